@@ -0,0 +1,103 @@
+/*
+    Craft Metrics
+
+    This product includes software developed by
+    Craft Metrics (https://craftmetrics.ca/).
+
+    MIT License
+    Copyright (c) 2018 Craft Metrics
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#include "mcp342x_export.h"
+#include "mcp342x.h"
+
+#include <benchmark/benchmark.h>
+
+#include <vector>
+
+/**
+ * Export throughput on a slowly changing 18-bit capture with +/-100 us jitter
+ */
+static const size_t SAMPLES = 4096;
+
+static const mcp342x_sample_t *_samples(void)
+{
+    static mcp342x_sample_t samples[SAMPLES];
+    uint32_t state = 1;
+    int32_t code = 60000;
+    for (size_t i = 0; i < SAMPLES; i++)
+    {
+        state = state * 1664525 + 1013904223;
+        code += (int32_t)(state >> 26) - 32;
+        samples[i].code = code;
+        samples[i].ready_us = (uint32_t)(i * 266667) + (state >> 8) % 201 - 100;
+        samples[i].config = MCP342X_CHANNEL_1 | MCP342X_MODE_CONTINUOUS | MCP342X_SRATE_18BIT | MCP342X_GAIN_1X;
+        samples[i].status = MCP342X_STATUS_OK;
+    }
+    return samples;
+}
+
+static void BM_Encode(benchmark::State &state)
+{
+    const mcp342x_sample_t *samples = _samples();
+    std::vector<uint8_t> buffer(SAMPLES * 8);
+    mcp342x_export_encoder_t encoder;
+    for (auto _ : state)
+    {
+        mcp342x_export_init(&encoder, buffer.data(), buffer.size());
+        for (size_t i = 0; i < SAMPLES; i++)
+        {
+            mcp342x_export_append(&encoder, &samples[i]);
+        }
+        mcp342x_export_close(&encoder);
+        benchmark::DoNotOptimize(buffer.data());
+    }
+    state.SetItemsProcessed(state.iterations() * SAMPLES);
+    state.counters["bytes/sample"] = (double)encoder.length / SAMPLES;
+}
+
+static void BM_Decode(benchmark::State &state)
+{
+    const mcp342x_sample_t *samples = _samples();
+    std::vector<uint8_t> buffer(SAMPLES * 8);
+    mcp342x_export_encoder_t encoder;
+    mcp342x_export_init(&encoder, buffer.data(), buffer.size());
+    for (size_t i = 0; i < SAMPLES; i++)
+    {
+        mcp342x_export_append(&encoder, &samples[i]);
+    }
+    mcp342x_export_close(&encoder);
+
+    mcp342x_export_decoder_t decoder;
+    mcp342x_export_record_t record;
+    for (auto _ : state)
+    {
+        mcp342x_export_decoder_init(&decoder, buffer.data(), encoder.length);
+        while (mcp342x_export_next(&decoder, &record))
+        {
+            benchmark::DoNotOptimize(record);
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * SAMPLES);
+}
+
+BENCHMARK(BM_Encode);
+BENCHMARK(BM_Decode);
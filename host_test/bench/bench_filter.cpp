@@ -0,0 +1,90 @@
+/*
+    Craft Metrics
+
+    This product includes software developed by
+    Craft Metrics (https://craftmetrics.ca/).
+
+    MIT License
+    Copyright (c) 2018 Craft Metrics
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#include "mcp342x_filter.h"
+
+#include <benchmark/benchmark.h>
+
+/**
+ * Filter kernels, CPU time per input code on noisy 18-bit codes
+ */
+static const size_t CODES = 4096;
+
+static const int32_t *_codes(void)
+{
+    static int32_t codes[CODES];
+    uint32_t state = 1;
+    for (size_t i = 0; i < CODES; i++)
+    {
+        state = state * 1664525 + 1013904223;
+        codes[i] = 50000 + (int32_t)(state >> 24) - 128;
+    }
+    return codes;
+}
+
+static void _run(benchmark::State &state, mcp342x_filter_t *filter)
+{
+    const int32_t *codes = _codes();
+    int32_t output = 0;
+    for (auto _ : state)
+    {
+        for (size_t i = 0; i < CODES; i++)
+        {
+            benchmark::DoNotOptimize(mcp342x_filter_push(filter, codes[i], &output));
+        }
+    }
+    benchmark::DoNotOptimize(output);
+    state.SetItemsProcessed(state.iterations() * CODES);
+    state.counters["ns/code"] = benchmark::Counter(state.iterations() * CODES, benchmark::Counter::kIsRate | benchmark::Counter::kInvert);
+}
+
+static void BM_Boxcar(benchmark::State &state)
+{
+    mcp342x_filter_t filter;
+    mcp342x_filter_init_boxcar(&filter, state.range(0));
+    _run(state, &filter);
+}
+
+static void BM_Cic(benchmark::State &state)
+{
+    mcp342x_filter_t filter;
+    mcp342x_filter_init_cic(&filter, state.range(0), state.range(1));
+    _run(state, &filter);
+}
+
+static void BM_Median(benchmark::State &state)
+{
+    static int32_t buffer[2 * 64];
+    mcp342x_filter_t filter;
+    mcp342x_filter_init_median(&filter, state.range(0), state.range(1), buffer);
+    _run(state, &filter);
+}
+
+BENCHMARK(BM_Boxcar)->Arg(16)->Arg(MCP342X_FILTER_MAX_GAIN);
+BENCHMARK(BM_Cic)->Args({16, 1})->Args({16, 2})->Args({11, 4});
+BENCHMARK(BM_Median)->Args({1, 5})->Args({8, 15})->Args({16, 63});
@@ -0,0 +1,113 @@
+/*
+    Craft Metrics
+
+    This product includes software developed by
+    Craft Metrics (https://craftmetrics.ca/).
+
+    MIT License
+    Copyright (c) 2018 Craft Metrics
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#include "mcp342x_sim.h"
+
+#include <time.h>
+#include <benchmark/benchmark.h>
+
+/**
+ * Read modes against the simulated bus at 400 kHz, one iteration per sample.
+ * Reports samples/s, bus bytes per sample, bus utilisation and CPU ns per sample.
+ */
+static const uint8_t ADDRESS = MCP342X_A0GND_A1GND;
+
+static int64_t _thread_cpu_ns(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+    return (int64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+static void _report(benchmark::State &state, int64_t cpu_ns)
+{
+    mcp342x_sim_stats_t sim_stats;
+    mcp342x_sim_get_stats(&sim_stats);
+    double samples = state.iterations();
+    state.SetItemsProcessed(state.iterations());
+    state.counters["bytes/sample"] = sim_stats.bytes / samples;
+    state.counters["transactions/sample"] = sim_stats.transactions / samples;
+    state.counters["bus_busy_us/sample"] = sim_stats.busy_us / samples;
+    state.counters["cpu_ns/sample"] = cpu_ns / samples;
+}
+
+static void _setup(smbus_info_t *smbus_info, mcp342x_info_t *info, mcp342x_conversion_mode_t mode,
+                   mcp342x_sample_rate_t rate, mcp342x_wait_mode_t wait_mode)
+{
+    mcp342x_sim_reset();
+    mcp342x_sim_set_clock(400000, true);
+    mcp342x_sim_add_device(ADDRESS, 4, true);
+    mcp342x_sim_set_input(ADDRESS, 0, 100000000);
+    smbus_init(smbus_info, 0, ADDRESS);
+    mcp342x_config_t config = {MCP342X_CHANNEL_1, mode, rate, MCP342X_GAIN_1X};
+    mcp342x_init(info, smbus_info, config);
+    mcp342x_set_wait_mode(info, wait_mode);
+    mcp342x_sim_reset_stats();
+}
+
+/**
+ * One-shot: trigger, then wait for the result
+ */
+static void BM_OneShot(benchmark::State &state, mcp342x_wait_mode_t wait_mode)
+{
+    smbus_info_t smbus_info;
+    mcp342x_info_t info = {};
+    _setup(&smbus_info, &info, MCP342X_MODE_ONESHOT, (mcp342x_sample_rate_t)state.range(0), wait_mode);
+    int64_t cpu_ns = _thread_cpu_ns();
+    for (auto _ : state)
+    {
+        int32_t code;
+        mcp342x_start_new_conversion(&info);
+        benchmark::DoNotOptimize(mcp342x_read_raw(&info, &code));
+    }
+    _report(state, _thread_cpu_ns() - cpu_ns);
+}
+
+/**
+ * Continuous: every read waits for the next result of the running conversions
+ */
+static void BM_Continuous(benchmark::State &state, mcp342x_wait_mode_t wait_mode)
+{
+    smbus_info_t smbus_info;
+    mcp342x_info_t info = {};
+    _setup(&smbus_info, &info, MCP342X_MODE_CONTINUOUS, (mcp342x_sample_rate_t)state.range(0), wait_mode);
+    int64_t cpu_ns = _thread_cpu_ns();
+    for (auto _ : state)
+    {
+        mcp342x_sample_t sample;
+        benchmark::DoNotOptimize(mcp342x_read_sample(&info, &sample));
+    }
+    _report(state, _thread_cpu_ns() - cpu_ns);
+}
+
+#define READ_MODE_ARGS ->Arg(MCP342X_SRATE_12BIT)->Arg(MCP342X_SRATE_14BIT)->Arg(MCP342X_SRATE_16BIT)->Arg(MCP342X_SRATE_18BIT)->UseRealTime()->Unit(benchmark::kMillisecond)
+
+BENCHMARK_CAPTURE(BM_OneShot, sleep, MCP342X_WAIT_SLEEP) READ_MODE_ARGS;
+BENCHMARK_CAPTURE(BM_OneShot, poll, MCP342X_WAIT_POLL) READ_MODE_ARGS;
+BENCHMARK_CAPTURE(BM_Continuous, sleep, MCP342X_WAIT_SLEEP) READ_MODE_ARGS;
+BENCHMARK_CAPTURE(BM_Continuous, poll, MCP342X_WAIT_POLL) READ_MODE_ARGS;
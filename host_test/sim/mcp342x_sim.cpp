@@ -0,0 +1,583 @@
+/*
+    Craft Metrics
+
+    This product includes software developed by
+    Craft Metrics (https://craftmetrics.ca/).
+
+    MIT License
+    Copyright (c) 2018 Craft Metrics
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#include "mcp342x_sim.h"
+#include "host_time.h"
+
+#include <pthread.h>
+#include <string.h>
+#include <vector>
+#include <esp_timer.h>
+#include <driver/i2c.h>
+
+/*-----------------------------------------------------------
+* DEVICE MODEL
+*----------------------------------------------------------*/
+#define SIM_ADDRESSES (128)
+#define SIM_RDY (0x80)
+
+typedef struct
+{
+    bool present;
+    uint8_t channels;
+    bool has_18bit;
+    int32_t input_nv[4];
+    uint16_t noise_lsb;
+    uint32_t rng;
+    bool ramp;
+    bool forced;
+    int32_t forced_code;
+    uint16_t timing_percent;
+    uint32_t fail_count;
+
+    uint8_t config;             // config register without the RDY bit
+    bool converting;
+    int64_t start_us;
+    uint8_t converting_config;  // settings latched when the conversion started
+    int32_t output_code;
+    uint8_t output_bits;
+    bool fresh;                 // a result has not been read yet, RDY reads 0
+    uint32_t conversions;
+} sim_device_t;
+
+static pthread_mutex_t _lock = PTHREAD_MUTEX_INITIALIZER;
+static sim_device_t _devices[SIM_ADDRESSES];
+static uint32_t _general_call_fail_count;
+static mcp342x_sim_stats_t _stats;
+static uint32_t _clock_hz = 400000;
+static bool _block;
+
+static uint8_t _resolution(const sim_device_t *device, uint8_t config)
+{
+    uint8_t rate = (config & MCP342X_SRATE_MASK) >> 2;
+    if (rate == 3 && !device->has_18bit)
+    {
+        rate = 2;
+    }
+    return 12 + 2 * rate;
+}
+
+static int64_t _conversion_us(const sim_device_t *device, uint8_t config)
+{
+    static const int64_t nominal_us[] = {4167, 16667, 66667, 266667};
+    return nominal_us[(_resolution(device, config) - 12) / 2] * device->timing_percent / 100;
+}
+
+static uint8_t _channel(const sim_device_t *device, uint8_t config)
+{
+    uint8_t channel = (config & MCP342X_CHANNEL_MASK) >> 5;
+    return device->channels == 1 ? 0 : (device->channels == 2 ? channel & 1 : channel);
+}
+
+static int32_t _convert(sim_device_t *device, uint8_t config)
+{
+    uint8_t bits = _resolution(device, config);
+    int32_t code_max = (1 << (bits - 1)) - 1;
+    int32_t code_min = -(1 << (bits - 1));
+
+    if (device->forced)
+    {
+        return device->forced_code;
+    }
+    if (device->ramp)
+    {
+        return device->output_code < 0 || device->output_code >= code_max - 1 ? 0 : device->output_code + 1;
+    }
+
+    /**
+     * 1 mV per code at 12 bits and 1x, 4x finer per extra two bits, times the PGA gain
+     */
+    int64_t scaled = (int64_t)device->input_nv[_channel(device, config)] * (1 << (config & MCP342X_GAIN_MASK));
+    scaled *= 1 << (bits - 12);
+    int64_t code = (scaled >= 0 ? scaled + 500000 : scaled - 500000) / 1000000;
+    if (device->noise_lsb > 0)
+    {
+        device->rng = device->rng * 1103515245 + 12345;
+        code += (int32_t)((device->rng >> 16) % (2 * device->noise_lsb + 1)) - device->noise_lsb;
+    }
+    return code > code_max ? code_max : (code < code_min ? code_min : (int32_t)code);
+}
+
+static void _start_conversion(sim_device_t *device, int64_t now_us)
+{
+    device->converting = true;
+    device->start_us = now_us;
+    device->converting_config = device->config;
+    device->fresh = false;
+}
+
+/**
+ * Finish every conversion that is due by now, continuous mode starts the next one straight away
+ */
+static void _update(sim_device_t *device, int64_t now_us)
+{
+    while (device->converting)
+    {
+        int64_t conversion_us = _conversion_us(device, device->converting_config);
+        int64_t done_us = device->start_us + conversion_us;
+        if (now_us < done_us)
+        {
+            break;
+        }
+        device->output_code = _convert(device, device->converting_config);
+        device->output_bits = _resolution(device, device->converting_config);
+        device->fresh = true;
+        device->conversions++;
+        if ((device->config & MCP342X_MODE_MASK) != MCP342X_MODE_CONTINUOUS)
+        {
+            device->converting = false;
+            break;
+        }
+        device->start_us = conversion_us > 0 ? done_us : now_us;
+        device->converting_config = device->config;
+        if (conversion_us == 0)
+        {
+            break;
+        }
+    }
+}
+
+static void _power_on(sim_device_t *device, int64_t now_us)
+{
+    device->config = MCP342X_MODE_CONTINUOUS;
+    device->output_code = 0;
+    device->output_bits = 12;
+    _start_conversion(device, now_us);
+}
+
+static void _write_config(sim_device_t *device, uint8_t data, int64_t now_us)
+{
+    /**
+     * Single channel parts leave the channel bits unimplemented, they read back as zero
+     */
+    device->config = data & ~SIM_RDY;
+    if (device->channels == 1)
+    {
+        device->config &= ~MCP342X_CHANNEL_MASK;
+    }
+    if ((data & SIM_RDY) || (device->config & MCP342X_MODE_MASK) == MCP342X_MODE_CONTINUOUS)
+    {
+        _start_conversion(device, now_us);
+    }
+}
+
+/**
+ * Output register: the data bytes of the last result, sign extended, then the
+ * config register repeated. The layout follows the current resolution setting.
+ */
+static void _output_register(const sim_device_t *device, uint8_t *out, size_t len)
+{
+    uint8_t config = device->config | (device->fresh ? 0 : SIM_RDY);
+    uint32_t code = (uint32_t)device->output_code;
+    size_t n = 0;
+    if (_resolution(device, device->config) == 18)
+    {
+        out[n++] = code >> 16;
+    }
+    out[n++] = code >> 8;
+    out[n++] = code;
+    while (n < len)
+    {
+        out[n++] = config;
+    }
+}
+
+static void _general_call(uint8_t command, int64_t now_us)
+{
+    for (size_t address = 0; address < SIM_ADDRESSES; address++)
+    {
+        sim_device_t *device = &_devices[address];
+        if (!device->present)
+        {
+            continue;
+        }
+        _update(device, now_us);
+        if (command == MCP342X_GC_RESET)
+        {
+            _power_on(device, now_us);
+        }
+        else if (command == MCP342X_GC_CONVERSION)
+        {
+            _start_conversion(device, now_us);
+        }
+    }
+}
+
+/*-----------------------------------------------------------
+* BUS
+*----------------------------------------------------------*/
+typedef enum
+{
+    SIM_OP_START,
+    SIM_OP_WRITE,
+    SIM_OP_READ,
+    SIM_OP_STOP,
+} sim_op_kind_t;
+
+typedef struct
+{
+    sim_op_kind_t kind;
+    uint8_t byte;
+    uint8_t *data;
+    size_t len;
+} sim_op_t;
+
+typedef std::vector<sim_op_t> sim_link_t;
+
+static bool _fails(uint32_t *fail_count)
+{
+    if (*fail_count == 0)
+    {
+        return false;
+    }
+    if (*fail_count != MCP342X_SIM_FOREVER)
+    {
+        (*fail_count)--;
+    }
+    return true;
+}
+
+static void _wire_time(uint32_t bytes)
+{
+    // START, 9 clocks per byte with the acknowledge, STOP
+    uint64_t busy_us = ((uint64_t)(2 + 9 * bytes) * 1000000 + _clock_hz - 1) / _clock_hz;
+    _stats.busy_us += busy_us;
+    if (_block)
+    {
+        host_sleep_until_us(host_time_us() + busy_us);
+    }
+}
+
+/**
+ * Play one command link on the wire. A NACK ends the link like the driver does.
+ */
+static esp_err_t _run(const sim_link_t &link)
+{
+    int64_t now_us = esp_timer_get_time();
+    sim_device_t *device = NULL;
+    bool general_call = false;
+    bool addressed = false;
+    bool reading = false;
+    uint8_t output[8];
+    size_t output_pos = 0;
+    uint32_t bytes = 0;
+    esp_err_t err = ESP_OK;
+
+    pthread_mutex_lock(&_lock);
+    _stats.links++;
+    for (const sim_op_t &op : link)
+    {
+        if (op.kind == SIM_OP_START || op.kind == SIM_OP_STOP)
+        {
+            if (reading && device != NULL)
+            {
+                // Reading the output register clears its ready state
+                device->fresh = false;
+            }
+            addressed = false;
+            reading = false;
+            if (op.kind == SIM_OP_START)
+            {
+                device = NULL;
+                general_call = false;
+            }
+            continue;
+        }
+        if (op.kind == SIM_OP_WRITE && !addressed)
+        {
+            uint8_t address = op.byte >> 1;
+            bytes++;
+            _stats.transactions++;
+            addressed = true;
+            general_call = (address == MCP342X_GC_START);
+            device = general_call ? NULL : &_devices[address & (SIM_ADDRESSES - 1)];
+            bool fail = general_call ? _fails(&_general_call_fail_count) : (!device->present || _fails(&device->fail_count));
+            if (fail)
+            {
+                _stats.nacks++;
+                err = ESP_FAIL;
+                break;
+            }
+            reading = (op.byte & 1) != 0;
+            if (reading)
+            {
+                _stats.reads++;
+                _update(device, now_us);
+                _output_register(device, output, sizeof(output));
+                output_pos = 0;
+            }
+            else
+            {
+                _stats.writes++;
+                _stats.general_calls += general_call ? 1 : 0;
+            }
+            continue;
+        }
+        if (op.kind == SIM_OP_WRITE)
+        {
+            bytes++;
+            if (general_call)
+            {
+                _general_call(op.byte, now_us);
+            }
+            else
+            {
+                _update(device, now_us);
+                _write_config(device, op.byte, now_us);
+            }
+            continue;
+        }
+        for (size_t i = 0; i < op.len; i++)
+        {
+            op.data[i] = output[output_pos < sizeof(output) ? output_pos : sizeof(output) - 1];
+            output_pos++;
+        }
+        bytes += op.len;
+    }
+    _stats.bytes += bytes;
+    _wire_time(bytes);
+    pthread_mutex_unlock(&_lock);
+    return err;
+}
+
+static esp_err_t _sim_write(void *, const smbus_info_t *smbus_info, const uint8_t *data, size_t len)
+{
+    sim_link_t link;
+    link.push_back({SIM_OP_START, 0, NULL, 0});
+    link.push_back({SIM_OP_WRITE, (uint8_t)(smbus_info->address << 1), NULL, 0});
+    for (size_t i = 0; i < len; i++)
+    {
+        link.push_back({SIM_OP_WRITE, data[i], NULL, 0});
+    }
+    link.push_back({SIM_OP_STOP, 0, NULL, 0});
+    return _run(link);
+}
+
+static esp_err_t _sim_read(void *, const smbus_info_t *smbus_info, uint8_t *data, size_t len)
+{
+    sim_link_t link;
+    link.push_back({SIM_OP_START, 0, NULL, 0});
+    link.push_back({SIM_OP_WRITE, (uint8_t)((smbus_info->address << 1) | 1), NULL, 0});
+    link.push_back({SIM_OP_READ, 0, data, len});
+    link.push_back({SIM_OP_STOP, 0, NULL, 0});
+    return _run(link);
+}
+
+const mcp342x_bus_t mcp342x_sim_bus = {NULL, _sim_write, _sim_read};
+
+/*-----------------------------------------------------------
+* I2C COMMAND LINKS
+*----------------------------------------------------------*/
+i2c_cmd_handle_t i2c_cmd_link_create(void)
+{
+    return new sim_link_t();
+}
+
+void i2c_cmd_link_delete(i2c_cmd_handle_t cmd_handle)
+{
+    delete (sim_link_t *)cmd_handle;
+}
+
+esp_err_t i2c_master_start(i2c_cmd_handle_t cmd_handle)
+{
+    ((sim_link_t *)cmd_handle)->push_back({SIM_OP_START, 0, NULL, 0});
+    return ESP_OK;
+}
+
+esp_err_t i2c_master_stop(i2c_cmd_handle_t cmd_handle)
+{
+    ((sim_link_t *)cmd_handle)->push_back({SIM_OP_STOP, 0, NULL, 0});
+    return ESP_OK;
+}
+
+esp_err_t i2c_master_write_byte(i2c_cmd_handle_t cmd_handle, uint8_t data, bool)
+{
+    ((sim_link_t *)cmd_handle)->push_back({SIM_OP_WRITE, data, NULL, 0});
+    return ESP_OK;
+}
+
+esp_err_t i2c_master_write(i2c_cmd_handle_t cmd_handle, const uint8_t *data, size_t data_len, bool ack_en)
+{
+    for (size_t i = 0; i < data_len; i++)
+    {
+        i2c_master_write_byte(cmd_handle, data[i], ack_en);
+    }
+    return ESP_OK;
+}
+
+esp_err_t i2c_master_read_byte(i2c_cmd_handle_t cmd_handle, uint8_t *data, i2c_ack_type_t)
+{
+    ((sim_link_t *)cmd_handle)->push_back({SIM_OP_READ, 0, data, 1});
+    return ESP_OK;
+}
+
+esp_err_t i2c_master_read(i2c_cmd_handle_t cmd_handle, uint8_t *data, size_t data_len, i2c_ack_type_t)
+{
+    ((sim_link_t *)cmd_handle)->push_back({SIM_OP_READ, 0, data, data_len});
+    return ESP_OK;
+}
+
+esp_err_t i2c_master_cmd_begin(i2c_port_t, i2c_cmd_handle_t cmd_handle, TickType_t)
+{
+    return _run(*(sim_link_t *)cmd_handle);
+}
+
+/*-----------------------------------------------------------
+* CONTROL
+*----------------------------------------------------------*/
+void mcp342x_sim_set_time_scale(uint32_t scale)
+{
+    host_time_set_scale(scale);
+}
+
+void mcp342x_sim_reset(void)
+{
+    pthread_mutex_lock(&_lock);
+    memset(_devices, 0, sizeof(_devices));
+    memset(&_stats, 0, sizeof(_stats));
+    _general_call_fail_count = 0;
+    _clock_hz = 400000;
+    _block = false;
+    pthread_mutex_unlock(&_lock);
+}
+
+void mcp342x_sim_add_device(uint8_t address, uint8_t channels, bool has_18bit)
+{
+    pthread_mutex_lock(&_lock);
+    sim_device_t *device = &_devices[address & (SIM_ADDRESSES - 1)];
+    memset(device, 0, sizeof(*device));
+    device->present = true;
+    device->channels = channels;
+    device->has_18bit = has_18bit;
+    device->timing_percent = 100;
+    device->rng = address;
+    _power_on(device, esp_timer_get_time());
+    pthread_mutex_unlock(&_lock);
+}
+
+void mcp342x_sim_remove_device(uint8_t address)
+{
+    pthread_mutex_lock(&_lock);
+    _devices[address & (SIM_ADDRESSES - 1)].present = false;
+    pthread_mutex_unlock(&_lock);
+}
+
+void mcp342x_sim_set_input(uint8_t address, uint8_t channel, int32_t nanovolts)
+{
+    pthread_mutex_lock(&_lock);
+    _devices[address & (SIM_ADDRESSES - 1)].input_nv[channel & 3] = nanovolts;
+    pthread_mutex_unlock(&_lock);
+}
+
+void mcp342x_sim_set_noise(uint8_t address, uint16_t noise_lsb)
+{
+    pthread_mutex_lock(&_lock);
+    _devices[address & (SIM_ADDRESSES - 1)].noise_lsb = noise_lsb;
+    pthread_mutex_unlock(&_lock);
+}
+
+void mcp342x_sim_set_ramp(uint8_t address, bool enable)
+{
+    pthread_mutex_lock(&_lock);
+    _devices[address & (SIM_ADDRESSES - 1)].ramp = enable;
+    pthread_mutex_unlock(&_lock);
+}
+
+void mcp342x_sim_force_code(uint8_t address, bool enable, int32_t code)
+{
+    pthread_mutex_lock(&_lock);
+    sim_device_t *device = &_devices[address & (SIM_ADDRESSES - 1)];
+    device->forced = enable;
+    device->forced_code = code;
+    pthread_mutex_unlock(&_lock);
+}
+
+void mcp342x_sim_set_timing(uint8_t address, uint16_t percent)
+{
+    pthread_mutex_lock(&_lock);
+    sim_device_t *device = &_devices[address & (SIM_ADDRESSES - 1)];
+    _update(device, esp_timer_get_time());
+    device->timing_percent = percent;
+    pthread_mutex_unlock(&_lock);
+}
+
+void mcp342x_sim_fail(uint8_t address, uint32_t count)
+{
+    pthread_mutex_lock(&_lock);
+    if (address == MCP342X_GC_START)
+    {
+        _general_call_fail_count = count;
+    }
+    else
+    {
+        _devices[address & (SIM_ADDRESSES - 1)].fail_count = count;
+    }
+    pthread_mutex_unlock(&_lock);
+}
+
+void mcp342x_sim_set_clock(uint32_t clock_hz, bool block)
+{
+    pthread_mutex_lock(&_lock);
+    _clock_hz = clock_hz;
+    _block = block;
+    pthread_mutex_unlock(&_lock);
+}
+
+void mcp342x_sim_get_stats(mcp342x_sim_stats_t *stats)
+{
+    pthread_mutex_lock(&_lock);
+    *stats = _stats;
+    pthread_mutex_unlock(&_lock);
+}
+
+void mcp342x_sim_reset_stats(void)
+{
+    pthread_mutex_lock(&_lock);
+    memset(&_stats, 0, sizeof(_stats));
+    pthread_mutex_unlock(&_lock);
+}
+
+uint8_t mcp342x_sim_config(uint8_t address)
+{
+    pthread_mutex_lock(&_lock);
+    sim_device_t *device = &_devices[address & (SIM_ADDRESSES - 1)];
+    _update(device, esp_timer_get_time());
+    uint8_t config = device->config | (device->fresh ? 0 : SIM_RDY);
+    pthread_mutex_unlock(&_lock);
+    return config;
+}
+
+uint32_t mcp342x_sim_conversions(uint8_t address)
+{
+    pthread_mutex_lock(&_lock);
+    sim_device_t *device = &_devices[address & (SIM_ADDRESSES - 1)];
+    _update(device, esp_timer_get_time());
+    uint32_t conversions = device->conversions;
+    pthread_mutex_unlock(&_lock);
+    return conversions;
+}
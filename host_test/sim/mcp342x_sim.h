@@ -0,0 +1,147 @@
+/*
+Craft Metrics
+
+This product includes software developed by
+Craft Metrics (https://craftmetrics.ca/).
+
+MIT License
+Copyright (c) 2018 Craft Metrics
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+/**
+ * @file mcp342x_sim.h
+ * @brief Behavioural MCP342x simulator for host builds.
+ *
+ * Models devices on one I2C bus: conversion time per resolution, the ready
+ * bit, one-shot and continuous modes, general calls, per-channel input
+ * voltages and the 12 to 18-bit output register layouts. It is reachable
+ * both as an mcp342x_bus_t backend (mcp342x_sim_bus) and through the host
+ * i2c command link stand-ins, so the default mcp342x_i2c_bus path runs
+ * against it too. Time is the host clock, so a 3.75 sps conversion really
+ * takes 266 ms, unless the clock is slowed down with mcp342x_sim_set_time_scale.
+ */
+
+#ifndef MCP342X_SIM_H
+#define MCP342X_SIM_H
+
+#include "mcp342x.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+// Fault count that never runs out, the device stays off the bus
+#define MCP342X_SIM_FOREVER (0xFFFFFFFFUL)
+
+/**
+ * Bus counters, a transaction runs from a (repeated) START to the next one or STOP
+ */
+typedef struct MCP342xSimStats
+{
+    uint32_t links;          // i2c_master_cmd_begin calls or mcp342x_sim_bus transfers
+    uint32_t transactions;   // address phases on the wire
+    uint32_t reads;          // read transactions that were acknowledged
+    uint32_t writes;         // write transactions that were acknowledged, general calls included
+    uint32_t general_calls;  // acknowledged general calls
+    uint32_t nacks;          // transactions not acknowledged
+    uint32_t bytes;          // bytes on the wire, address bytes included
+    uint64_t busy_us;        // time the bus was busy at the configured clock
+} mcp342x_sim_stats_t;
+
+extern const mcp342x_bus_t mcp342x_sim_bus;
+
+/**
+ * Remove all devices, faults and counters and go back to a 400 kHz clock that only accounts time
+ */
+void mcp342x_sim_reset(void);
+
+/**
+ * Power up a device with 1, 2 or 4 inputs, all at 0 V.
+ * Parts without 18-bit support convert at 16 bits when 18 bits is selected.
+ */
+void mcp342x_sim_add_device(uint8_t address, uint8_t channels, bool has_18bit);
+void mcp342x_sim_remove_device(uint8_t address);
+
+/**
+ * Differential input voltage of channel 0 - 3 in nanovolts
+ */
+void mcp342x_sim_set_input(uint8_t address, uint8_t channel, int32_t nanovolts);
+
+/**
+ * Random noise of up to +/- noise_lsb codes on every conversion, from a fixed seed
+ */
+void mcp342x_sim_set_noise(uint8_t address, uint16_t noise_lsb);
+
+/**
+ * Each conversion outputs the previous code plus one, wrapping below full scale,
+ * so dropped or repeated samples show up as gaps in the sequence
+ */
+void mcp342x_sim_set_ramp(uint8_t address, bool enable);
+
+/**
+ * Output this code from every conversion instead of the input voltage
+ */
+void mcp342x_sim_force_code(uint8_t address, bool enable, int32_t code);
+
+/**
+ * Scale the conversion time to percent of nominal, 0 finishes conversions at once
+ */
+void mcp342x_sim_set_timing(uint8_t address, uint16_t percent);
+
+/**
+ * Fail the next count transactions addressed to the device with a NACK.
+ * Address MCP342X_GC_START fails general calls instead.
+ */
+void mcp342x_sim_fail(uint8_t address, uint32_t count);
+
+/**
+ * Bus clock used for busy time, when block is set transfers also take that long
+ */
+void mcp342x_sim_set_clock(uint32_t clock_hz, bool block);
+
+/**
+ * Slow the clock of the simulator, esp_timer and FreeRTOS stand-ins down by
+ * scale against the host clock, 1 is real time. Host scheduling stalls then
+ * shrink by the same factor in simulated time, so timing tests stay exact on
+ * a loaded host. Not reset by mcp342x_sim_reset.
+ */
+void mcp342x_sim_set_time_scale(uint32_t scale);
+
+void mcp342x_sim_get_stats(mcp342x_sim_stats_t *stats);
+void mcp342x_sim_reset_stats(void);
+
+/**
+ * Current config register of the device, RDY bit included
+ */
+uint8_t mcp342x_sim_config(uint8_t address);
+
+/**
+ * Conversions the device has finished since it was added
+ */
+uint32_t mcp342x_sim_conversions(uint8_t address);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // MCP342X_SIM_H
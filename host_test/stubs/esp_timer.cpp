@@ -0,0 +1,195 @@
+/*
+    Craft Metrics
+
+    This product includes software developed by
+    Craft Metrics (https://craftmetrics.ca/).
+
+    MIT License
+    Copyright (c) 2018 Craft Metrics
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#include "host_time.h"
+
+#include <pthread.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <esp_timer.h>
+
+/**
+ * One-shot timers on POSIX timer_create. Expiries arrive on SIGEV_THREAD
+ * threads and are funnelled through one recursive lock, so callbacks run one
+ * at a time like on the esp_timer task. The sigevent carries a slot number and
+ * generation rather than a pointer, so an expiry that races esp_timer_delete
+ * finds a stale generation and is dropped, as is a stale expiry from before
+ * a stop and restart, which arrives ahead of the current deadline.
+ */
+#define HOST_TIMER_SLOTS (64)
+
+struct esp_timer
+{
+    timer_t timer;
+    esp_timer_cb_t callback;
+    void *arg;
+    uint16_t slot;
+    uint16_t generation;
+    bool armed;
+    int64_t expiry_us;
+};
+
+static struct esp_timer *_timers[HOST_TIMER_SLOTS];
+static uint16_t _generations[HOST_TIMER_SLOTS];
+static pthread_mutex_t _dispatch_lock;
+static pthread_once_t _dispatch_once = PTHREAD_ONCE_INIT;
+
+static void _dispatch_init(void)
+{
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&_dispatch_lock, &attr);
+    pthread_mutexattr_destroy(&attr);
+}
+
+static void _dispatch_lock_take(void)
+{
+    pthread_once(&_dispatch_once, _dispatch_init);
+    pthread_mutex_lock(&_dispatch_lock);
+}
+
+static void _on_expiry(union sigval value)
+{
+    uint16_t slot = (uint32_t)value.sival_int >> 16;
+    uint16_t generation = (uint32_t)value.sival_int & 0xFFFF;
+
+    _dispatch_lock_take();
+    struct esp_timer *timer = _timers[slot];
+    if (timer != NULL && timer->generation == generation && timer->armed &&
+        host_time_us() >= timer->expiry_us)
+    {
+        timer->armed = false;
+        timer->callback(timer->arg);
+    }
+    pthread_mutex_unlock(&_dispatch_lock);
+}
+
+int64_t esp_timer_get_time(void)
+{
+    return host_time_us();
+}
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t *create_args, esp_timer_handle_t *out_handle)
+{
+    if (create_args == NULL || create_args->callback == NULL || out_handle == NULL)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    _dispatch_lock_take();
+    int slot = 0;
+    while (slot < HOST_TIMER_SLOTS && _timers[slot] != NULL)
+    {
+        slot++;
+    }
+    if (slot == HOST_TIMER_SLOTS)
+    {
+        pthread_mutex_unlock(&_dispatch_lock);
+        return ESP_ERR_NO_MEM;
+    }
+
+    struct esp_timer *timer = (struct esp_timer *)calloc(1, sizeof(*timer));
+    timer->callback = create_args->callback;
+    timer->arg = create_args->arg;
+    timer->slot = slot;
+    timer->generation = ++_generations[slot];
+
+    struct sigevent event;
+    memset(&event, 0, sizeof(event));
+    event.sigev_notify = SIGEV_THREAD;
+    event.sigev_notify_function = _on_expiry;
+    event.sigev_value.sival_int = (int)(((uint32_t)timer->slot << 16) | timer->generation);
+    if (timer_create(CLOCK_MONOTONIC, &event, &timer->timer) != 0)
+    {
+        free(timer);
+        pthread_mutex_unlock(&_dispatch_lock);
+        return ESP_FAIL;
+    }
+    _timers[slot] = timer;
+    pthread_mutex_unlock(&_dispatch_lock);
+
+    *out_handle = timer;
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us)
+{
+    _dispatch_lock_take();
+    if (timer->armed)
+    {
+        pthread_mutex_unlock(&_dispatch_lock);
+        return ESP_ERR_INVALID_STATE;
+    }
+    /**
+     * Arm at an absolute host time, so the expiry follows the clock scale.
+     * A zero it_value would disarm the timer, expire after 1 us instead.
+     */
+    struct itimerspec spec;
+    memset(&spec, 0, sizeof(spec));
+    timeout_us = timeout_us > 0 ? timeout_us : 1;
+    timer->armed = true;
+    timer->expiry_us = host_time_us() + timeout_us;
+    spec.it_value = host_timespec(timer->expiry_us);
+    esp_err_t err = timer_settime(timer->timer, TIMER_ABSTIME, &spec, NULL) == 0 ? ESP_OK : ESP_FAIL;
+    timer->armed = (err == ESP_OK);
+    pthread_mutex_unlock(&_dispatch_lock);
+    return err;
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer)
+{
+    _dispatch_lock_take();
+    if (!timer->armed)
+    {
+        pthread_mutex_unlock(&_dispatch_lock);
+        return ESP_ERR_INVALID_STATE;
+    }
+    struct itimerspec spec;
+    memset(&spec, 0, sizeof(spec));
+    timer_settime(timer->timer, 0, &spec, NULL);
+    timer->armed = false;
+    pthread_mutex_unlock(&_dispatch_lock);
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_delete(esp_timer_handle_t timer)
+{
+    _dispatch_lock_take();
+    if (timer->armed)
+    {
+        pthread_mutex_unlock(&_dispatch_lock);
+        return ESP_ERR_INVALID_STATE;
+    }
+    timer_delete(timer->timer);
+    _timers[timer->slot] = NULL;
+    pthread_mutex_unlock(&_dispatch_lock);
+    free(timer);
+    return ESP_OK;
+}
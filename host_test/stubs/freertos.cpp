@@ -0,0 +1,382 @@
+/*
+    Craft Metrics
+
+    This product includes software developed by
+    Craft Metrics (https://craftmetrics.ca/).
+
+    MIT License
+    Copyright (c) 2018 Craft Metrics
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#include "host_time.h"
+
+#include <errno.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/semphr.h>
+
+/*-----------------------------------------------------------
+* CLOCK
+*----------------------------------------------------------*/
+static int64_t _monotonic_us(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+static const int64_t _epoch_us = _monotonic_us();
+
+/**
+ * Host time runs scale times slower than CLOCK_MONOTONIC. A scale change
+ * rebases both clocks at the current instant, so host time stays continuous.
+ */
+static pthread_mutex_t _clock_lock = PTHREAD_MUTEX_INITIALIZER;
+static int64_t _base_monotonic_us = _epoch_us;
+static int64_t _base_us = 0;
+static uint32_t _scale = 1;
+
+int64_t host_time_us(void)
+{
+    pthread_mutex_lock(&_clock_lock);
+    int64_t time_us = _base_us + (_monotonic_us() - _base_monotonic_us) / _scale;
+    pthread_mutex_unlock(&_clock_lock);
+    return time_us;
+}
+
+struct timespec host_timespec(int64_t time_us)
+{
+    pthread_mutex_lock(&_clock_lock);
+    int64_t absolute_us = _base_monotonic_us + (time_us - _base_us) * _scale;
+    pthread_mutex_unlock(&_clock_lock);
+    struct timespec ts;
+    ts.tv_sec = absolute_us / 1000000;
+    ts.tv_nsec = (absolute_us % 1000000) * 1000;
+    return ts;
+}
+
+void host_time_set_scale(uint32_t scale)
+{
+    pthread_mutex_lock(&_clock_lock);
+    int64_t now_us = _monotonic_us();
+    _base_us += (now_us - _base_monotonic_us) / _scale;
+    _base_monotonic_us = now_us;
+    _scale = scale > 0 ? scale : 1;
+    pthread_mutex_unlock(&_clock_lock);
+}
+
+void host_sleep_until_us(int64_t time_us)
+{
+    struct timespec ts = host_timespec(time_us);
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+    {
+    }
+}
+
+int64_t host_tick_deadline_us(uint32_t ticks)
+{
+    if (ticks == portMAX_DELAY)
+    {
+        return -1;
+    }
+    return host_time_us() + (int64_t)ticks * 1000000 / configTICK_RATE_HZ;
+}
+
+void host_assert_failed(const char *file, int line)
+{
+    fprintf(stderr, "assert failed at %s:%d\n", file, line);
+    abort();
+}
+
+static void _cond_init(pthread_cond_t *cond)
+{
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(cond, &attr);
+    pthread_condattr_destroy(&attr);
+}
+
+/**
+ * Wait on cond until the deadline, -1 waits forever. Returns false on timeout.
+ */
+static bool _cond_wait(pthread_cond_t *cond, pthread_mutex_t *mutex, int64_t deadline_us)
+{
+    if (deadline_us < 0)
+    {
+        pthread_cond_wait(cond, mutex);
+        return true;
+    }
+    struct timespec ts = host_timespec(deadline_us);
+    return pthread_cond_timedwait(cond, mutex, &ts) != ETIMEDOUT;
+}
+
+/*-----------------------------------------------------------
+* TASKS
+*----------------------------------------------------------*/
+struct host_task
+{
+    pthread_t thread;
+    TaskFunction_t function;
+    void *arg;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    uint32_t notify_value;
+};
+
+static thread_local struct host_task *_current_task = NULL;
+
+static struct host_task *_task_new(void)
+{
+    struct host_task *task = (struct host_task *)calloc(1, sizeof(*task));
+    pthread_mutex_init(&task->mutex, NULL);
+    _cond_init(&task->cond);
+    return task;
+}
+
+static void *_task_entry(void *arg)
+{
+    struct host_task *task = (struct host_task *)arg;
+    _current_task = task;
+    task->function(task->arg);
+    return NULL;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t function, const char *, uint32_t, void *arg, UBaseType_t, TaskHandle_t *handle)
+{
+    struct host_task *task = _task_new();
+    task->function = function;
+    task->arg = arg;
+    if (pthread_create(&task->thread, NULL, _task_entry, task) != 0)
+    {
+        free(task);
+        return pdFAIL;
+    }
+    pthread_detach(task->thread);
+    if (handle != NULL)
+    {
+        *handle = task;
+    }
+    return pdPASS;
+}
+
+void vTaskDelete(TaskHandle_t task)
+{
+    configASSERT(task == NULL || task == _current_task);
+    /**
+     * The handle stays valid, a late notification to a deleted task is harmless
+     */
+    pthread_exit(NULL);
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+    int64_t tick_us = 1000000 / configTICK_RATE_HZ;
+    host_sleep_until_us((host_time_us() / tick_us + ticks) * tick_us);
+}
+
+TickType_t xTaskGetTickCount(void)
+{
+    return (TickType_t)(host_time_us() * configTICK_RATE_HZ / 1000000);
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void)
+{
+    if (_current_task == NULL)
+    {
+        _current_task = _task_new();
+        _current_task->thread = pthread_self();
+    }
+    return _current_task;
+}
+
+void taskYIELD(void)
+{
+    sched_yield();
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task)
+{
+    pthread_mutex_lock(&task->mutex);
+    task->notify_value++;
+    pthread_cond_signal(&task->cond);
+    pthread_mutex_unlock(&task->mutex);
+    return pdPASS;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t ticks_to_wait)
+{
+    struct host_task *task = xTaskGetCurrentTaskHandle();
+    int64_t deadline_us = host_tick_deadline_us(ticks_to_wait);
+    pthread_mutex_lock(&task->mutex);
+    while (task->notify_value == 0 && ticks_to_wait != 0)
+    {
+        if (!_cond_wait(&task->cond, &task->mutex, deadline_us))
+        {
+            break;
+        }
+    }
+    uint32_t value = task->notify_value;
+    if (value > 0)
+    {
+        task->notify_value = clear_on_exit ? 0 : value - 1;
+    }
+    pthread_mutex_unlock(&task->mutex);
+    return value;
+}
+
+/*-----------------------------------------------------------
+* SEMAPHORES
+*----------------------------------------------------------*/
+static SemaphoreHandle_t _semaphore_init(StaticSemaphore_t *semaphore, uint32_t count, bool is_static)
+{
+    pthread_mutex_init(&semaphore->mutex, NULL);
+    _cond_init(&semaphore->cond);
+    semaphore->count = count;
+    semaphore->max_count = 1;
+    semaphore->holder = NULL;
+    semaphore->depth = 0;
+    semaphore->is_static = is_static;
+    return semaphore;
+}
+
+static SemaphoreHandle_t _semaphore_new(uint32_t count)
+{
+    StaticSemaphore_t *semaphore = (StaticSemaphore_t *)malloc(sizeof(*semaphore));
+    return semaphore != NULL ? _semaphore_init(semaphore, count, false) : NULL;
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void)
+{
+    return _semaphore_new(0);
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void)
+{
+    return _semaphore_new(1);
+}
+
+SemaphoreHandle_t xSemaphoreCreateRecursiveMutex(void)
+{
+    return _semaphore_new(1);
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinaryStatic(StaticSemaphore_t *buffer)
+{
+    return _semaphore_init(buffer, 0, true);
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutexStatic(StaticSemaphore_t *buffer)
+{
+    return _semaphore_init(buffer, 1, true);
+}
+
+SemaphoreHandle_t xSemaphoreCreateRecursiveMutexStatic(StaticSemaphore_t *buffer)
+{
+    return _semaphore_init(buffer, 1, true);
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t semaphore)
+{
+    pthread_mutex_destroy(&semaphore->mutex);
+    pthread_cond_destroy(&semaphore->cond);
+    if (!semaphore->is_static)
+    {
+        free(semaphore);
+    }
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticks_to_wait)
+{
+    int64_t deadline_us = host_tick_deadline_us(ticks_to_wait);
+    BaseType_t taken = pdFALSE;
+    pthread_mutex_lock(&semaphore->mutex);
+    while (semaphore->count == 0 && ticks_to_wait != 0)
+    {
+        if (!_cond_wait(&semaphore->cond, &semaphore->mutex, deadline_us))
+        {
+            break;
+        }
+    }
+    if (semaphore->count > 0)
+    {
+        semaphore->count--;
+        semaphore->holder = xTaskGetCurrentTaskHandle();
+        taken = pdTRUE;
+    }
+    pthread_mutex_unlock(&semaphore->mutex);
+    return taken;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore)
+{
+    BaseType_t given = pdFALSE;
+    pthread_mutex_lock(&semaphore->mutex);
+    if (semaphore->count < semaphore->max_count)
+    {
+        semaphore->count++;
+        semaphore->holder = NULL;
+        pthread_cond_signal(&semaphore->cond);
+        given = pdTRUE;
+    }
+    pthread_mutex_unlock(&semaphore->mutex);
+    return given;
+}
+
+BaseType_t xSemaphoreTakeRecursive(SemaphoreHandle_t semaphore, TickType_t ticks_to_wait)
+{
+    TaskHandle_t self = xTaskGetCurrentTaskHandle();
+    pthread_mutex_lock(&semaphore->mutex);
+    if (semaphore->depth > 0 && semaphore->holder == self)
+    {
+        semaphore->depth++;
+        pthread_mutex_unlock(&semaphore->mutex);
+        return pdTRUE;
+    }
+    pthread_mutex_unlock(&semaphore->mutex);
+
+    if (xSemaphoreTake(semaphore, ticks_to_wait) != pdTRUE)
+    {
+        return pdFALSE;
+    }
+    pthread_mutex_lock(&semaphore->mutex);
+    semaphore->depth = 1;
+    pthread_mutex_unlock(&semaphore->mutex);
+    return pdTRUE;
+}
+
+BaseType_t xSemaphoreGiveRecursive(SemaphoreHandle_t semaphore)
+{
+    pthread_mutex_lock(&semaphore->mutex);
+    if (semaphore->depth == 0 || semaphore->holder != xTaskGetCurrentTaskHandle())
+    {
+        pthread_mutex_unlock(&semaphore->mutex);
+        return pdFALSE;
+    }
+    bool release = (--semaphore->depth == 0);
+    pthread_mutex_unlock(&semaphore->mutex);
+    return release ? xSemaphoreGive(semaphore) : pdTRUE;
+}
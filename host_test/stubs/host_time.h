@@ -0,0 +1,61 @@
+/*
+Craft Metrics
+
+This product includes software developed by
+Craft Metrics (https://craftmetrics.ca/).
+
+MIT License
+Copyright (c) 2018 Craft Metrics
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+/**
+ * Clock shared by the host stand-ins: esp_timer_get_time, ticks and timed waits
+ * all count CLOCK_MONOTONIC microseconds from process start, optionally slowed
+ * down by a scale
+ */
+
+#ifndef HOST_TIME_H
+#define HOST_TIME_H
+
+#include <stdint.h>
+#include <time.h>
+
+int64_t host_time_us(void);
+
+/**
+ * Absolute CLOCK_MONOTONIC time of a host_time_us value, for timed waits
+ */
+struct timespec host_timespec(int64_t time_us);
+
+void host_sleep_until_us(int64_t time_us);
+
+/**
+ * Run host time scale times slower than CLOCK_MONOTONIC from now on, 1 is real time
+ */
+void host_time_set_scale(uint32_t scale);
+
+/**
+ * Deadline in host_time_us of a wait of the given number of ticks, -1 waits forever
+ */
+int64_t host_tick_deadline_us(uint32_t ticks);
+
+#endif // HOST_TIME_H
@@ -0,0 +1,64 @@
+/*
+Craft Metrics
+
+This product includes software developed by
+Craft Metrics (https://craftmetrics.ca/).
+
+MIT License
+Copyright (c) 2018 Craft Metrics
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+/**
+ * Host build stand-in for the esp32-smbus component, only the parts the driver uses
+ */
+
+#ifndef HOST_SMBUS_H
+#define HOST_SMBUS_H
+
+#include <stdbool.h>
+#include "driver/i2c.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+typedef uint16_t i2c_address_t;
+
+typedef struct
+{
+    bool init;
+    i2c_port_t i2c_port;
+    i2c_address_t address;
+    portBASE_TYPE timeout;
+} smbus_info_t;
+
+smbus_info_t *smbus_malloc(void);
+void smbus_free(smbus_info_t **smbus_info);
+esp_err_t smbus_init(smbus_info_t *smbus_info, i2c_port_t i2c_port, i2c_address_t address);
+esp_err_t smbus_set_timeout(smbus_info_t *smbus_info, portBASE_TYPE timeout);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // HOST_SMBUS_H
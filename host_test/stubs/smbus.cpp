@@ -0,0 +1,67 @@
+/*
+    Craft Metrics
+
+    This product includes software developed by
+    Craft Metrics (https://craftmetrics.ca/).
+
+    MIT License
+    Copyright (c) 2018 Craft Metrics
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#include <stdlib.h>
+#include <smbus.h>
+
+smbus_info_t *smbus_malloc(void)
+{
+    return (smbus_info_t *)calloc(1, sizeof(smbus_info_t));
+}
+
+void smbus_free(smbus_info_t **smbus_info)
+{
+    if (smbus_info != NULL)
+    {
+        free(*smbus_info);
+        *smbus_info = NULL;
+    }
+}
+
+esp_err_t smbus_init(smbus_info_t *smbus_info, i2c_port_t i2c_port, i2c_address_t address)
+{
+    if (smbus_info == NULL)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    smbus_info->init = true;
+    smbus_info->i2c_port = i2c_port;
+    smbus_info->address = address;
+    smbus_info->timeout = 1000 / portTICK_RATE_MS;
+    return ESP_OK;
+}
+
+esp_err_t smbus_set_timeout(smbus_info_t *smbus_info, portBASE_TYPE timeout)
+{
+    if (smbus_info == NULL || !smbus_info->init)
+    {
+        return ESP_FAIL;
+    }
+    smbus_info->timeout = timeout;
+    return ESP_OK;
+}
@@ -0,0 +1,48 @@
+/*
+    Craft Metrics
+
+    This product includes software developed by
+    Craft Metrics (https://craftmetrics.ca/).
+
+    MIT License
+    Copyright (c) 2018 Craft Metrics
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#include "mcp342x_device.h"
+
+/**
+ * Uses of the variant front ends that the static_assert guards must reject.
+ * Each compile_fail_* test builds this file with one MCP342X_FAIL_* define
+ * and expects the build to stop with the guard's message.
+ */
+void compile_fail_device(void)
+{
+#if defined(MCP342X_FAIL_CHANNEL)
+    cm::MCP3426 device(MCP342X_A0GND_A1GND);
+    device.StartNewConversion<MCP342X_CHANNEL_3>();
+#elif defined(MCP342X_FAIL_INIT_CHANNEL)
+    cm::MCP3421 device(MCP342X_A0GND_A1GND);
+    device.Init<MCP342X_CHANNEL_2, MCP342X_SRATE_16BIT, MCP342X_GAIN_1X>(0);
+#elif defined(MCP342X_FAIL_18BIT)
+    cm::MCP3428 device(MCP342X_A0GND_A1GND);
+    device.Init<MCP342X_CHANNEL_1, MCP342X_SRATE_18BIT, MCP342X_GAIN_1X>(0);
+#endif
+}
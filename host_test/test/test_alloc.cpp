@@ -0,0 +1,272 @@
+/*
+    Craft Metrics
+
+    This product includes software developed by
+    Craft Metrics (https://craftmetrics.ca/).
+
+    MIT License
+    Copyright (c) 2018 Craft Metrics
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#include "mcp342x_sim.h"
+
+#include <stdlib.h>
+#include <gtest/gtest.h>
+#include <new>
+
+/**
+ * Instance allocation, built twice: against the heap and against the static pool.
+ * The driver's calls to malloc and free are counted through the linker's --wrap,
+ * calloc included since the compiler may merge malloc and memset into it.
+ */
+static const uint8_t ADDRESS = MCP342X_A0GND_A1GND;
+
+static int _mallocs;
+static int _frees;
+
+extern "C" void *__real_malloc(size_t size);
+extern "C" void *__real_calloc(size_t count, size_t size);
+extern "C" void __real_free(void *ptr);
+
+extern "C" void *__wrap_malloc(size_t size)
+{
+    void *ptr = __real_malloc(size);
+    if (ptr != NULL)
+    {
+        __atomic_add_fetch(&_mallocs, 1, __ATOMIC_RELAXED);
+    }
+    return ptr;
+}
+
+extern "C" void *__wrap_calloc(size_t count, size_t size)
+{
+    void *ptr = __real_calloc(count, size);
+    if (ptr != NULL)
+    {
+        __atomic_add_fetch(&_mallocs, 1, __ATOMIC_RELAXED);
+    }
+    return ptr;
+}
+
+extern "C" void __wrap_free(void *ptr)
+{
+    if (ptr != NULL)
+    {
+        __atomic_add_fetch(&_frees, 1, __ATOMIC_RELAXED);
+    }
+    __real_free(ptr);
+}
+
+class AllocTest : public ::testing::Test
+{
+protected:
+    int mallocs;
+    int frees;
+
+    void SetUp() override
+    {
+        mcp342x_sim_reset();
+        mcp342x_sim_add_device(ADDRESS, 4, true);
+        mcp342x_sim_set_input(ADDRESS, 0, 100000000);
+        this->mallocs = _mallocs;
+        this->frees = _frees;
+    }
+
+    int Mallocs(void)
+    {
+        return _mallocs - this->mallocs;
+    }
+
+    int Outstanding(void)
+    {
+        return (_mallocs - this->mallocs) - (_frees - this->frees);
+    }
+};
+
+TEST_F(AllocTest, MallocFreeDoesNotLeak)
+{
+    for (int i = 0; i < 100; i++)
+    {
+        mcp342x_info_t *info = mcp342x_malloc();
+        ASSERT_NE(nullptr, info);
+        mcp342x_free(&info);
+        EXPECT_EQ(nullptr, info);
+    }
+    EXPECT_EQ(0, this->Outstanding());
+#ifdef CONFIG_MCP342X_STATIC_POOL_SIZE
+    EXPECT_EQ(0, this->Mallocs());
+#else
+    EXPECT_EQ(100, this->Mallocs());
+#endif
+}
+
+TEST_F(AllocTest, InstancesAreUsableAndZeroed)
+{
+    smbus_info_t smbus_info;
+    smbus_init(&smbus_info, 0, ADDRESS);
+    mcp342x_info_t *info = mcp342x_malloc();
+    ASSERT_NE(nullptr, info);
+    EXPECT_FALSE(info->init);
+    EXPECT_EQ(0U, info->stats.samples);
+    mcp342x_set_bus(info, &mcp342x_sim_bus);
+    mcp342x_config_t config = {MCP342X_CHANNEL_1, MCP342X_MODE_ONESHOT, MCP342X_SRATE_12BIT, MCP342X_GAIN_1X};
+    ASSERT_EQ(ESP_OK, mcp342x_init(info, &smbus_info, config));
+    int32_t code;
+    ASSERT_EQ(ESP_OK, mcp342x_start_new_conversion(info));
+    EXPECT_EQ(MCP342X_STATUS_OK, mcp342x_read_raw(info, &code));
+    EXPECT_EQ(100, code);
+    mcp342x_free(&info);
+    EXPECT_EQ(0, this->Outstanding());
+}
+
+TEST_F(AllocTest, CppClassUsesNoHeap)
+{
+    {
+        cm::MCP342x adc(MCP342X_A0GND_A1GND);
+        mcp342x_config_t config = {MCP342X_CHANNEL_1, MCP342X_MODE_ONESHOT, MCP342X_SRATE_12BIT, MCP342X_GAIN_1X};
+        ASSERT_EQ(ESP_OK, adc.Init(0, config));
+        int32_t code;
+        ASSERT_EQ(ESP_OK, adc.StartNewConversion());
+        EXPECT_EQ(MCP342X_STATUS_OK, adc.ReadRaw(&code));
+    }
+    EXPECT_EQ(0, this->Mallocs());
+}
+
+/**
+ * True if the device info of adc points at bus info inside adc itself
+ */
+static bool _owns_bus_info(cm::MCP342x *adc)
+{
+    const uint8_t *smbus_info = (const uint8_t *)adc->GetInfoPtr()->smbus_info;
+    return smbus_info >= (const uint8_t *)adc && smbus_info < (const uint8_t *)adc + sizeof(*adc);
+}
+
+TEST_F(AllocTest, MovedDeviceKeepsReading)
+{
+    mcp342x_sim_add_device(MCP342X_A0GND_A1FLT, 4, true);
+    mcp342x_sim_set_input(MCP342X_A0GND_A1FLT, 0, 300000000);
+    mcp342x_config_t config = {MCP342X_CHANNEL_1, MCP342X_MODE_ONESHOT, MCP342X_SRATE_12BIT, MCP342X_GAIN_1X};
+    int32_t code = 0;
+    {
+        alignas(cm::MCP342x) uint8_t storage[sizeof(cm::MCP342x)];
+        cm::MCP342x *first = new (storage) cm::MCP342x(MCP342X_A0GND_A1GND);
+        ASSERT_EQ(ESP_OK, first->Init(0, config));
+
+        /**
+         * The move constructor takes over the bus info, the source is left uninitialised
+         */
+        cm::MCP342x moved(static_cast<cm::MCP342x &&>(*first));
+        EXPECT_TRUE(_owns_bus_info(&moved));
+        EXPECT_FALSE(first->GetInfoPtr()->init);
+        EXPECT_EQ(ESP_FAIL, first->StartNewConversion());
+        first->~MCP342x();
+        ASSERT_EQ(ESP_OK, moved.StartNewConversion());
+        EXPECT_EQ(MCP342X_STATUS_OK, moved.ReadRaw(&code));
+        EXPECT_EQ(100, code);
+
+        /**
+         * Move assignment replaces an initialised device with it
+         */
+        cm::MCP342x assigned(MCP342X_A0GND_A1FLT);
+        ASSERT_EQ(ESP_OK, assigned.Init(0, config));
+        assigned = static_cast<cm::MCP342x &&>(moved);
+        EXPECT_TRUE(_owns_bus_info(&assigned));
+        EXPECT_EQ(MCP342X_A0GND_A1GND, assigned.GetAddress());
+        EXPECT_FALSE(moved.GetInfoPtr()->init);
+        ASSERT_EQ(ESP_OK, assigned.StartNewConversion());
+        EXPECT_EQ(MCP342X_STATUS_OK, assigned.ReadRaw(&code));
+        EXPECT_EQ(100, code);
+    }
+
+    /**
+     * Destroying moved-from objects gave nothing back twice
+     */
+    EXPECT_EQ(0, this->Mallocs());
+    EXPECT_EQ(0, this->Outstanding());
+#ifdef CONFIG_MCP342X_STATIC_POOL_SIZE
+    mcp342x_info_t *infos[CONFIG_MCP342X_STATIC_POOL_SIZE];
+    for (size_t i = 0; i < CONFIG_MCP342X_STATIC_POOL_SIZE; i++)
+    {
+        infos[i] = mcp342x_malloc();
+        ASSERT_NE(nullptr, infos[i]);
+    }
+    EXPECT_EQ(nullptr, mcp342x_malloc());
+    for (size_t i = 0; i < CONFIG_MCP342X_STATIC_POOL_SIZE; i++)
+    {
+        mcp342x_free(&infos[i]);
+    }
+#endif
+}
+
+#ifdef CONFIG_MCP342X_STATIC_POOL_SIZE
+TEST_F(AllocTest, PoolRunsOutAndRefills)
+{
+    mcp342x_info_t *infos[CONFIG_MCP342X_STATIC_POOL_SIZE];
+    for (size_t i = 0; i < CONFIG_MCP342X_STATIC_POOL_SIZE; i++)
+    {
+        infos[i] = mcp342x_malloc();
+        ASSERT_NE(nullptr, infos[i]);
+    }
+    EXPECT_EQ(nullptr, mcp342x_malloc());
+    mcp342x_info_t *freed = infos[1];
+    mcp342x_free(&infos[1]);
+    infos[1] = mcp342x_malloc();
+    EXPECT_EQ(freed, infos[1]);
+    for (size_t i = 0; i < CONFIG_MCP342X_STATIC_POOL_SIZE; i++)
+    {
+        mcp342x_free(&infos[i]);
+    }
+    EXPECT_EQ(0, this->Mallocs());
+}
+
+TEST_F(AllocTest, PoolRejectsForeignPointers)
+{
+    /**
+     * A static instance, a pointer inside a pool entry and a double free must not
+     * mark any pool entry free
+     */
+    mcp342x_info_t *infos[CONFIG_MCP342X_STATIC_POOL_SIZE];
+    for (size_t i = 0; i < CONFIG_MCP342X_STATIC_POOL_SIZE; i++)
+    {
+        infos[i] = mcp342x_malloc();
+        ASSERT_NE(nullptr, infos[i]);
+    }
+    static mcp342x_info_t outside;
+    mcp342x_info_t *foreign = &outside;
+    mcp342x_free(&foreign);
+    mcp342x_info_t *inside = (mcp342x_info_t *)((uint8_t *)infos[0] + 4);
+    mcp342x_free(&inside);
+    mcp342x_info_t *past = infos[CONFIG_MCP342X_STATIC_POOL_SIZE - 1] + 1;
+    mcp342x_free(&past);
+    EXPECT_EQ(nullptr, mcp342x_malloc());
+
+    mcp342x_info_t *twice = infos[0];
+    mcp342x_free(&infos[0]);
+    mcp342x_free(&twice);
+    infos[0] = mcp342x_malloc();
+    ASSERT_NE(nullptr, infos[0]);
+    EXPECT_EQ(nullptr, mcp342x_malloc());
+    for (size_t i = 0; i < CONFIG_MCP342X_STATIC_POOL_SIZE; i++)
+    {
+        mcp342x_free(&infos[i]);
+    }
+}
+#endif
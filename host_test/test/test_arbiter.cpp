@@ -0,0 +1,366 @@
+/*
+    Craft Metrics
+
+    This product includes software developed by
+    Craft Metrics (https://craftmetrics.ca/).
+
+    MIT License
+    Copyright (c) 2018 Craft Metrics
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#include "mcp342x_arbiter.h"
+#include "mcp342x_sim.h"
+
+#include <freertos/task.h>
+#include <freertos/semphr.h>
+#include <functional>
+#include <gtest/gtest.h>
+
+/**
+ * Transfers of several tasks sharing a port through the arbiter
+ */
+static const i2c_port_t PORT = 0;
+static const uint8_t ADDRESSES[] = {
+    MCP342X_A0GND_A1GND, MCP342X_A0GND_A1FLT, MCP342X_A0FLT_A1GND, MCP342X_A0GND_A1VCC};
+static const size_t DEVICES = sizeof(ADDRESSES) / sizeof(ADDRESSES[0]);
+static const uint8_t ADDRESS_MISSING = MCP342X_A0VCC_A1VCC;
+
+/**
+ * Runs a function in its own task, Join waits for it to return
+ */
+class Task
+{
+public:
+    explicit Task(std::function<void()> in_function) : function(in_function)
+    {
+        this->done = xSemaphoreCreateBinary();
+        xTaskCreate(_run, "test", 4096, this, 5, NULL);
+    }
+
+    ~Task()
+    {
+        this->Join();
+        vSemaphoreDelete(this->done);
+    }
+
+    bool Join(TickType_t timeout = portMAX_DELAY)
+    {
+        if (this->joined || xSemaphoreTake(this->done, timeout) == pdTRUE)
+        {
+            this->joined = true;
+        }
+        return this->joined;
+    }
+
+private:
+    std::function<void()> function;
+    SemaphoreHandle_t done;
+    bool joined = false;
+
+    static void _run(void *arg)
+    {
+        Task *task = (Task *)arg;
+        task->function();
+        xSemaphoreGive(task->done);
+        vTaskDelete(NULL);
+    }
+};
+
+class ArbiterTest : public ::testing::Test
+{
+protected:
+    const mcp342x_bus_t *bus;
+    smbus_info_t smbus[DEVICES];
+    mcp342x_arbiter_stats_t start;
+
+    void SetUp() override
+    {
+        mcp342x_sim_reset();
+        ASSERT_EQ(ESP_OK, mcp342x_arbiter_init(PORT, 10));
+        this->bus = mcp342x_arbiter_bus(PORT);
+        ASSERT_NE(nullptr, this->bus);
+        for (size_t i = 0; i < DEVICES; i++)
+        {
+            mcp342x_sim_add_device(ADDRESSES[i], 4, true);
+            mcp342x_sim_set_input(ADDRESSES[i], 0, (int32_t)(i + 1) * 100000000);
+            smbus_init(&this->smbus[i], PORT, ADDRESSES[i]);
+        }
+        mcp342x_arbiter_get_stats(PORT, &this->start);
+        mcp342x_sim_reset_stats();
+    }
+
+    mcp342x_arbiter_stats_t Stats()
+    {
+        mcp342x_arbiter_stats_t stats;
+        mcp342x_arbiter_get_stats(PORT, &stats);
+        stats.transfers -= this->start.transfers;
+        stats.links -= this->start.links;
+        stats.contentions -= this->start.contentions;
+        stats.bypasses -= this->start.bypasses;
+        return stats;
+    }
+
+    /**
+     * Set device 0 converting continuously at 16 bits, so a 3 byte read returns its config
+     */
+    void Continuous(mcp342x_gain_t gain)
+    {
+        uint8_t config = MCP342X_MODE_CONTINUOUS | MCP342X_SRATE_16BIT | gain;
+        ASSERT_EQ(ESP_OK, mcp342x_sim_bus.write(NULL, &this->smbus[0], &config, 1));
+    }
+
+    /**
+     * Give queued transfers time to reach the worker
+     */
+    static void Settle(void)
+    {
+        vTaskDelay(pdMS_TO_TICKS(30));
+    }
+};
+
+TEST_F(ArbiterTest, ConcurrentTasksReadTheirOwnDevices)
+{
+    static const int SAMPLES = 50;
+    mcp342x_sim_set_clock(100000, true);
+
+    int errors[DEVICES] = {};
+    mcp342x_info_t info[DEVICES];
+    std::vector<std::unique_ptr<Task>> tasks;
+    for (size_t i = 0; i < DEVICES; i++)
+    {
+        mcp342x_sim_set_timing(ADDRESSES[i], 0);
+        info[i] = {};
+        mcp342x_set_bus(&info[i], this->bus);
+        mcp342x_config_t config = {MCP342X_CHANNEL_1, MCP342X_MODE_ONESHOT, MCP342X_SRATE_12BIT, MCP342X_GAIN_1X};
+        ASSERT_EQ(ESP_OK, mcp342x_init(&info[i], &this->smbus[i], config));
+    }
+    this->start = {};
+    mcp342x_arbiter_get_stats(PORT, &this->start);
+    mcp342x_sim_reset_stats();
+
+    for (size_t i = 0; i < DEVICES; i++)
+    {
+        tasks.emplace_back(new Task([&, i]() {
+            for (int n = 0; n < SAMPLES; n++)
+            {
+                int32_t code = 0;
+                mcp342x_conversion_status_t status = MCP342X_STATUS_IN_PROGRESS;
+                if (mcp342x_start_new_conversion(&info[i]) == ESP_OK)
+                {
+                    while ((status = mcp342x_poll_raw(&info[i], &code)) == MCP342X_STATUS_IN_PROGRESS)
+                    {
+                    }
+                }
+                errors[i] += (status != MCP342X_STATUS_OK || code != (int32_t)(i + 1) * 100) ? 1 : 0;
+            }
+        }));
+    }
+    for (auto &task : tasks)
+    {
+        ASSERT_TRUE(task->Join(pdMS_TO_TICKS(10000)));
+    }
+    for (size_t i = 0; i < DEVICES; i++)
+    {
+        EXPECT_EQ(0, errors[i]) << "device " << i;
+    }
+
+    /**
+     * Every transfer reached the wire, most of them sharing a command link
+     */
+    mcp342x_arbiter_stats_t stats = this->Stats();
+    mcp342x_sim_stats_t sim;
+    mcp342x_sim_get_stats(&sim);
+    EXPECT_EQ(sim.transactions, stats.transfers);
+    EXPECT_EQ(sim.links, stats.links);
+    EXPECT_GE(stats.transfers, (uint32_t)(DEVICES * SAMPLES * 2));
+    EXPECT_LT(stats.links * 2, stats.transfers);
+    EXPECT_GT(stats.contentions, 0U);
+}
+
+TEST_F(ArbiterTest, ShortWriteOvertakesLongRead)
+{
+    this->Continuous(MCP342X_GAIN_1X);
+    uint8_t data[3] = {};
+    uint8_t config = MCP342X_MODE_CONTINUOUS | MCP342X_SRATE_16BIT | MCP342X_GAIN_8X;
+    esp_err_t read_err = ESP_FAIL;
+    esp_err_t write_err = ESP_FAIL;
+
+    ASSERT_EQ(ESP_OK, mcp342x_arbiter_lock(PORT, 0));
+    Task reader([&]() { read_err = this->bus->read(this->bus->context, &this->smbus[0], data, sizeof(data)); });
+    this->Settle();
+    Task writer([&]() { write_err = this->bus->write(this->bus->context, &this->smbus[0], &config, 1); });
+    this->Settle();
+    mcp342x_arbiter_unlock(PORT);
+    reader.Join();
+    writer.Join();
+
+    EXPECT_EQ(ESP_OK, read_err);
+    EXPECT_EQ(ESP_OK, write_err);
+    EXPECT_EQ(MCP342X_GAIN_8X, data[2] & MCP342X_GAIN_MASK);
+    mcp342x_arbiter_stats_t stats = this->Stats();
+    EXPECT_EQ(2U, stats.transfers);
+    EXPECT_EQ(1U, stats.links);
+    EXPECT_EQ(1U, stats.bypasses);
+    EXPECT_EQ(1U, stats.contentions);
+}
+
+TEST_F(ArbiterTest, OvertakingIsBounded)
+{
+    this->Continuous(MCP342X_GAIN_1X);
+    uint8_t data[3] = {};
+    uint8_t config_early = MCP342X_MODE_CONTINUOUS | MCP342X_SRATE_16BIT | MCP342X_GAIN_2X;
+    uint8_t config_late = MCP342X_MODE_CONTINUOUS | MCP342X_SRATE_16BIT | MCP342X_GAIN_8X;
+
+    ASSERT_EQ(ESP_OK, mcp342x_arbiter_lock(PORT, 0));
+    Task reader([&]() { this->bus->read(this->bus->context, &this->smbus[0], data, sizeof(data)); });
+    this->Settle();
+    std::vector<std::unique_ptr<Task>> writers;
+    for (int i = 0; i <= MCP342X_ARBITER_MAX_BYPASS; i++)
+    {
+        const uint8_t *config = (i < MCP342X_ARBITER_MAX_BYPASS) ? &config_early : &config_late;
+        writers.emplace_back(new Task([this, config]() { this->bus->write(this->bus->context, &this->smbus[0], config, 1); }));
+        this->Settle();
+    }
+    mcp342x_arbiter_unlock(PORT);
+    reader.Join();
+    writers.clear();
+
+    /**
+     * The read gives way MCP342X_ARBITER_MAX_BYPASS times, then the last write queues behind it
+     */
+    EXPECT_EQ(MCP342X_GAIN_2X, data[2] & MCP342X_GAIN_MASK);
+    EXPECT_EQ((uint8_t)MCP342X_GAIN_8X, mcp342x_sim_config(ADDRESSES[0]) & MCP342X_GAIN_MASK);
+    mcp342x_arbiter_stats_t stats = this->Stats();
+    EXPECT_EQ((uint32_t)MCP342X_ARBITER_MAX_BYPASS, stats.bypasses);
+    EXPECT_EQ((uint32_t)MCP342X_ARBITER_MAX_BYPASS + 2, stats.transfers);
+    EXPECT_EQ(1U, stats.links);
+}
+
+TEST_F(ArbiterTest, LockHoldsOtherTasksBack)
+{
+    mcp342x_info_t a = {};
+    mcp342x_info_t b = {};
+    mcp342x_set_bus(&a, this->bus);
+    mcp342x_set_bus(&b, this->bus);
+    mcp342x_config_t config = {MCP342X_CHANNEL_1, MCP342X_MODE_ONESHOT, MCP342X_SRATE_12BIT, MCP342X_GAIN_1X};
+    ASSERT_EQ(ESP_OK, mcp342x_init(&a, &this->smbus[0], config));
+    ASSERT_EQ(ESP_OK, mcp342x_init(&b, &this->smbus[1], config));
+    this->Settle();
+    uint32_t b_conversions = mcp342x_sim_conversions(ADDRESSES[1]);
+
+    ASSERT_EQ(ESP_OK, mcp342x_arbiter_lock(PORT, 0));
+    ASSERT_EQ(ESP_OK, mcp342x_arbiter_lock(PORT, 0));
+    volatile bool b_done = false;
+    Task other([&]() {
+        mcp342x_start_new_conversion(&b);
+        b_done = true;
+    });
+    this->Settle();
+    EXPECT_FALSE(b_done);
+
+    /**
+     * The owner's own transfers still go out, nested locks included
+     */
+    int32_t code;
+    ASSERT_EQ(ESP_OK, mcp342x_start_new_conversion(&a));
+    EXPECT_EQ(MCP342X_STATUS_OK, mcp342x_read_raw(&a, &code));
+    EXPECT_EQ(100, code);
+    mcp342x_arbiter_unlock(PORT);
+    this->Settle();
+    EXPECT_FALSE(b_done);
+    EXPECT_EQ(b_conversions, mcp342x_sim_conversions(ADDRESSES[1]));
+
+    /**
+     * Another task can not take the port meanwhile
+     */
+    esp_err_t lock_err = ESP_OK;
+    Task locker([&]() { lock_err = mcp342x_arbiter_lock(PORT, 0); });
+    locker.Join();
+    EXPECT_EQ(ESP_ERR_TIMEOUT, lock_err);
+
+    mcp342x_arbiter_unlock(PORT);
+    ASSERT_TRUE(other.Join(pdMS_TO_TICKS(1000)));
+    EXPECT_TRUE(b_done);
+    EXPECT_EQ(MCP342X_STATUS_OK, mcp342x_read_raw(&b, &code));
+    EXPECT_EQ(200, code);
+}
+
+TEST_F(ArbiterTest, FailedBatchReportsEachCaller)
+{
+    smbus_info_t missing;
+    smbus_init(&missing, PORT, ADDRESS_MISSING);
+    uint8_t before[3] = {};
+    uint8_t bad[3] = {};
+    uint8_t after[3] = {};
+    esp_err_t before_err = ESP_FAIL;
+    esp_err_t bad_err = ESP_OK;
+    esp_err_t after_err = ESP_FAIL;
+
+    /**
+     * Equal length reads are batched in the order they were queued
+     */
+    ASSERT_EQ(ESP_OK, mcp342x_arbiter_lock(PORT, 0));
+    Task before_reader([&]() { before_err = this->bus->read(this->bus->context, &this->smbus[0], before, sizeof(before)); });
+    this->Settle();
+    Task bad_reader([&]() { bad_err = this->bus->read(this->bus->context, &missing, bad, sizeof(bad)); });
+    this->Settle();
+    Task after_reader([&]() { after_err = this->bus->read(this->bus->context, &this->smbus[1], after, sizeof(after)); });
+    this->Settle();
+    mcp342x_arbiter_unlock(PORT);
+    before_reader.Join();
+    bad_reader.Join();
+    after_reader.Join();
+
+    /**
+     * The read ahead of the NACK keeps the result it got and is not repeated,
+     * which would find the ready bit cleared. The read behind it goes out again.
+     */
+    EXPECT_EQ(ESP_OK, before_err);
+    EXPECT_EQ(0, before[2] & MCP342X_CNTRL_MASK);
+    EXPECT_EQ(ESP_FAIL, bad_err);
+    EXPECT_EQ(ESP_OK, after_err);
+    EXPECT_EQ(0, after[2] & MCP342X_CNTRL_MASK);
+
+    mcp342x_sim_stats_t sim;
+    mcp342x_sim_get_stats(&sim);
+    EXPECT_EQ(2U, sim.reads);
+    mcp342x_arbiter_stats_t stats = this->Stats();
+    EXPECT_EQ(3U, stats.transfers);
+    // The batch, a probe of each device up to the missing one, the requeued read
+    EXPECT_EQ(4U, stats.links);
+}
+
+TEST_F(ArbiterTest, QueuedTransferTimesOut)
+{
+    smbus_info_t impatient = this->smbus[0];
+    impatient.timeout = pdMS_TO_TICKS(20);
+    uint8_t data[3];
+    esp_err_t err = ESP_OK;
+
+    ASSERT_EQ(ESP_OK, mcp342x_arbiter_lock(PORT, 0));
+    Task reader([&]() { err = this->bus->read(this->bus->context, &impatient, data, sizeof(data)); });
+    reader.Join();
+    mcp342x_arbiter_unlock(PORT);
+    this->Settle();
+
+    EXPECT_EQ(ESP_ERR_TIMEOUT, err);
+    EXPECT_EQ(0U, this->Stats().transfers);
+}
@@ -0,0 +1,176 @@
+/*
+    Craft Metrics
+
+    This product includes software developed by
+    Craft Metrics (https://craftmetrics.ca/).
+
+    MIT License
+    Copyright (c) 2018 Craft Metrics
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#include "mcp342x_async.h"
+#include "mcp342x_sim.h"
+
+#include <atomic>
+#include <gtest/gtest.h>
+
+/**
+ * Timer driven completion: the timer only wakes the worker, which reads and delivers
+ */
+static const uint8_t ADDRESS = MCP342X_A0GND_A1GND;
+
+typedef struct
+{
+    std::atomic<int> calls;
+    std::atomic<bool> on_worker;
+    mcp342x_async_t *async;
+    mcp342x_sample_t sample;
+} callback_record_t;
+
+static void _record(mcp342x_info_t *, const mcp342x_sample_t *sample, void *arg)
+{
+    callback_record_t *record = (callback_record_t *)arg;
+    record->sample = *sample;
+    record->on_worker = (xTaskGetCurrentTaskHandle() == record->async->worker);
+    record->calls++;
+}
+
+class AsyncTest : public ::testing::Test
+{
+protected:
+    smbus_info_t smbus_info;
+    mcp342x_info_t info;
+    mcp342x_async_t async;
+    callback_record_t record;
+
+    void SetUp() override
+    {
+        mcp342x_sim_reset();
+        mcp342x_sim_add_device(ADDRESS, 4, true);
+        mcp342x_sim_set_input(ADDRESS, 0, 300000000);
+        smbus_init(&this->smbus_info, 0, ADDRESS);
+        this->info = {};
+        this->record.calls = 0;
+        this->record.on_worker = false;
+        this->record.async = &this->async;
+    }
+
+    void TearDown() override
+    {
+        mcp342x_async_deinit(&this->async);
+    }
+
+    void Init(mcp342x_sample_rate_t rate)
+    {
+        mcp342x_config_t config = {MCP342X_CHANNEL_1, MCP342X_MODE_ONESHOT, rate, MCP342X_GAIN_1X};
+        ASSERT_EQ(ESP_OK, mcp342x_init(&this->info, &this->smbus_info, config));
+        ASSERT_EQ(ESP_OK, mcp342x_async_init(&this->async, &this->info, _record, &this->record,
+                                             xTaskGetCurrentTaskHandle(), 5));
+        mcp342x_sim_reset_stats();
+    }
+};
+
+TEST_F(AsyncTest, DeliversFromTheWorker)
+{
+    this->Init(MCP342X_SRATE_14BIT);
+    ASSERT_EQ(ESP_OK, mcp342x_async_start(&this->async));
+    EXPECT_EQ(ESP_ERR_INVALID_STATE, mcp342x_async_start(&this->async));
+    ASSERT_EQ(1U, ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(200)));
+
+    EXPECT_EQ(1, this->record.calls);
+    EXPECT_TRUE(this->record.on_worker);
+    EXPECT_EQ(MCP342X_STATUS_OK, this->record.sample.status);
+    EXPECT_EQ(1200, this->record.sample.code);
+}
+
+TEST_F(AsyncTest, EighteenBitReadsOnce)
+{
+    this->Init(MCP342X_SRATE_18BIT);
+    ASSERT_EQ(ESP_OK, mcp342x_async_start(&this->async));
+    ASSERT_EQ(1U, ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(500)));
+    EXPECT_EQ(MCP342X_STATUS_OK, this->record.sample.status);
+
+    mcp342x_sim_stats_t stats;
+    mcp342x_sim_get_stats(&stats);
+    EXPECT_EQ(1U, stats.writes);
+    EXPECT_LE(stats.reads, 2U);
+}
+
+TEST_F(AsyncTest, SlowDeviceRearms)
+{
+    this->Init(MCP342X_SRATE_14BIT);
+    mcp342x_sim_set_timing(ADDRESS, 130);
+    ASSERT_EQ(ESP_OK, mcp342x_async_start(&this->async));
+    ASSERT_EQ(1U, ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(200)));
+    EXPECT_EQ(MCP342X_STATUS_OK, this->record.sample.status);
+    EXPECT_GT(this->info.stats.polls, 1U);
+    EXPECT_LT(this->info.stats.polls, 10U);
+}
+
+TEST_F(AsyncTest, DeadDeviceTimesOut)
+{
+    this->Init(MCP342X_SRATE_12BIT);
+    mcp342x_sim_set_timing(ADDRESS, 50000);
+    ASSERT_EQ(ESP_OK, mcp342x_async_start(&this->async));
+    ASSERT_EQ(1U, ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(200)));
+    EXPECT_EQ(MCP342X_STATUS_TIMEOUT, this->record.sample.status);
+    EXPECT_EQ(1U, this->info.stats.timeouts);
+}
+
+static void _stamp(void *arg)
+{
+    *(std::atomic<int64_t> *)arg = esp_timer_get_time();
+}
+
+TEST_F(AsyncTest, SlowBusDoesNotHoldUpOtherTimers)
+{
+    /**
+     * At 1 kHz a result read holds the bus for about 40 ms. Another timer
+     * due at the same moment must still fire on time.
+     */
+    this->Init(MCP342X_SRATE_12BIT);
+    mcp342x_sim_set_clock(1000, true);
+
+    std::atomic<int64_t> fired_us(0);
+    esp_timer_handle_t other;
+    esp_timer_create_args_t args = {};
+    args.callback = _stamp;
+    args.arg = &fired_us;
+    ASSERT_EQ(ESP_OK, esp_timer_create(&args, &other));
+
+    ASSERT_EQ(ESP_OK, mcp342x_async_start(&this->async));
+    int64_t due_us = this->info.conversion_start_us + mcp342x_conversion_time_us(MCP342X_SRATE_12BIT) + 2000;
+    ASSERT_EQ(ESP_OK, esp_timer_start_once(other, due_us - esp_timer_get_time()));
+    ASSERT_EQ(1U, ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(500)));
+
+    EXPECT_NE(0, fired_us.load());
+    EXPECT_LT(fired_us.load() - due_us, 10000);
+    esp_timer_delete(other);
+}
+
+TEST_F(AsyncTest, DeinitWhilePending)
+{
+    this->Init(MCP342X_SRATE_16BIT);
+    ASSERT_EQ(ESP_OK, mcp342x_async_start(&this->async));
+    mcp342x_async_deinit(&this->async);
+    vTaskDelay(pdMS_TO_TICKS(100));
+    EXPECT_EQ(0, this->record.calls);
+}
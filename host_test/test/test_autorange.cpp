@@ -0,0 +1,154 @@
+/*
+    Craft Metrics
+
+    This product includes software developed by
+    Craft Metrics (https://craftmetrics.ca/).
+
+    MIT License
+    Copyright (c) 2018 Craft Metrics
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#include "mcp342x.h"
+#include "mcp342x_sim.h"
+
+#include <gtest/gtest.h>
+
+/**
+ * Auto-ranging on one-shot 12-bit conversions, 1 mV per code at 1x, so full
+ * scale is 2047 codes, the step up limit 3/8 of it and the step down limit 7/8
+ */
+static const uint8_t ADDRESS = MCP342X_A0GND_A1GND;
+
+class AutoRangeTest : public ::testing::Test
+{
+protected:
+    cm::MCP342x device{MCP342X_A0GND_A1GND};
+
+    void SetUp() override
+    {
+        mcp342x_sim_reset();
+        mcp342x_sim_add_device(ADDRESS, 4, true);
+    }
+
+    void Init(mcp342x_gain_t gain, int32_t input_nv)
+    {
+        mcp342x_sim_set_input(ADDRESS, 0, input_nv);
+        mcp342x_config_t config = {MCP342X_CHANNEL_1, MCP342X_MODE_ONESHOT, MCP342X_SRATE_12BIT, gain};
+        ASSERT_EQ(ESP_OK, this->device.Init(0, config));
+        this->device.SetAutoRange(MCP342X_CHANNEL_1, true);
+        mcp342x_sim_reset_stats();
+    }
+
+    /**
+     * Trigger and read once, returning the gain the result was converted with
+     */
+    mcp342x_gain_t Convert(int32_t *code)
+    {
+        EXPECT_EQ(ESP_OK, this->device.StartNewConversion());
+        this->device.ReadRaw(code);
+        return this->device.GetResultGain();
+    }
+
+    static uint32_t Writes(void)
+    {
+        mcp342x_sim_stats_t stats;
+        mcp342x_sim_get_stats(&stats);
+        return stats.writes;
+    }
+};
+
+TEST_F(AutoRangeTest, StepsUpAfterHold)
+{
+    this->Init(MCP342X_GAIN_1X, 100000000);
+
+    /**
+     * 100 mV stays below 3/8 of full scale up to 4x, 8x then holds at 800 codes
+     */
+    static const mcp342x_gain_t GAINS[] = {MCP342X_GAIN_1X, MCP342X_GAIN_2X, MCP342X_GAIN_4X, MCP342X_GAIN_8X};
+    for (int step = 0; step < 4; step++)
+    {
+        for (int i = 0; i < MCP342X_AUTORANGE_HOLD; i++)
+        {
+            int32_t code = 0;
+            ASSERT_EQ(GAINS[step], this->Convert(&code)) << "step " << step << " conversion " << i;
+            EXPECT_EQ(100 << step, code);
+        }
+    }
+    int32_t code = 0;
+    EXPECT_EQ(MCP342X_GAIN_8X, this->Convert(&code));
+
+    // One trigger write per conversion, gain changes included
+    EXPECT_EQ(4U * MCP342X_AUTORANGE_HOLD + 1, Writes());
+}
+
+TEST_F(AutoRangeTest, StepsDownOnSaturation)
+{
+    this->Init(MCP342X_GAIN_8X, 500000000);
+
+    /**
+     * 4000 codes saturate at 8x, 2000 at 4x still pass 7/8 of full scale,
+     * 1000 at 2x are in range and hold
+     */
+    int32_t code = 0;
+    EXPECT_EQ(MCP342X_GAIN_8X, this->Convert(&code));
+    EXPECT_EQ(2047, code);
+    EXPECT_EQ(MCP342X_GAIN_4X, this->Convert(&code));
+    EXPECT_EQ(2000, code);
+    EXPECT_EQ(MCP342X_GAIN_2X, this->Convert(&code));
+    EXPECT_EQ(1000, code);
+    for (int i = 0; i < 2 * MCP342X_AUTORANGE_HOLD; i++)
+    {
+        EXPECT_EQ(MCP342X_GAIN_2X, this->Convert(&code));
+    }
+    EXPECT_EQ(3U + 2 * MCP342X_AUTORANGE_HOLD, Writes());
+}
+
+TEST_F(AutoRangeTest, GainChangeRidesOnTrigger)
+{
+    this->Init(MCP342X_GAIN_8X, -500000000);
+    int32_t code = 0;
+    EXPECT_EQ(MCP342X_GAIN_8X, this->Convert(&code));
+    EXPECT_EQ(-2048, code);
+    EXPECT_EQ(1U, Writes());
+
+    /**
+     * The new gain is only in the driver until the next trigger, which carries it
+     */
+    EXPECT_EQ(MCP342X_GAIN_8X, mcp342x_sim_config(ADDRESS) & MCP342X_GAIN_MASK);
+    ASSERT_EQ(ESP_OK, this->device.StartNewConversion());
+    EXPECT_EQ(2U, Writes());
+    EXPECT_EQ(MCP342X_GAIN_4X, mcp342x_sim_config(ADDRESS) & MCP342X_GAIN_MASK);
+    ASSERT_EQ(MCP342X_STATUS_OK, this->device.ReadRaw(&code));
+    EXPECT_EQ(MCP342X_GAIN_4X, this->device.GetResultGain());
+    EXPECT_EQ(2U, Writes());
+}
+
+TEST_F(AutoRangeTest, DisabledKeepsGain)
+{
+    this->Init(MCP342X_GAIN_8X, 500000000);
+    this->device.SetAutoRange(MCP342X_CHANNEL_1, false);
+    int32_t code = 0;
+    for (int i = 0; i < 3; i++)
+    {
+        EXPECT_EQ(MCP342X_GAIN_8X, this->Convert(&code));
+    }
+    EXPECT_EQ(3U, Writes());
+}
@@ -0,0 +1,260 @@
+/*
+    Craft Metrics
+
+    This product includes software developed by
+    Craft Metrics (https://craftmetrics.ca/).
+
+    MIT License
+    Copyright (c) 2018 Craft Metrics
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#include "mcp342x_calibration.h"
+#include "mcp342x_sim.h"
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <gtest/gtest.h>
+#include <string>
+
+/**
+ * Two-point calibration, clamping of corrected codes and the stored blob
+ */
+static const uint8_t ADDRESS = MCP342X_A0GND_A1GND;
+
+/**
+ * The simulated front end reads 2 % high with a 5 mV offset
+ */
+static int32_t _front_end_nv(int32_t reference_nv)
+{
+    return (int32_t)((int64_t)reference_nv * 102 / 100) + 5000000;
+}
+
+class CalibrationTest : public ::testing::Test
+{
+protected:
+    smbus_info_t smbus_info;
+    mcp342x_info_t info;
+    mcp342x_calibration_t calibration;
+
+    void SetUp() override
+    {
+        mcp342x_sim_reset();
+        mcp342x_sim_add_device(ADDRESS, 4, true);
+        mcp342x_sim_set_timing(ADDRESS, 0);
+        smbus_init(&this->smbus_info, 0, ADDRESS);
+        this->info = {};
+        this->calibration = {};
+        mcp342x_set_bus(&this->info, &mcp342x_sim_bus);
+        mcp342x_set_wait_mode(&this->info, MCP342X_WAIT_POLL);
+        mcp342x_config_t config = {MCP342X_CHANNEL_1, MCP342X_MODE_ONESHOT, MCP342X_SRATE_14BIT, MCP342X_GAIN_1X};
+        ASSERT_EQ(ESP_OK, mcp342x_init(&this->info, &this->smbus_info, config));
+    }
+
+    int32_t Measure(int32_t reference_nv)
+    {
+        mcp342x_sim_set_input(ADDRESS, 0, _front_end_nv(reference_nv));
+        int32_t mean_q8 = 0;
+        EXPECT_EQ(ESP_OK, mcp342x_calibration_measure(&this->info, 4, &mean_q8));
+        return mean_q8;
+    }
+
+    mcp342x_conversion_status_t Read(int32_t *code)
+    {
+        EXPECT_EQ(ESP_OK, mcp342x_start_new_conversion(&this->info));
+        return mcp342x_read_raw(&this->info, code);
+    }
+};
+
+TEST(CalibrationLsbTest, LsbOfEveryRateAndGain)
+{
+    for (uint8_t rate = 0; rate < 4; rate++)
+    {
+        for (uint8_t gain = 0; gain < 4; gain++)
+        {
+            uint8_t config = (rate << 2) | gain;
+            uint32_t expected = (uint32_t)(8 * 2.048e9 / (1 << (11 + 2 * rate)) / (1 << gain));
+            EXPECT_EQ(expected, mcp342x_lsb_nv_q3(config | MCP342X_CHANNEL_3 | MCP342X_MODE_CONTINUOUS));
+        }
+    }
+    EXPECT_EQ(8000000U, mcp342x_lsb_nv_q3(MCP342X_SRATE_12BIT | MCP342X_GAIN_1X));
+    EXPECT_EQ(15625U, mcp342x_lsb_nv_q3(MCP342X_SRATE_18BIT | MCP342X_GAIN_8X));
+}
+
+TEST_F(CalibrationTest, TwoPointCorrectsOffsetAndGain)
+{
+    int32_t low_q8 = this->Measure(0);
+    int32_t high_q8 = this->Measure(1000000000);
+    ASSERT_EQ(ESP_OK, mcp342x_calibration_two_point(&this->calibration, this->info.config, low_q8, 0, high_q8, 1000000000));
+    mcp342x_set_calibration(&this->info, &this->calibration);
+
+    /**
+     * 250 uV per code at 14 bits and 1x
+     */
+    for (int32_t reference_nv : {-1500000000, -250000000, 0, 400000000, 1750000000})
+    {
+        mcp342x_sim_set_input(ADDRESS, 0, _front_end_nv(reference_nv));
+        int32_t code;
+        ASSERT_EQ(MCP342X_STATUS_OK, this->Read(&code));
+        EXPECT_LE(abs(code - reference_nv / 250000), 1) << reference_nv;
+    }
+}
+
+TEST_F(CalibrationTest, TwoPointWithNegativeReferences)
+{
+    int32_t low_q8 = this->Measure(-1000000000);
+    int32_t high_q8 = this->Measure(-200000000);
+    ASSERT_LT(low_q8, 0);
+    ASSERT_EQ(ESP_OK, mcp342x_calibration_two_point(&this->calibration, this->info.config, low_q8, -1000000000, high_q8, -200000000));
+    mcp342x_set_calibration(&this->info, &this->calibration);
+
+    for (int32_t reference_nv : {-1500000000, -600000000, 0, 900000000})
+    {
+        mcp342x_sim_set_input(ADDRESS, 0, _front_end_nv(reference_nv));
+        int32_t code;
+        ASSERT_EQ(MCP342X_STATUS_OK, this->Read(&code));
+        EXPECT_LE(abs(code - reference_nv / 250000), 1) << reference_nv;
+    }
+}
+
+TEST_F(CalibrationTest, CorrectedCodesSaturate)
+{
+    /**
+     * A 10 % gain trim pushes codes near full scale past it
+     */
+    uint8_t config = this->info.config;
+    mcp342x_calibration_entry_t *entry = &this->calibration.entry[mcp342x_calibration_index(config)];
+    entry->gain_trim_q24 = (1 << MCP342X_CALIBRATION_TRIM_SHIFT) / 10;
+    EXPECT_EQ(8191, mcp342x_calibrate_code(&this->calibration, config, 8000));
+    EXPECT_EQ(-8192, mcp342x_calibrate_code(&this->calibration, config, -8000));
+    EXPECT_EQ(1100, mcp342x_calibrate_code(&this->calibration, config, 1000));
+
+    /**
+     * At 18 bits and with an offset pulling the other way
+     */
+    uint8_t config_18bit = (config & ~MCP342X_SRATE_MASK) | MCP342X_SRATE_18BIT;
+    entry = &this->calibration.entry[mcp342x_calibration_index(config_18bit)];
+    entry->offset_q8 = -1000 * 256;
+    EXPECT_EQ(131071, mcp342x_calibrate_code(&this->calibration, config_18bit, 130500));
+    EXPECT_EQ(-130000, mcp342x_calibrate_code(&this->calibration, config_18bit, -131000));
+
+    /**
+     * The driver reports saturated corrections like saturated conversions
+     */
+    mcp342x_set_calibration(&this->info, &this->calibration);
+    mcp342x_sim_set_input(ADDRESS, 0, 2000000000);
+    int32_t code;
+    EXPECT_EQ(MCP342X_STATUS_OVERFLOW, this->Read(&code));
+    EXPECT_EQ(8191, code);
+    mcp342x_sim_set_input(ADDRESS, 0, -2000000000);
+    EXPECT_EQ(MCP342X_STATUS_UNDERFLOW, this->Read(&code));
+    EXPECT_EQ(-8192, code);
+    EXPECT_EQ(1U, this->info.stats.overflows);
+    EXPECT_EQ(1U, this->info.stats.underflows);
+    mcp342x_sim_set_input(ADDRESS, 0, 100000000);
+    EXPECT_EQ(MCP342X_STATUS_OK, this->Read(&code));
+    EXPECT_EQ(440, code);
+}
+
+TEST_F(CalibrationTest, BlobRoundTrip)
+{
+    for (uint8_t i = 0; i < MCP342X_CALIBRATION_ENTRIES; i += 7)
+    {
+        this->calibration.entry[i].offset_q8 = -1000 * i - 3;
+        this->calibration.entry[i].gain_trim_q24 = 12345 * i + 1;
+    }
+    uint8_t blob[MCP342X_CALIBRATION_BLOB_MAX];
+    size_t len = sizeof(blob);
+    ASSERT_EQ(ESP_OK, mcp342x_calibration_serialize(&this->calibration, blob, &len));
+    EXPECT_EQ(4 + 9 * 10 + 2U, len);
+
+    mcp342x_calibration_t restored;
+    memset(&restored, 0xA5, sizeof(restored));
+    ASSERT_EQ(ESP_OK, mcp342x_calibration_deserialize(&restored, blob, len));
+    EXPECT_EQ(0, memcmp(&this->calibration, &restored, sizeof(restored)));
+
+    /**
+     * Corruption, a short buffer and another version are refused
+     */
+    blob[10] ^= 0x01;
+    EXPECT_EQ(ESP_ERR_INVALID_CRC, mcp342x_calibration_deserialize(&restored, blob, len));
+    blob[10] ^= 0x01;
+    EXPECT_EQ(ESP_ERR_INVALID_SIZE, mcp342x_calibration_deserialize(&restored, blob, len - 1));
+    blob[2]++;
+    EXPECT_EQ(ESP_ERR_INVALID_VERSION, mcp342x_calibration_deserialize(&restored, blob, len));
+    size_t small = len - 1;
+    blob[2]--;
+    EXPECT_EQ(ESP_ERR_INVALID_SIZE, mcp342x_calibration_serialize(&this->calibration, blob, &small));
+}
+
+TEST_F(CalibrationTest, RefusedBlobLeavesTableUntouched)
+{
+    this->calibration.entry[3].offset_q8 = 1000;
+    this->calibration.entry[5].offset_q8 = -2000;
+    uint8_t blob[MCP342X_CALIBRATION_BLOB_MAX];
+    size_t len = sizeof(blob);
+    ASSERT_EQ(ESP_OK, mcp342x_calibration_serialize(&this->calibration, blob, &len));
+
+    /**
+     * Second entry points past the table, with a checksum that matches
+     */
+    blob[4 + 9] = MCP342X_CALIBRATION_ENTRIES;
+    uint16_t sum1 = 0;
+    uint16_t sum2 = 0;
+    for (size_t i = 0; i < len - 2; i++)
+    {
+        sum1 = (sum1 + blob[i]) % 255;
+        sum2 = (sum2 + sum1) % 255;
+    }
+    blob[len - 2] = sum1;
+    blob[len - 1] = sum2;
+
+    mcp342x_calibration_t restored;
+    memset(&restored, 0xA5, sizeof(restored));
+    mcp342x_calibration_t before = restored;
+    EXPECT_EQ(ESP_ERR_INVALID_SIZE, mcp342x_calibration_deserialize(&restored, blob, len));
+    EXPECT_EQ(0, memcmp(&before, &restored, sizeof(restored)));
+}
+
+TEST_F(CalibrationTest, FileRoundTrip)
+{
+    for (uint8_t i = 1; i < MCP342X_CALIBRATION_ENTRIES; i += 5)
+    {
+        this->calibration.entry[i].offset_q8 = 77 * i;
+        this->calibration.entry[i].gain_trim_q24 = -4321 * i;
+    }
+    std::string path = ::testing::TempDir() + "mcp342x_calibration.bin";
+    ASSERT_EQ(ESP_OK, mcp342x_calibration_save_file(&this->calibration, path.c_str()));
+
+    mcp342x_calibration_t restored;
+    memset(&restored, 0xA5, sizeof(restored));
+    ASSERT_EQ(ESP_OK, mcp342x_calibration_load_file(&restored, path.c_str()));
+    EXPECT_EQ(0, memcmp(&this->calibration, &restored, sizeof(restored)));
+
+    /**
+     * A truncated file is refused and a missing one reported as such
+     */
+    ASSERT_EQ(0, truncate(path.c_str(), 8));
+    EXPECT_EQ(ESP_ERR_INVALID_SIZE, mcp342x_calibration_load_file(&restored, path.c_str()));
+    EXPECT_EQ(0, memcmp(&this->calibration, &restored, sizeof(restored)));
+    remove(path.c_str());
+    EXPECT_EQ(ESP_ERR_NOT_FOUND, mcp342x_calibration_load_file(&restored, path.c_str()));
+    EXPECT_EQ(ESP_ERR_NOT_FOUND, mcp342x_calibration_save_file(&this->calibration, (::testing::TempDir() + "missing/calibration.bin").c_str()));
+}
@@ -0,0 +1,144 @@
+/*
+    Craft Metrics
+
+    This product includes software developed by
+    Craft Metrics (https://craftmetrics.ca/).
+
+    MIT License
+    Copyright (c) 2018 Craft Metrics
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#include "mcp342x_priv.h"
+#include "mcp342x_sim.h"
+
+#include <math.h>
+#include <gtest/gtest.h>
+
+/**
+ * Output code decoding, every code of every resolution and gain
+ */
+static const mcp342x_sample_rate_t RATES[] = {
+    MCP342X_SRATE_12BIT, MCP342X_SRATE_14BIT, MCP342X_SRATE_16BIT, MCP342X_SRATE_18BIT};
+static const uint8_t BITS[] = {12, 14, 16, 18};
+static const mcp342x_gain_t GAINS[] = {MCP342X_GAIN_1X, MCP342X_GAIN_2X, MCP342X_GAIN_4X, MCP342X_GAIN_8X};
+
+/**
+ * Output register as the device sends it: the code sign extended over the data bytes, then the config
+ */
+static void _output_register(int32_t code, uint8_t bits, uint8_t config, uint8_t *buffer)
+{
+    uint32_t raw = (uint32_t)code;
+    if (bits == 18)
+    {
+        buffer[0] = raw >> 16;
+        buffer[1] = raw >> 8;
+        buffer[2] = raw;
+        buffer[3] = config;
+    }
+    else
+    {
+        buffer[0] = raw >> 8;
+        buffer[1] = raw;
+        buffer[2] = config;
+        buffer[3] = config;
+    }
+}
+
+TEST(DecodeTest, EveryCodeOfEveryResolution)
+{
+    for (size_t r = 0; r < 4; r++)
+    {
+        for (mcp342x_gain_t gain : GAINS)
+        {
+            uint8_t config = MCP342X_MODE_ONESHOT | RATES[r] | gain;
+            int32_t code_min = -(1 << (BITS[r] - 1));
+            int32_t code_max = (1 << (BITS[r] - 1)) - 1;
+            double lsb_nv = 2 * 2.048e9 / (1 << BITS[r]) / (1 << gain);
+            size_t errors = 0;
+            for (int32_t expected = code_min; expected <= code_max; expected++)
+            {
+                uint8_t buffer[4];
+                _output_register(expected, BITS[r], config, buffer);
+                int32_t code = 0;
+                mcp342x_conversion_status_t status = mcp342x_output_code(config, buffer, &code);
+                mcp342x_conversion_status_t expected_status =
+                    expected == code_max ? MCP342X_STATUS_OVERFLOW : (expected == code_min ? MCP342X_STATUS_UNDERFLOW : MCP342X_STATUS_OK);
+
+                mcp342x_sample_t sample = {};
+                sample.code = code;
+                sample.config = config;
+                double nanovolts = mcp342x_sample_to_nanovolts(&sample);
+                errors += (code != expected || status != expected_status || fabs(nanovolts - expected * lsb_nv) >= 1.0) ? 1 : 0;
+            }
+            EXPECT_EQ(0U, errors) << (int)BITS[r] << " bits, gain " << (1 << gain);
+        }
+    }
+}
+
+TEST(DecodeTest, SignBitsAboveTheCodeAreIgnored)
+{
+    /**
+     * At 12 and 14 bits the upper bits repeat the sign, only the code bits count
+     */
+    uint8_t buffer[4] = {0xF8, 0x00, 0x00, 0x00};
+    int32_t code;
+    EXPECT_EQ(MCP342X_STATUS_UNDERFLOW, mcp342x_output_code(MCP342X_SRATE_12BIT, buffer, &code));
+    EXPECT_EQ(-2048, code);
+    buffer[0] = 0x07;
+    buffer[1] = 0xFE;
+    EXPECT_EQ(MCP342X_STATUS_OK, mcp342x_output_code(MCP342X_SRATE_12BIT, buffer, &code));
+    EXPECT_EQ(2046, code);
+    buffer[0] = 0xFE;
+    buffer[1] = 0x00;
+    buffer[2] = 0x01;
+    EXPECT_EQ(MCP342X_STATUS_OK, mcp342x_output_code(MCP342X_SRATE_18BIT, buffer, &code));
+    EXPECT_EQ(-131071, code);
+}
+
+TEST(DecodeTest, DriverReadsForcedCodes)
+{
+    /**
+     * End to end through the simulated device, the extremes and both sides of zero
+     */
+    mcp342x_sim_reset();
+    mcp342x_sim_add_device(MCP342X_A0GND_A1GND, 4, true);
+    mcp342x_sim_set_timing(MCP342X_A0GND_A1GND, 0);
+    smbus_info_t smbus_info;
+    smbus_init(&smbus_info, 0, MCP342X_A0GND_A1GND);
+    for (size_t r = 0; r < 4; r++)
+    {
+        mcp342x_info_t info = {};
+        mcp342x_set_bus(&info, &mcp342x_sim_bus);
+        mcp342x_set_wait_mode(&info, MCP342X_WAIT_POLL);
+        mcp342x_config_t config = {MCP342X_CHANNEL_1, MCP342X_MODE_ONESHOT, RATES[r], MCP342X_GAIN_1X};
+        ASSERT_EQ(ESP_OK, mcp342x_init(&info, &smbus_info, config));
+        int32_t code_max = (1 << (BITS[r] - 1)) - 1;
+        for (int32_t expected : {-code_max - 1, -code_max, -1, 0, 1, code_max - 1, code_max})
+        {
+            mcp342x_sim_force_code(MCP342X_A0GND_A1GND, true, expected);
+            int32_t code = 0;
+            ASSERT_EQ(ESP_OK, mcp342x_start_new_conversion(&info));
+            mcp342x_conversion_status_t status = mcp342x_read_raw(&info, &code);
+            EXPECT_NE(MCP342X_STATUS_I2C, status);
+            EXPECT_EQ(expected, code) << (int)BITS[r] << " bits";
+        }
+    }
+}
@@ -0,0 +1,131 @@
+/*
+    Craft Metrics
+
+    This product includes software developed by
+    Craft Metrics (https://craftmetrics.ca/).
+
+    MIT License
+    Copyright (c) 2018 Craft Metrics
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#include "mcp342x_device.h"
+#include "mcp342x_sim.h"
+
+#include <gtest/gtest.h>
+#include <type_traits>
+
+/**
+ * Every variant front end instantiated and read through the simulator.
+ * Channel n carries n times 100 mV, 1600 codes per 100 mV at 16 bits and 1x.
+ */
+static const mcp342x_address_t ADDRESS = MCP342X_A0GND_A1GND;
+
+static_assert(cm::MCP3421::Channels() == 1 && cm::MCP3421::Has18Bit(), "MCP3421");
+static_assert(cm::MCP3422::Channels() == 2 && cm::MCP3422::Has18Bit(), "MCP3422");
+static_assert(cm::MCP3423::Channels() == 2 && cm::MCP3423::Has18Bit(), "MCP3423");
+static_assert(cm::MCP3424::Channels() == 4 && cm::MCP3424::Has18Bit(), "MCP3424");
+static_assert(cm::MCP3425::Channels() == 1 && !cm::MCP3425::Has18Bit(), "MCP3425");
+static_assert(cm::MCP3426::Channels() == 2 && !cm::MCP3426::Has18Bit(), "MCP3426");
+static_assert(cm::MCP3427::Channels() == 2 && !cm::MCP3427::Has18Bit(), "MCP3427");
+static_assert(cm::MCP3428::Channels() == 4 && !cm::MCP3428::Has18Bit(), "MCP3428");
+
+template <typename D, int I>
+static void _read_channels(D *, std::false_type)
+{
+}
+
+/**
+ * Convert on channel I and each further channel of the variant. Channels the
+ * part does not have are never instantiated, they would fail to compile.
+ */
+template <typename D, int I>
+static void _read_channels(D *device, std::true_type)
+{
+    int32_t code = 0;
+    ASSERT_EQ(ESP_OK, (device->template StartNewConversion<(mcp342x_channel_t)(I << 5)>()));
+    ASSERT_EQ(MCP342X_STATUS_OK, device->ReadRaw(&code));
+    EXPECT_EQ(1600 * (I + 1), code) << "channel " << I + 1;
+    _read_channels<D, I + 1>(device, std::integral_constant<bool, (I + 1 < D::Channels())>());
+}
+
+template <typename D>
+static void _read_18bit(D *, std::false_type)
+{
+}
+
+template <typename D>
+static void _read_18bit(D *device, std::true_type)
+{
+    int32_t code = 0;
+    ASSERT_EQ(ESP_OK, (device->template Init<MCP342X_CHANNEL_1, MCP342X_SRATE_18BIT, MCP342X_GAIN_1X>(0)));
+    ASSERT_EQ(ESP_OK, device->StartNewConversion());
+    ASSERT_EQ(MCP342X_STATUS_OK, device->ReadRaw(&code));
+    EXPECT_EQ(6400, code);
+}
+
+template <typename D>
+class DeviceTest : public ::testing::Test
+{
+protected:
+    D device{ADDRESS};
+
+    void SetUp() override
+    {
+        mcp342x_sim_reset();
+        mcp342x_sim_add_device(ADDRESS, D::Channels(), D::Has18Bit());
+        for (uint8_t i = 0; i < 4; i++)
+        {
+            mcp342x_sim_set_input(ADDRESS, i, (int32_t)(i + 1) * 100000000);
+        }
+        ASSERT_EQ(ESP_OK, (this->device.template Init<MCP342X_CHANNEL_1, MCP342X_SRATE_16BIT, MCP342X_GAIN_1X>(0)));
+    }
+};
+
+typedef ::testing::Types<cm::MCP3421, cm::MCP3422, cm::MCP3423, cm::MCP3424,
+                         cm::MCP3425, cm::MCP3426, cm::MCP3427, cm::MCP3428> Variants;
+TYPED_TEST_SUITE(DeviceTest, Variants);
+
+TYPED_TEST(DeviceTest, ReadsEachChannel)
+{
+    _read_channels<TypeParam, 0>(&this->device, std::true_type());
+
+    /**
+     * Channel changes go through the driver, which counts them and writes
+     * the new config with the trigger
+     */
+    mcp342x_info_t *info = this->device.GetInfoPtr();
+    EXPECT_EQ((uint32_t)TypeParam::Channels() - 1, info->stats.channel_swaps);
+    EXPECT_EQ((uint32_t)TypeParam::Channels(), info->stats.conversions);
+    EXPECT_EQ(info->config & MCP342X_CHANNEL_MASK, mcp342x_sim_config(ADDRESS) & MCP342X_CHANNEL_MASK);
+}
+
+TYPED_TEST(DeviceTest, ReadsNanovolts)
+{
+    int32_t nanovolts = 0;
+    ASSERT_EQ(ESP_OK, this->device.StartNewConversion());
+    ASSERT_EQ(MCP342X_STATUS_OK, this->device.ReadNanovolts(&nanovolts));
+    EXPECT_EQ(100000000, nanovolts);
+}
+
+TYPED_TEST(DeviceTest, Reads18BitWhereAvailable)
+{
+    _read_18bit(&this->device, std::integral_constant<bool, TypeParam::Has18Bit()>());
+}
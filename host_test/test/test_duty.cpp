@@ -0,0 +1,208 @@
+/*
+    Craft Metrics
+
+    This product includes software developed by
+    Craft Metrics (https://craftmetrics.ca/).
+
+    MIT License
+    Copyright (c) 2018 Craft Metrics
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#include "mcp342x_duty.h"
+#include "mcp342x_sim.h"
+
+#include <gtest/gtest.h>
+
+#include <esp_timer.h>
+#include <time.h>
+
+/**
+ * Duty-cycled one-shot sampling, one read per sample and the energy estimate
+ */
+static const uint8_t ADDRESS = MCP342X_A0GND_A1GND;
+
+static int64_t _cpu_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+class DutyTest : public ::testing::Test
+{
+protected:
+    cm::MCP342x device{MCP342X_A0GND_A1GND};
+
+    void SetUp() override
+    {
+        mcp342x_sim_reset();
+        mcp342x_sim_add_device(ADDRESS, 4, true);
+        mcp342x_sim_set_input(ADDRESS, 0, 500000000);
+    }
+
+    void Init(mcp342x_sample_rate_t rate)
+    {
+        mcp342x_config_t config = {MCP342X_CHANNEL_1, MCP342X_MODE_ONESHOT, rate, MCP342X_GAIN_1X};
+        ASSERT_EQ(ESP_OK, this->device.Init(0, config));
+        this->device.ResetStats();
+    }
+
+    /**
+     * Take count samples of channel 1, checking each one
+     */
+    void Sample(cm::MCP342xDutyCycle *duty, int count)
+    {
+        for (int i = 0; i < count; i++)
+        {
+            mcp342x_sample_t sample;
+            ASSERT_EQ(MCP342X_STATUS_OK, duty->Next(&sample));
+            ASSERT_EQ(0, sample.device);
+            ASSERT_GT(sample.code, 0);
+        }
+    }
+};
+
+TEST_F(DutyTest, ReadsOncePerSample)
+{
+    this->Init(MCP342X_SRATE_14BIT);
+    cm::MCP342xDutyCycle duty({100, 0});
+    ASSERT_EQ(ESP_OK, duty.AddChannel(&this->device, MCP342X_CHANNEL_1, 30000));
+    this->Sample(&duty, 10);
+
+    mcp342x_stats_t stats;
+    this->device.GetStats(&stats);
+    EXPECT_EQ(10U, stats.conversions);
+    EXPECT_EQ(10U, stats.polls);
+}
+
+TEST_F(DutyTest, SleepsThroughConversions)
+{
+    this->Init(MCP342X_SRATE_14BIT);
+    cm::MCP342xDutyCycle duty({100, 0});
+    ASSERT_EQ(ESP_OK, duty.AddChannel(&this->device, MCP342X_CHANNEL_1, 20000));
+
+    int64_t wall_us = esp_timer_get_time();
+    int64_t cpu_us = _cpu_us();
+    this->Sample(&duty, 20);
+    wall_us = esp_timer_get_time() - wall_us;
+    cpu_us = _cpu_us() - cpu_us;
+
+    /**
+     * The period is kept and the task blocks between transfers
+     */
+    EXPECT_GE(wall_us, 19 * 20000);
+    EXPECT_LT(cpu_us, wall_us / 10);
+    EXPECT_LT(duty.GetAwakeUs(), wall_us / 10);
+}
+
+TEST_F(DutyTest, EnergyPerSampleByResolution)
+{
+    /**
+     * Bus only model: the trigger writes address and config, the read moves
+     * the address, the data bytes and the config byte
+     */
+    const cm::mcp342x_energy_model_t model = {100, 0};
+
+    this->Init(MCP342X_SRATE_12BIT);
+    cm::MCP342xDutyCycle fast(model);
+    ASSERT_EQ(ESP_OK, fast.AddChannel(&this->device, MCP342X_CHANNEL_1, 10000));
+    this->Sample(&fast, 8);
+    EXPECT_EQ(600U, fast.GetEnergyPerSampleNj());
+    EXPECT_EQ(8U * 600, fast.GetEnergyNj());
+
+    this->Init(MCP342X_SRATE_18BIT);
+    cm::MCP342xDutyCycle precise(model);
+    ASSERT_EQ(ESP_OK, precise.AddChannel(&this->device, MCP342X_CHANNEL_1, 300000));
+    this->Sample(&precise, 3);
+    EXPECT_EQ(700U, precise.GetEnergyPerSampleNj());
+
+    precise.ResetEnergy();
+    EXPECT_EQ(0U, precise.GetEnergyNj());
+    EXPECT_EQ(0U, precise.GetEnergyPerSampleNj());
+}
+
+TEST_F(DutyTest, AwakeTimeAddsEnergy)
+{
+    this->Init(MCP342X_SRATE_12BIT);
+    cm::MCP342xDutyCycle duty({100, 1000});
+    ASSERT_EQ(ESP_OK, duty.AddChannel(&this->device, MCP342X_CHANNEL_1, 10000));
+    this->Sample(&duty, 8);
+
+    // 1 mW is 1 nJ per us
+    EXPECT_EQ(8U * 600 + duty.GetAwakeUs(), duty.GetEnergyNj());
+}
+
+TEST_F(DutyTest, SlowPartStillCompletes)
+{
+    mcp342x_sim_set_timing(ADDRESS, 140);
+    this->Init(MCP342X_SRATE_16BIT);
+    cm::MCP342xDutyCycle duty({100, 0});
+    ASSERT_EQ(ESP_OK, duty.AddChannel(&this->device, MCP342X_CHANNEL_1, 100000));
+    this->Sample(&duty, 5);
+
+    /**
+     * The first read comes early, the retries follow a sixteenth of a conversion apart
+     */
+    mcp342x_stats_t stats;
+    this->device.GetStats(&stats);
+    EXPECT_GE(stats.polls, 10U);
+    EXPECT_LE(stats.polls, 5U * 5);
+    EXPECT_EQ(0U, stats.timeouts);
+}
+
+TEST_F(DutyTest, ChannelsKeepTheirPeriods)
+{
+    this->Init(MCP342X_SRATE_12BIT);
+    cm::MCP342xDutyCycle duty({100, 0});
+    ASSERT_EQ(ESP_OK, duty.AddChannel(&this->device, MCP342X_CHANNEL_1, 40000));
+    ASSERT_EQ(ESP_OK, duty.AddChannel(&this->device, MCP342X_CHANNEL_2, 120000));
+
+    size_t counts[2] = {0, 0};
+    for (int i = 0; i < 12; i++)
+    {
+        mcp342x_sample_t sample;
+        ASSERT_EQ(MCP342X_STATUS_OK, duty.Next(&sample));
+        ASSERT_LT(sample.device, 2);
+        EXPECT_EQ(sample.device == 0 ? MCP342X_CHANNEL_1 : MCP342X_CHANNEL_2, sample.config & MCP342X_CHANNEL_MASK);
+        counts[sample.device]++;
+    }
+    EXPECT_EQ(9U, counts[0]);
+    EXPECT_EQ(3U, counts[1]);
+}
+
+TEST_F(DutyTest, RejectsContinuousMode)
+{
+    mcp342x_config_t config = {MCP342X_CHANNEL_1, MCP342X_MODE_CONTINUOUS, MCP342X_SRATE_12BIT, MCP342X_GAIN_1X};
+    ASSERT_EQ(ESP_OK, this->device.Init(0, config));
+    cm::MCP342xDutyCycle duty({100, 0});
+    EXPECT_EQ(ESP_ERR_INVALID_STATE, duty.AddChannel(&this->device, MCP342X_CHANNEL_1, 10000));
+    EXPECT_EQ(ESP_ERR_INVALID_ARG, duty.AddChannel(&this->device, MCP342X_CHANNEL_1, 0));
+}
+
+TEST_F(DutyTest, NextNeedsAChannel)
+{
+    this->Init(MCP342X_SRATE_12BIT);
+    cm::MCP342xDutyCycle duty({100, 1000});
+    mcp342x_sample_t sample;
+    EXPECT_EQ(MCP342X_STATUS_INVALID_STATE, duty.Next(&sample));
+    EXPECT_EQ(0U, duty.GetEnergyNj());
+    EXPECT_EQ(0U, this->device.GetInfoPtr()->stats.conversions);
+}
@@ -0,0 +1,207 @@
+/*
+    Craft Metrics
+
+    This product includes software developed by
+    Craft Metrics (https://craftmetrics.ca/).
+
+    MIT License
+    Copyright (c) 2018 Craft Metrics
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#include "mcp342x_export.h"
+#include "mcp342x.h"
+
+#include <gtest/gtest.h>
+
+#include <vector>
+
+/**
+ * Slowly changing 18-bit capture at 3.75 samples/s, with a pseudo random
+ * walk of the code and the given timing jitter
+ */
+static std::vector<mcp342x_sample_t> _capture(size_t count, uint32_t jitter_us, uint32_t start_us)
+{
+    std::vector<mcp342x_sample_t> samples(count);
+    uint8_t config = MCP342X_CHANNEL_2 | MCP342X_MODE_CONTINUOUS | MCP342X_SRATE_18BIT | MCP342X_GAIN_2X;
+    uint32_t state = 1;
+    int32_t code = 60000;
+    for (size_t i = 0; i < count; i++)
+    {
+        state = state * 1664525 + 1013904223;
+        code += (int32_t)(state >> 26) - 32;
+        int32_t jitter = jitter_us ? (int32_t)((state >> 8) % (2 * jitter_us + 1)) - (int32_t)jitter_us : 0;
+        samples[i].code = code;
+        samples[i].ready_us = start_us + (uint32_t)(i * 266667) + (uint32_t)jitter;
+        samples[i].start_us = samples[i].ready_us - 266667;
+        samples[i].config = config;
+        samples[i].status = MCP342X_STATUS_OK;
+    }
+    return samples;
+}
+
+static size_t _encode(const std::vector<mcp342x_sample_t> &samples, std::vector<uint8_t> *buffer)
+{
+    mcp342x_export_encoder_t encoder;
+    mcp342x_export_init(&encoder, buffer->data(), buffer->size());
+    size_t appended = 0;
+    while (appended < samples.size() && mcp342x_export_append(&encoder, &samples[appended]))
+    {
+        appended++;
+    }
+    mcp342x_export_close(&encoder);
+    buffer->resize(encoder.length);
+    return appended;
+}
+
+static std::vector<mcp342x_export_record_t> _decode(const std::vector<uint8_t> &buffer)
+{
+    std::vector<mcp342x_export_record_t> records;
+    mcp342x_export_decoder_t decoder;
+    mcp342x_export_decoder_init(&decoder, buffer.data(), buffer.size());
+    mcp342x_export_record_t record;
+    while (mcp342x_export_next(&decoder, &record))
+    {
+        records.push_back(record);
+    }
+    return records;
+}
+
+static void _expect_equal(const std::vector<mcp342x_sample_t> &samples, const std::vector<mcp342x_export_record_t> &records)
+{
+    ASSERT_EQ(samples.size(), records.size());
+    for (size_t i = 0; i < samples.size(); i++)
+    {
+        ASSERT_EQ(samples[i].code, records[i].code) << "sample " << i;
+        ASSERT_EQ(samples[i].ready_us, records[i].timestamp_us) << "sample " << i;
+        ASSERT_EQ(samples[i].config, records[i].config) << "sample " << i;
+    }
+}
+
+TEST(ExportTest, RoundTripsExactly)
+{
+    /**
+     * Start just before the 32-bit timestamp wraps
+     */
+    std::vector<mcp342x_sample_t> samples = _capture(20000, 100, 0xFFFF0000);
+    std::vector<uint8_t> buffer(20000 * 8);
+    ASSERT_EQ(samples.size(), _encode(samples, &buffer));
+    _expect_equal(samples, _decode(buffer));
+}
+
+/**
+ * One byte for the code change and one for the timing deviation at a steady
+ * rate, a second timing byte once the jitter exceeds +/-63 us. The block
+ * header and the full first code come on top.
+ */
+TEST(ExportTest, TwoToThreeBytesPerSample)
+{
+    std::vector<mcp342x_sample_t> steady = _capture(20000, 0, 0);
+    std::vector<uint8_t> buffer(20000 * 8);
+    _encode(steady, &buffer);
+    EXPECT_LE(buffer.size(), 2 * steady.size() + MCP342X_EXPORT_HEADER_SIZE + 4);
+
+    std::vector<mcp342x_sample_t> jittery = _capture(20000, 100, 0);
+    buffer.resize(20000 * 8);
+    _encode(jittery, &buffer);
+    EXPECT_GT(buffer.size(), 2 * jittery.size());
+    EXPECT_LE(buffer.size(), 3 * jittery.size() + MCP342X_EXPORT_HEADER_SIZE + 4);
+}
+
+TEST(ExportTest, ConfigChangeStartsBlock)
+{
+    std::vector<mcp342x_sample_t> samples = _capture(30, 100, 0);
+    for (size_t i = 10; i < 20; i++)
+    {
+        samples[i].config = (samples[i].config & ~MCP342X_GAIN_MASK) | MCP342X_GAIN_8X;
+        samples[i].code *= -4;
+    }
+    std::vector<uint8_t> buffer(1024);
+    ASSERT_EQ(samples.size(), _encode(samples, &buffer));
+    _expect_equal(samples, _decode(buffer));
+    EXPECT_EQ('M', buffer[0]);
+    EXPECT_EQ(samples[0].config, buffer[3]);
+}
+
+TEST(ExportTest, SamplesWithoutCodeAreSkipped)
+{
+    std::vector<mcp342x_sample_t> samples = _capture(10, 0, 0);
+    samples[3].status = MCP342X_STATUS_TIMEOUT;
+    samples[7].status = MCP342X_STATUS_OVERFLOW;
+
+    std::vector<uint8_t> buffer(256);
+    mcp342x_export_encoder_t encoder;
+    mcp342x_export_init(&encoder, buffer.data(), buffer.size());
+    for (const mcp342x_sample_t &sample : samples)
+    {
+        ASSERT_TRUE(mcp342x_export_append(&encoder, &sample));
+    }
+    mcp342x_export_close(&encoder);
+    buffer.resize(encoder.length);
+    EXPECT_EQ(1U, encoder.skipped);
+
+    samples.erase(samples.begin() + 3);
+    _expect_equal(samples, _decode(buffer));
+}
+
+TEST(ExportTest, FullBufferStaysDecodable)
+{
+    std::vector<mcp342x_sample_t> samples = _capture(200, 100, 0);
+    std::vector<uint8_t> buffer(100);
+    size_t appended = _encode(samples, &buffer);
+
+    /**
+     * The sample that did not fit is refused whole
+     */
+    ASSERT_GT(appended, 20U);
+    ASSERT_LT(appended, samples.size());
+    EXPECT_LE(buffer.size(), 100U);
+    samples.resize(appended);
+    _expect_equal(samples, _decode(buffer));
+}
+
+TEST(ExportTest, LongCaptureSplitsBlocks)
+{
+    std::vector<mcp342x_sample_t> samples = _capture(UINT16_MAX + 100, 0, 0);
+    std::vector<uint8_t> buffer(samples.size() * 4);
+    ASSERT_EQ(samples.size(), _encode(samples, &buffer));
+    _expect_equal(samples, _decode(buffer));
+}
+
+TEST(ExportTest, TruncatedDataEndsCleanly)
+{
+    std::vector<mcp342x_sample_t> samples = _capture(50, 100, 0);
+    std::vector<uint8_t> buffer(1024);
+    _encode(samples, &buffer);
+
+    /**
+     * Cut inside the header and inside the records, the decoder stops at the cut
+     */
+    for (size_t length : {(size_t)5, (size_t)MCP342X_EXPORT_HEADER_SIZE, buffer.size() / 2, buffer.size() - 1})
+    {
+        std::vector<uint8_t> truncated(buffer.begin(), buffer.begin() + length);
+        std::vector<mcp342x_export_record_t> records = _decode(truncated);
+        ASSERT_LT(records.size(), samples.size());
+        for (size_t i = 0; i < records.size(); i++)
+        {
+            EXPECT_EQ(samples[i].code, records[i].code);
+        }
+    }
+}
@@ -0,0 +1,218 @@
+/*
+    Craft Metrics
+
+    This product includes software developed by
+    Craft Metrics (https://craftmetrics.ca/).
+
+    MIT License
+    Copyright (c) 2018 Craft Metrics
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#include "mcp342x_filter.h"
+
+#include <gtest/gtest.h>
+
+#include <vector>
+
+/**
+ * Decimation filters at their limits
+ */
+static int32_t _run(mcp342x_filter_t *filter, int32_t code, uint32_t codes)
+{
+    int32_t output = 0;
+    for (uint32_t i = 0; i < codes; i++)
+    {
+        mcp342x_filter_push(filter, code, &output);
+    }
+    return output;
+}
+
+TEST(FilterTest, BoxcarFullScaleAtMaxGain)
+{
+    mcp342x_filter_t filter;
+    ASSERT_EQ(ESP_OK, mcp342x_filter_init_boxcar(&filter, MCP342X_FILTER_MAX_GAIN));
+    EXPECT_EQ(MCP342X_FILTER_CODE_MAX * MCP342X_FILTER_MAX_GAIN, _run(&filter, MCP342X_FILTER_CODE_MAX, MCP342X_FILTER_MAX_GAIN));
+    EXPECT_EQ(INT32_MIN, _run(&filter, MCP342X_FILTER_CODE_MIN, MCP342X_FILTER_MAX_GAIN));
+}
+
+TEST(FilterTest, OutOfRangeCodesAreClamped)
+{
+    /**
+     * Codes beyond 18 bits used to wrap the sum and flip its sign
+     */
+    mcp342x_filter_t filter;
+    ASSERT_EQ(ESP_OK, mcp342x_filter_init_boxcar(&filter, MCP342X_FILTER_MAX_GAIN));
+    EXPECT_EQ(MCP342X_FILTER_CODE_MAX * MCP342X_FILTER_MAX_GAIN, _run(&filter, 1 << 18, MCP342X_FILTER_MAX_GAIN));
+    EXPECT_EQ(INT32_MIN, _run(&filter, -(1 << 20), MCP342X_FILTER_MAX_GAIN));
+
+    ASSERT_EQ(ESP_OK, mcp342x_filter_init_cic(&filter, 128, 2));
+    EXPECT_EQ(MCP342X_FILTER_CODE_MAX * MCP342X_FILTER_MAX_GAIN, _run(&filter, INT32_MAX, 128 * 8));
+}
+
+TEST(FilterTest, CicSettlesToGainTimesInput)
+{
+    for (uint8_t order = 1; order <= MCP342X_FILTER_CIC_MAX_ORDER; order++)
+    {
+        mcp342x_filter_t filter;
+        uint16_t decimation = order == 1 ? 16384 : (order == 2 ? 128 : (order == 3 ? 25 : 11));
+        ASSERT_EQ(ESP_OK, mcp342x_filter_init_cic(&filter, decimation, order));
+        for (int32_t code : {MCP342X_FILTER_CODE_MIN, -1, 0, 1234, MCP342X_FILTER_CODE_MAX})
+        {
+            EXPECT_EQ((int64_t)code * filter.gain, _run(&filter, code, decimation * (order + 1)))
+                << "order " << (int)order << " code " << code;
+        }
+    }
+    mcp342x_filter_t filter;
+    EXPECT_EQ(ESP_ERR_INVALID_ARG, mcp342x_filter_init_cic(&filter, 129, 2));
+}
+
+TEST(FilterTest, MedianRejectsSpikes)
+{
+    int32_t buffer[2 * 5];
+    mcp342x_filter_t filter;
+    ASSERT_EQ(ESP_OK, mcp342x_filter_init_median(&filter, 5, 5, buffer));
+    int32_t codes[] = {100, 101, 99, 100000, 100, -100000, 102, 98, 100, 101};
+    int32_t output = 0;
+    int outputs = 0;
+    for (int32_t code : codes)
+    {
+        if (mcp342x_filter_push(&filter, code, &output))
+        {
+            EXPECT_NEAR(100, output, 1);
+            outputs++;
+        }
+    }
+    EXPECT_EQ(2, outputs);
+}
+
+TEST(FilterTest, CicMatchesCascadedBoxcars)
+{
+    /**
+     * An order N CIC decimating by R outputs the input convolved with N
+     * boxcars of length R, sampled every R codes
+     */
+    const uint16_t decimation = 5;
+    for (uint8_t order = 1; order <= MCP342X_FILTER_CIC_MAX_ORDER; order++)
+    {
+        std::vector<int64_t> kernel(1, 1);
+        for (uint8_t i = 0; i < order; i++)
+        {
+            std::vector<int64_t> next(kernel.size() + decimation - 1, 0);
+            for (size_t j = 0; j < kernel.size(); j++)
+            {
+                for (uint16_t k = 0; k < decimation; k++)
+                {
+                    next[j + k] += kernel[j];
+                }
+            }
+            kernel = next;
+        }
+
+        const uint32_t codes = decimation * 8;
+        std::vector<int32_t> step(codes), ramp(codes);
+        for (uint32_t n = 0; n < codes; n++)
+        {
+            step[n] = n < 7 ? 0 : 1000;
+            ramp[n] = 50 * (int32_t)n - 600;
+        }
+        for (const std::vector<int32_t> *input : {&step, &ramp})
+        {
+            mcp342x_filter_t filter;
+            ASSERT_EQ(ESP_OK, mcp342x_filter_init_cic(&filter, decimation, order));
+            int outputs = 0;
+            for (uint32_t n = 0; n < codes; n++)
+            {
+                int32_t output = 0;
+                if (!mcp342x_filter_push(&filter, (*input)[n], &output))
+                {
+                    continue;
+                }
+                outputs++;
+                int64_t expected = 0;
+                for (size_t j = 0; j < kernel.size() && j <= n; j++)
+                {
+                    expected += kernel[j] * (*input)[n - j];
+                }
+                EXPECT_EQ(expected, output) << "order " << (int)order << " code " << n << (input == &step ? " step" : " ramp");
+            }
+            EXPECT_EQ(8, outputs);
+        }
+    }
+}
+
+TEST(FilterTest, PlanSwitchesResolutionAtSlowestConversionTimes)
+{
+    struct
+    {
+        uint32_t max_latency_us;
+        mcp342x_sample_rate_t sample_rate;
+        uint16_t decimation;
+        mcp342x_sample_rate_t sample_rate_no_18bit;
+        uint16_t decimation_no_18bit;
+    } cases[] = {
+        {5682, MCP342X_SRATE_12BIT, 1, MCP342X_SRATE_12BIT, 1},
+        {22727, MCP342X_SRATE_12BIT, 3, MCP342X_SRATE_12BIT, 3},
+        {22728, MCP342X_SRATE_14BIT, 1, MCP342X_SRATE_14BIT, 1},
+        {90909, MCP342X_SRATE_14BIT, 3, MCP342X_SRATE_14BIT, 3},
+        {90910, MCP342X_SRATE_16BIT, 1, MCP342X_SRATE_16BIT, 1},
+        {363636, MCP342X_SRATE_16BIT, 3, MCP342X_SRATE_16BIT, 3},
+        {363637, MCP342X_SRATE_18BIT, 1, MCP342X_SRATE_16BIT, 3},
+    };
+    for (const auto &c : cases)
+    {
+        for (bool has_18bit : {true, false})
+        {
+            mcp342x_sample_rate_t sample_rate;
+            uint16_t decimation = 0;
+            ASSERT_EQ(ESP_OK, mcp342x_filter_plan(c.max_latency_us, has_18bit, &sample_rate, &decimation));
+            EXPECT_EQ(has_18bit ? c.sample_rate : c.sample_rate_no_18bit, sample_rate) << c.max_latency_us << " us";
+            EXPECT_EQ(has_18bit ? c.decimation : c.decimation_no_18bit, decimation) << c.max_latency_us << " us";
+        }
+    }
+}
+
+TEST(FilterTest, PlanFitsTheBudgetOnSlowParts)
+{
+    /**
+     * A typical 18-bit conversion fits 266667 us, a slow one does not
+     */
+    mcp342x_sample_rate_t sample_rate;
+    uint16_t decimation = 0;
+    ASSERT_EQ(ESP_OK, mcp342x_filter_plan(266667, true, &sample_rate, &decimation));
+    EXPECT_NE(MCP342X_SRATE_18BIT, sample_rate);
+
+    for (uint32_t max_latency_us = 5682; max_latency_us < 4000000; max_latency_us = max_latency_us * 5 / 4 + 1)
+    {
+        ASSERT_EQ(ESP_OK, mcp342x_filter_plan(max_latency_us, true, &sample_rate, &decimation));
+        EXPECT_GE(decimation, 1);
+        EXPECT_LE((uint64_t)decimation * mcp342x_conversion_time_max_us(sample_rate), max_latency_us);
+    }
+}
+
+TEST(FilterTest, PlanFailsBelowOneConversion)
+{
+    mcp342x_sample_rate_t sample_rate = MCP342X_SRATE_16BIT;
+    uint16_t decimation = 7;
+    EXPECT_EQ(ESP_ERR_NOT_FOUND, mcp342x_filter_plan(5681, true, &sample_rate, &decimation));
+    EXPECT_EQ(ESP_ERR_NOT_FOUND, mcp342x_filter_plan(0, false, &sample_rate, &decimation));
+    EXPECT_EQ(MCP342X_SRATE_16BIT, sample_rate);
+    EXPECT_EQ(7, decimation);
+}
@@ -0,0 +1,229 @@
+/*
+    Craft Metrics
+
+    This product includes software developed by
+    Craft Metrics (https://craftmetrics.ca/).
+
+    MIT License
+    Copyright (c) 2018 Craft Metrics
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#include "mcp342x.h"
+#include "mcp342x_sim.h"
+
+#include <freertos/task.h>
+#include <gtest/gtest.h>
+#include <tuple>
+
+/**
+ * Non-blocking polls and integer nanovolt results on the simulator
+ */
+static const uint8_t ADDRESS = MCP342X_A0GND_A1GND;
+static const double SENTINEL = 12345.0;
+static const int32_t SENTINEL_NV = 0x5a5a5a5a;
+
+/**
+ * Reference scale: 2.048 V / 2^(bits - 1) / gain, rounded towards minus infinity
+ */
+static int32_t _expected_nv(mcp342x_sample_rate_t sample_rate, mcp342x_gain_t gain, int32_t code)
+{
+    int bits = 12 + 2 * (sample_rate >> 2);
+    return (int32_t)(((int64_t)code * 2048000000) >> (bits - 1 + gain));
+}
+
+class NanovoltsTest : public ::testing::TestWithParam<std::tuple<mcp342x_sample_rate_t, mcp342x_gain_t>>
+{
+protected:
+    smbus_info_t smbus_info;
+    mcp342x_info_t info;
+
+    void SetUp() override
+    {
+        mcp342x_sim_reset();
+        mcp342x_sim_add_device(ADDRESS, 4, true);
+        mcp342x_sim_set_timing(ADDRESS, 0);
+        smbus_init(&this->smbus_info, 0, ADDRESS);
+        this->info = {};
+        mcp342x_set_bus(&this->info, &mcp342x_sim_bus);
+        mcp342x_set_wait_mode(&this->info, MCP342X_WAIT_POLL);
+        mcp342x_config_t config = {MCP342X_CHANNEL_1, MCP342X_MODE_ONESHOT, Rate(), Gain()};
+        ASSERT_EQ(ESP_OK, mcp342x_init(&this->info, &this->smbus_info, config));
+    }
+
+    static mcp342x_sample_rate_t Rate(void)
+    {
+        return std::get<0>(GetParam());
+    }
+
+    static mcp342x_gain_t Gain(void)
+    {
+        return std::get<1>(GetParam());
+    }
+
+    static int32_t CodeMax(void)
+    {
+        return (1 << (11 + 2 * (Rate() >> 2))) - 1;
+    }
+};
+
+TEST_P(NanovoltsTest, CodeScaleMatchesDatasheet)
+{
+    for (int32_t code : {-CodeMax() - 1, -CodeMax(), -1000, -1, 0, 1, 3, 1000, CodeMax()})
+    {
+        EXPECT_EQ(_expected_nv(Rate(), Gain(), code), mcp342x_code_to_nanovolts(&this->info, code)) << "code " << code;
+    }
+    EXPECT_EQ(-2048000000 >> Gain(), mcp342x_code_to_nanovolts(&this->info, -CodeMax() - 1));
+}
+
+TEST_P(NanovoltsTest, ReadNanovoltsScalesTheConvertedCode)
+{
+    for (int32_t input_nv : {-150000000, -1000000, 0, 7654321, 200000000})
+    {
+        mcp342x_sim_set_input(ADDRESS, 0, input_nv);
+        ASSERT_EQ(ESP_OK, mcp342x_start_new_conversion(&this->info));
+        int32_t nanovolts = SENTINEL_NV;
+        ASSERT_EQ(MCP342X_STATUS_OK, mcp342x_read_nanovolts(&this->info, &nanovolts));
+
+        /**
+         * Within one LSB of the input, exactly on a code step
+         */
+        int32_t lsb_nv = _expected_nv(Rate(), Gain(), 1) + 1;
+        EXPECT_NEAR(input_nv, nanovolts, lsb_nv) << "input " << input_nv;
+        int32_t code = 0;
+        ASSERT_EQ(ESP_OK, mcp342x_start_new_conversion(&this->info));
+        ASSERT_EQ(MCP342X_STATUS_OK, mcp342x_read_raw(&this->info, &code));
+        EXPECT_EQ(_expected_nv(Rate(), Gain(), code), nanovolts) << "input " << input_nv;
+
+        double result = SENTINEL;
+        ASSERT_EQ(ESP_OK, mcp342x_start_new_conversion(&this->info));
+        ASSERT_EQ(MCP342X_STATUS_OK, mcp342x_poll_result(&this->info, &result));
+        EXPECT_DOUBLE_EQ(nanovolts * 1e-9, result) << "input " << input_nv;
+    }
+}
+
+TEST_P(NanovoltsTest, FullScaleCodesKeepTheirScale)
+{
+    mcp342x_sim_force_code(ADDRESS, true, CodeMax());
+    ASSERT_EQ(ESP_OK, mcp342x_start_new_conversion(&this->info));
+    int32_t nanovolts = SENTINEL_NV;
+    EXPECT_EQ(MCP342X_STATUS_OVERFLOW, mcp342x_read_nanovolts(&this->info, &nanovolts));
+    EXPECT_EQ(_expected_nv(Rate(), Gain(), CodeMax()), nanovolts);
+
+    mcp342x_sim_force_code(ADDRESS, true, -CodeMax() - 1);
+    ASSERT_EQ(ESP_OK, mcp342x_start_new_conversion(&this->info));
+    EXPECT_EQ(MCP342X_STATUS_UNDERFLOW, mcp342x_read_nanovolts(&this->info, &nanovolts));
+    EXPECT_EQ(-2048000000 >> Gain(), nanovolts);
+}
+
+INSTANTIATE_TEST_SUITE_P(RatesAndGains, NanovoltsTest,
+                         ::testing::Combine(::testing::Values(MCP342X_SRATE_12BIT, MCP342X_SRATE_14BIT, MCP342X_SRATE_16BIT, MCP342X_SRATE_18BIT),
+                                            ::testing::Values(MCP342X_GAIN_1X, MCP342X_GAIN_2X, MCP342X_GAIN_4X, MCP342X_GAIN_8X)));
+
+class PollTest : public ::testing::Test
+{
+protected:
+    smbus_info_t smbus_info;
+    mcp342x_info_t info;
+
+    void SetUp() override
+    {
+        mcp342x_sim_reset();
+        mcp342x_sim_add_device(ADDRESS, 4, true);
+        mcp342x_sim_set_input(ADDRESS, 0, 100000000);
+        smbus_init(&this->smbus_info, 0, ADDRESS);
+        this->info = {};
+        mcp342x_set_bus(&this->info, &mcp342x_sim_bus);
+        mcp342x_set_wait_mode(&this->info, MCP342X_WAIT_POLL);
+        mcp342x_config_t config = {MCP342X_CHANNEL_1, MCP342X_MODE_ONESHOT, MCP342X_SRATE_14BIT, MCP342X_GAIN_1X};
+        ASSERT_EQ(ESP_OK, mcp342x_init(&this->info, &this->smbus_info, config));
+    }
+};
+
+TEST_F(PollTest, InProgressLeavesResultUntouched)
+{
+    ASSERT_EQ(ESP_OK, mcp342x_start_new_conversion(&this->info));
+    double result = SENTINEL;
+    ASSERT_EQ(MCP342X_STATUS_IN_PROGRESS, mcp342x_poll_result(&this->info, &result));
+    EXPECT_EQ(SENTINEL, result);
+
+    /**
+     * Keep polling until the conversion is done, every miss leaves the result alone
+     */
+    mcp342x_conversion_status_t status;
+    int polls = 1;
+    while ((status = mcp342x_poll_result(&this->info, &result)) == MCP342X_STATUS_IN_PROGRESS)
+    {
+        EXPECT_EQ(SENTINEL, result);
+        polls++;
+        vTaskDelay(1);
+    }
+    EXPECT_EQ(MCP342X_STATUS_OK, status);
+    EXPECT_GT(polls, 1);
+    EXPECT_DOUBLE_EQ(0.1, result);
+}
+
+TEST_F(PollTest, FailedReadsLeaveResultUntouched)
+{
+    ASSERT_EQ(ESP_OK, mcp342x_start_new_conversion(&this->info));
+    mcp342x_sim_fail(ADDRESS, 1);
+    double result = SENTINEL;
+    EXPECT_EQ(MCP342X_STATUS_I2C, mcp342x_poll_result(&this->info, &result));
+    EXPECT_EQ(SENTINEL, result);
+
+    /**
+     * A part that never finishes times out in the waiting read
+     */
+    mcp342x_sim_set_timing(ADDRESS, 50000);
+    ASSERT_EQ(ESP_OK, mcp342x_start_new_conversion(&this->info));
+    int32_t nanovolts = SENTINEL_NV;
+    EXPECT_EQ(MCP342X_STATUS_TIMEOUT, mcp342x_read_nanovolts(&this->info, &nanovolts));
+    EXPECT_EQ(SENTINEL_NV, nanovolts);
+}
+
+TEST(TryReadTest, InProgressLeavesResultUntouched)
+{
+    mcp342x_sim_reset();
+    mcp342x_sim_add_device(ADDRESS, 4, true);
+    mcp342x_sim_set_input(ADDRESS, 0, -250000000);
+    cm::MCP342x device(MCP342X_A0GND_A1GND);
+    mcp342x_config_t config = {MCP342X_CHANNEL_1, MCP342X_MODE_ONESHOT, MCP342X_SRATE_14BIT, MCP342X_GAIN_2X};
+    ASSERT_EQ(ESP_OK, device.Init(0, config));
+
+    ASSERT_EQ(ESP_OK, device.StartNewConversion());
+    double result = SENTINEL;
+    mcp342x_conversion_status_t status;
+    int polls = 0;
+    while ((status = device.TryRead(&result)) == MCP342X_STATUS_IN_PROGRESS)
+    {
+        EXPECT_EQ(SENTINEL, result);
+        polls++;
+        vTaskDelay(1);
+    }
+    EXPECT_GT(polls, 0);
+    EXPECT_EQ(MCP342X_STATUS_OK, status);
+    EXPECT_DOUBLE_EQ(-0.25, result);
+
+    ASSERT_EQ(ESP_OK, device.StartNewConversion());
+    mcp342x_sim_fail(ADDRESS, 1);
+    result = SENTINEL;
+    EXPECT_EQ(MCP342X_STATUS_I2C, device.TryRead(&result));
+    EXPECT_EQ(SENTINEL, result);
+}
@@ -0,0 +1,154 @@
+/*
+    Craft Metrics
+
+    This product includes software developed by
+    Craft Metrics (https://craftmetrics.ca/).
+
+    MIT License
+    Copyright (c) 2018 Craft Metrics
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#include "mcp342x_probe.h"
+#include "mcp342x_sim.h"
+
+#include <gtest/gtest.h>
+
+/**
+ * Variant detection from config read-back and output register layout
+ */
+class ProbeTest : public ::testing::Test
+{
+protected:
+    mcp342x_probe_result_t results[MCP342X_PROBE_ADDRESSES];
+    size_t found = 0;
+
+    void SetUp() override
+    {
+        mcp342x_sim_reset();
+    }
+
+    void Add(uint8_t address, uint8_t channels, bool has_18bit)
+    {
+        mcp342x_sim_add_device(address, channels, has_18bit);
+        for (uint8_t ch = 0; ch < 4; ch++)
+        {
+            mcp342x_sim_set_input(address, ch, 250000000);
+        }
+    }
+
+    void Probe(void)
+    {
+        mcp342x_config_t config = {MCP342X_CHANNEL_1, MCP342X_MODE_CONTINUOUS, MCP342X_SRATE_12BIT, MCP342X_GAIN_2X};
+        ASSERT_EQ(ESP_OK, mcp342x_probe(0, &mcp342x_sim_bus, config, this->results, MCP342X_PROBE_ADDRESSES, &this->found));
+    }
+};
+
+TEST_F(ProbeTest, EveryVariantFromReadBack)
+{
+    /**
+     * Identical inputs on every channel, as with nothing connected
+     */
+    this->Add(MCP342X_A0GND_A1GND, 1, true);   // MCP3421
+    this->Add(MCP342X_A0GND_A1FLT, 2, true);   // MCP3422
+    this->Add(MCP342X_A0GND_A1VCC, 4, true);   // MCP3424
+    this->Add(MCP342X_A0FLT_A1GND, 1, false);  // MCP3425
+    this->Add(MCP342X_A0VCC_A1GND, 2, false);  // MCP3426
+    this->Add(MCP342X_A0VCC_A1FLT, 4, false);  // MCP3428
+    this->Probe();
+    ASSERT_EQ(6U, this->found);
+
+    const struct
+    {
+        uint8_t channels;
+        bool has_18bit;
+    } expected[] = {{1, true}, {0, true}, {0, true}, {1, false}, {0, false}, {0, false}};
+    for (size_t i = 0; i < this->found; i++)
+    {
+        EXPECT_TRUE(this->results[i].identified) << i;
+        EXPECT_EQ(expected[i].channels, this->results[i].channels) << i;
+        EXPECT_EQ(expected[i].has_18bit, this->results[i].has_18bit) << i;
+    }
+}
+
+TEST_F(ProbeTest, DataMatchingTheConfigByteStillReads18Bit)
+{
+    /**
+     * The low data byte equals the config byte, which fooled a byte comparison
+     */
+    uint8_t config = MCP342X_CNTRL_MASK | MCP342X_MODE_ONESHOT | MCP342X_SRATE_18BIT | MCP342X_GAIN_1X;
+    for (bool has_18bit : {true, false})
+    {
+        mcp342x_sim_reset();
+        this->Add(MCP342X_A0GND_A1GND, 4, has_18bit);
+        mcp342x_sim_force_code(MCP342X_A0GND_A1GND, true, config);
+        this->Probe();
+        ASSERT_EQ(1U, this->found);
+        EXPECT_TRUE(this->results[0].identified);
+        EXPECT_EQ(has_18bit, this->results[0].has_18bit);
+    }
+}
+
+TEST_F(ProbeTest, EveryDataByteIsDeterministic)
+{
+    /**
+     * Sweep the low data byte through every value on both layouts
+     */
+    for (int32_t low = 0; low < 256; low += 51)
+    {
+        for (bool has_18bit : {true, false})
+        {
+            mcp342x_sim_reset();
+            this->Add(MCP342X_A0GND_A1GND, 1, has_18bit);
+            mcp342x_sim_set_timing(MCP342X_A0GND_A1GND, 0);
+            mcp342x_sim_force_code(MCP342X_A0GND_A1GND, true, 0x0100 | low);
+            this->Probe();
+            ASSERT_EQ(1U, this->found);
+            EXPECT_TRUE(this->results[0].identified);
+            EXPECT_EQ(has_18bit, this->results[0].has_18bit) << low;
+            EXPECT_EQ(1, this->results[0].channels);
+        }
+    }
+}
+
+TEST_F(ProbeTest, RequestedConfigRestored)
+{
+    this->Add(MCP342X_A0GND_A1GND, 4, true);
+    this->Add(MCP342X_A0GND_A1FLT, 1, false);
+    this->Probe();
+    ASSERT_EQ(2U, this->found);
+
+    /**
+     * The probe leaves each device with the requested config, written for real
+     */
+    uint8_t config = MCP342X_MODE_CONTINUOUS | MCP342X_SRATE_12BIT | MCP342X_GAIN_2X;
+    EXPECT_EQ(config, mcp342x_sim_config(MCP342X_A0GND_A1GND) & ~MCP342X_CNTRL_MASK);
+    EXPECT_EQ(config, mcp342x_sim_config(MCP342X_A0GND_A1FLT) & ~MCP342X_CNTRL_MASK);
+    int32_t code;
+    EXPECT_EQ(MCP342X_STATUS_OK, mcp342x_read_raw(&this->results[0].mcp342x_info, &code));
+    EXPECT_EQ(500, code);
+}
+
+TEST_F(ProbeTest, NoDevice)
+{
+    mcp342x_config_t config = {MCP342X_CHANNEL_1, MCP342X_MODE_ONESHOT, MCP342X_SRATE_12BIT, MCP342X_GAIN_1X};
+    EXPECT_EQ(ESP_ERR_NOT_FOUND, mcp342x_probe(0, &mcp342x_sim_bus, config, this->results, MCP342X_PROBE_ADDRESSES, &this->found));
+    EXPECT_EQ(0U, this->found);
+}
@@ -0,0 +1,100 @@
+/*
+    Craft Metrics
+
+    This product includes software developed by
+    Craft Metrics (https://craftmetrics.ca/).
+
+    MIT License
+    Copyright (c) 2018 Craft Metrics
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#include "mcp342x_sim.h"
+
+#include <gtest/gtest.h>
+
+/**
+ * Each poll reads only the data bytes of the resolution and the config byte
+ */
+static const uint8_t ADDRESS = MCP342X_A0GND_A1GND;
+
+class ReadBytesTest : public ::testing::TestWithParam<mcp342x_sample_rate_t>
+{
+protected:
+    smbus_info_t smbus_info;
+    mcp342x_info_t info;
+
+    void SetUp() override
+    {
+        mcp342x_sim_reset();
+        mcp342x_sim_add_device(ADDRESS, 4, true);
+        mcp342x_sim_set_input(ADDRESS, 0, -300000000);
+        smbus_init(&this->smbus_info, 0, ADDRESS);
+        this->info = {};
+        mcp342x_set_bus(&this->info, &mcp342x_sim_bus);
+        mcp342x_set_wait_mode(&this->info, MCP342X_WAIT_POLL);
+        mcp342x_config_t config = {MCP342X_CHANNEL_1, MCP342X_MODE_ONESHOT, GetParam(), MCP342X_GAIN_1X};
+        ASSERT_EQ(ESP_OK, mcp342x_init(&this->info, &this->smbus_info, config));
+    }
+
+    static uint32_t ExpectedBytes(void)
+    {
+        // Address byte, data bytes, config byte
+        return GetParam() == MCP342X_SRATE_18BIT ? 5 : 4;
+    }
+};
+
+TEST_P(ReadBytesTest, BytesPerPoll)
+{
+    mcp342x_reset_stats(&this->info);
+    mcp342x_sim_reset_stats();
+    int32_t code;
+    for (int i = 0; i < 3; i++)
+    {
+        ASSERT_EQ(ESP_OK, mcp342x_start_new_conversion(&this->info));
+        ASSERT_EQ(MCP342X_STATUS_OK, mcp342x_read_raw(&this->info, &code));
+    }
+
+    /**
+     * Polls that find the conversion still running cost the same as the final one
+     */
+    mcp342x_stats_t stats;
+    mcp342x_get_stats(&this->info, &stats);
+    ASSERT_GE(stats.polls, 3U);
+    EXPECT_EQ(ExpectedBytes() * stats.polls, stats.bytes_read);
+
+    mcp342x_sim_stats_t sim;
+    mcp342x_sim_get_stats(&sim);
+    EXPECT_EQ(stats.polls, sim.reads);
+    EXPECT_EQ(stats.bytes_read + stats.bytes_written, sim.bytes);
+}
+
+TEST_P(ReadBytesTest, ShortReadStillDecodes)
+{
+    int32_t code;
+    ASSERT_EQ(ESP_OK, mcp342x_start_new_conversion(&this->info));
+    ASSERT_EQ(MCP342X_STATUS_OK, mcp342x_read_raw(&this->info, &code));
+    int bits = 12 + 2 * (GetParam() >> 2);
+    EXPECT_EQ(-(300 << (bits - 12)), code);
+    EXPECT_EQ(MCP342X_MODE_ONESHOT | GetParam() | MCP342X_GAIN_1X, this->info.result_config);
+}
+
+INSTANTIATE_TEST_SUITE_P(Rates, ReadBytesTest,
+                         ::testing::Values(MCP342X_SRATE_12BIT, MCP342X_SRATE_14BIT, MCP342X_SRATE_16BIT, MCP342X_SRATE_18BIT));
@@ -0,0 +1,185 @@
+/*
+    Craft Metrics
+
+    This product includes software developed by
+    Craft Metrics (https://craftmetrics.ca/).
+
+    MIT License
+    Copyright (c) 2018 Craft Metrics
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#include "mcp342x_sim.h"
+
+#include <gtest/gtest.h>
+#include <esp_timer.h>
+
+/**
+ * Bounded retries and error recovery under injected bus faults
+ */
+static const uint8_t ADDRESS_A = MCP342X_A0GND_A1GND;
+static const uint8_t ADDRESS_B = MCP342X_A0GND_A1FLT;
+
+class RecoveryTest : public ::testing::Test
+{
+protected:
+    smbus_info_t smbus_a;
+    smbus_info_t smbus_b;
+    mcp342x_info_t a;
+    mcp342x_info_t b;
+
+    void SetUp() override
+    {
+        mcp342x_sim_reset();
+        mcp342x_sim_add_device(ADDRESS_A, 4, true);
+        mcp342x_sim_add_device(ADDRESS_B, 4, true);
+        mcp342x_sim_set_input(ADDRESS_A, 0, 100000000);
+        mcp342x_sim_set_input(ADDRESS_B, 0, 200000000);
+        smbus_init(&this->smbus_a, 0, ADDRESS_A);
+        smbus_init(&this->smbus_b, 0, ADDRESS_B);
+        this->a = {};
+        this->b = {};
+        mcp342x_set_bus(&this->a, &mcp342x_sim_bus);
+        mcp342x_set_bus(&this->b, &mcp342x_sim_bus);
+        mcp342x_config_t config_a = {MCP342X_CHANNEL_1, MCP342X_MODE_ONESHOT, MCP342X_SRATE_12BIT, MCP342X_GAIN_1X};
+        mcp342x_config_t config_b = {MCP342X_CHANNEL_1, MCP342X_MODE_CONTINUOUS, MCP342X_SRATE_14BIT, MCP342X_GAIN_4X};
+        ASSERT_EQ(ESP_OK, mcp342x_init(&this->a, &this->smbus_a, config_a));
+        ASSERT_EQ(ESP_OK, mcp342x_init(&this->b, &this->smbus_b, config_b));
+    }
+
+    mcp342x_conversion_status_t ReadA(int32_t *code)
+    {
+        if (mcp342x_start_new_conversion(&this->a) != ESP_OK)
+        {
+            return MCP342X_STATUS_I2C;
+        }
+        return mcp342x_read_raw(&this->a, code);
+    }
+};
+
+TEST_F(RecoveryTest, RetriesRideOutTransientFaults)
+{
+    mcp342x_set_recovery(&this->a, 3, 100, 0);
+    mcp342x_sim_fail(ADDRESS_A, 2);
+    int32_t code;
+    EXPECT_EQ(MCP342X_STATUS_OK, this->ReadA(&code));
+    EXPECT_EQ(100, code);
+    EXPECT_EQ(2U, this->a.stats.retries);
+    EXPECT_EQ(0U, this->a.stats.i2c_errors);
+}
+
+TEST_F(RecoveryTest, BackoffStopsDoublingAtMax)
+{
+    /**
+     * 60 ms, then 100 ms twice instead of 120 ms and 240 ms
+     */
+    mcp342x_set_recovery(&this->a, 3, 60000, 0);
+    mcp342x_sim_fail(ADDRESS_A, 3);
+    int64_t start_us = esp_timer_get_time();
+    ASSERT_EQ(ESP_OK, mcp342x_start_new_conversion(&this->a));
+    int64_t elapsed_us = esp_timer_get_time() - start_us;
+    EXPECT_EQ(3U, this->a.stats.retries);
+    EXPECT_GE(elapsed_us, 60000 + 2 * MCP342X_RECOVERY_BACKOFF_MAX_US);
+    EXPECT_LT(elapsed_us, 60000 + 120000 + 240000);
+}
+
+TEST_F(RecoveryTest, BudgetOverrunResendsConfig)
+{
+    mcp342x_set_recovery(&this->a, 0, 0, 2);
+    mcp342x_sim_fail(ADDRESS_A, 3);
+    int32_t code;
+    for (int i = 0; i < 3; i++)
+    {
+        EXPECT_EQ(MCP342X_STATUS_I2C, this->ReadA(&code));
+    }
+    EXPECT_EQ(1U, this->a.stats.recoveries);
+    EXPECT_FALSE(this->a.degraded);
+    EXPECT_EQ(MCP342X_STATUS_OK, this->ReadA(&code));
+}
+
+TEST_F(RecoveryTest, RecoveryLeavesOtherDevicesAlone)
+{
+    mcp342x_set_recovery(&this->a, 1, 100, 1);
+    mcp342x_sim_reset_stats();
+    uint32_t b_conversions = mcp342x_sim_conversions(ADDRESS_B);
+
+    mcp342x_sim_fail(ADDRESS_A, 4);
+    int32_t code;
+    EXPECT_EQ(MCP342X_STATUS_I2C, this->ReadA(&code));
+    EXPECT_EQ(MCP342X_STATUS_I2C, this->ReadA(&code));
+    EXPECT_EQ(1U, this->a.stats.recoveries);
+    EXPECT_FALSE(this->a.degraded);
+
+    /**
+     * No general call went out, so B still holds its config and keeps converting
+     */
+    mcp342x_sim_stats_t stats;
+    mcp342x_sim_get_stats(&stats);
+    EXPECT_EQ(0U, stats.general_calls);
+    EXPECT_EQ(MCP342X_MODE_CONTINUOUS | MCP342X_SRATE_14BIT | MCP342X_GAIN_4X,
+              mcp342x_sim_config(ADDRESS_B) & ~MCP342X_CNTRL_MASK);
+    EXPECT_GT(mcp342x_sim_conversions(ADDRESS_B), b_conversions);
+
+    /**
+     * B's shadow is still right: the skipped trigger leaves continuous conversions
+     * running, and the result carries B's gain
+     */
+    ASSERT_EQ(ESP_OK, mcp342x_start_new_conversion(&this->b));
+    EXPECT_EQ(1U, this->b.stats.writes_skipped);
+    EXPECT_EQ(MCP342X_STATUS_OK, mcp342x_read_raw(&this->b, &code));
+    EXPECT_EQ(MCP342X_GAIN_4X, this->b.result_config & MCP342X_GAIN_MASK);
+    EXPECT_EQ(800 * 4, code);
+}
+
+TEST_F(RecoveryTest, DeadDeviceDegradesUntilRecovered)
+{
+    mcp342x_set_recovery(&this->a, 1, 100, 1);
+    mcp342x_sim_fail(ADDRESS_A, MCP342X_SIM_FOREVER);
+    int32_t code;
+    EXPECT_EQ(MCP342X_STATUS_I2C, this->ReadA(&code));
+    EXPECT_EQ(MCP342X_STATUS_I2C, this->ReadA(&code));
+    EXPECT_TRUE(this->a.degraded);
+
+    /**
+     * Degraded devices fail without touching the bus
+     */
+    mcp342x_sim_reset_stats();
+    EXPECT_EQ(MCP342X_STATUS_I2C, this->ReadA(&code));
+    mcp342x_sim_stats_t stats;
+    mcp342x_sim_get_stats(&stats);
+    EXPECT_EQ(0U, stats.transactions);
+
+    mcp342x_sim_fail(ADDRESS_A, 0);
+    EXPECT_EQ(ESP_OK, mcp342x_recover(&this->a));
+    EXPECT_FALSE(this->a.degraded);
+    EXPECT_EQ(MCP342X_STATUS_OK, this->ReadA(&code));
+}
+
+TEST_F(RecoveryTest, ExplicitResetNeedsInvalidatedShadows)
+{
+    ASSERT_EQ(ESP_OK, mcp342x_general_call(&this->a, MCP342X_GC_RESET));
+    EXPECT_FALSE(this->a.shadow_valid);
+    EXPECT_EQ(0x90, mcp342x_sim_config(ADDRESS_B));
+
+    mcp342x_invalidate_config(&this->b);
+    ASSERT_EQ(ESP_OK, mcp342x_start_new_conversion(&this->b));
+    EXPECT_EQ(MCP342X_MODE_CONTINUOUS | MCP342X_SRATE_14BIT | MCP342X_GAIN_4X,
+              mcp342x_sim_config(ADDRESS_B) & ~MCP342X_CNTRL_MASK);
+}
@@ -0,0 +1,183 @@
+/*
+    Craft Metrics
+
+    This product includes software developed by
+    Craft Metrics (https://craftmetrics.ca/).
+
+    MIT License
+    Copyright (c) 2018 Craft Metrics
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#include "mcp342x_scheduler.h"
+#include "mcp342x_sim.h"
+
+#include <gtest/gtest.h>
+#include <esp_timer.h>
+
+/**
+ * Scheduler throughput and bus utilisation on the simulated bus, and
+ * Collect returning when devices stop answering
+ */
+static const mcp342x_address_t ADDRESSES[] = {MCP342X_A0GND_A1GND, MCP342X_A0GND_A1FLT, MCP342X_A0GND_A1VCC, MCP342X_A0FLT_A1GND};
+static const size_t DEVICES = sizeof(ADDRESSES) / sizeof(ADDRESSES[0]);
+
+class SchedulerTest : public ::testing::Test
+{
+protected:
+    cm::MCP342x devices[DEVICES] = {cm::MCP342x(ADDRESSES[0]), cm::MCP342x(ADDRESSES[1]),
+                                    cm::MCP342x(ADDRESSES[2]), cm::MCP342x(ADDRESSES[3])};
+
+    void SetUp() override
+    {
+        mcp342x_sim_reset();
+        mcp342x_sim_set_clock(400000, true);
+        mcp342x_config_t config = {MCP342X_CHANNEL_1, MCP342X_MODE_ONESHOT, MCP342X_SRATE_12BIT, MCP342X_GAIN_1X};
+        for (size_t i = 0; i < DEVICES; i++)
+        {
+            mcp342x_sim_add_device(ADDRESSES[i], 4, true);
+            mcp342x_sim_set_input(ADDRESSES[i], 0, 100000000 * (i + 1));
+            mcp342x_sim_set_input(ADDRESSES[i], 1, -100000000 * (i + 1));
+            ASSERT_EQ(ESP_OK, this->devices[i].Init(0, config));
+        }
+        mcp342x_sim_reset_stats();
+    }
+};
+
+TEST_F(SchedulerTest, PipelinesDevicesOnOneBus)
+{
+    const size_t samples_wanted = 160;
+    mcp342x_sample_t samples[16];
+
+    /**
+     * Baseline: one device read sample by sample
+     */
+    int64_t start_us = esp_timer_get_time();
+    for (size_t i = 0; i < samples_wanted / 4; i++)
+    {
+        ASSERT_EQ(ESP_OK, this->devices[0].StartNewConversion(MCP342X_CHANNEL_1));
+        ASSERT_EQ(MCP342X_STATUS_OK, this->devices[0].ReadSample(&samples[0]));
+    }
+    double sequential_sps = (samples_wanted / 4) * 1e6 / (esp_timer_get_time() - start_us);
+
+    cm::MCP342xScheduler scheduler;
+    for (size_t i = 0; i < DEVICES; i++)
+    {
+        ASSERT_EQ(ESP_OK, scheduler.AddDevice(&this->devices[i], 0x03));
+    }
+    mcp342x_sim_reset_stats();
+    start_us = esp_timer_get_time();
+    ASSERT_EQ(ESP_OK, scheduler.Start());
+    size_t collected = 0;
+    while (collected < samples_wanted)
+    {
+        size_t n = scheduler.Collect(samples, 16);
+        for (size_t i = 0; i < n; i++)
+        {
+            ASSERT_EQ(MCP342X_STATUS_OK, samples[i].status);
+            int32_t expected = 100 * (samples[i].device + 1);
+            EXPECT_EQ((samples[i].config & MCP342X_CHANNEL_MASK) ? -expected : expected, samples[i].code);
+        }
+        collected += n;
+    }
+    int64_t elapsed_us = esp_timer_get_time() - start_us;
+    double scheduled_sps = collected * 1e6 / elapsed_us;
+
+    mcp342x_sim_stats_t stats;
+    mcp342x_sim_get_stats(&stats);
+    double utilisation = (double)stats.busy_us / elapsed_us;
+    printf("sequential %.0f samples/s, scheduled %.0f samples/s, %.1f bus bytes/sample, bus %.1f %% busy\n",
+           sequential_sps, scheduled_sps, (double)stats.bytes / collected, utilisation * 100);
+    RecordProperty("samples_per_second", (int)scheduled_sps);
+
+    EXPECT_GT(scheduled_sps, 2.5 * sequential_sps);
+    EXPECT_LT(utilisation, 0.2);
+    EXPECT_LE(stats.reads, collected + collected / 4);
+}
+
+TEST_F(SchedulerTest, DeadBusStillReturns)
+{
+    cm::MCP342xScheduler scheduler;
+    for (size_t i = 0; i < DEVICES; i++)
+    {
+        ASSERT_EQ(ESP_OK, scheduler.AddDevice(&this->devices[i], 0x0F));
+        mcp342x_sim_fail(ADDRESSES[i], MCP342X_SIM_FOREVER);
+    }
+    EXPECT_NE(ESP_OK, scheduler.Start());
+
+    mcp342x_sample_t samples[8];
+    int64_t start_us = esp_timer_get_time();
+    ASSERT_EQ(8U, scheduler.Collect(samples, 8));
+    EXPECT_LT(esp_timer_get_time() - start_us, 100000);
+    for (const mcp342x_sample_t &sample : samples)
+    {
+        EXPECT_EQ(MCP342X_STATUS_I2C, sample.status);
+    }
+}
+
+TEST_F(SchedulerTest, DeadDeviceDoesNotStallTheOthers)
+{
+    cm::MCP342xScheduler scheduler;
+    for (size_t i = 0; i < DEVICES; i++)
+    {
+        ASSERT_EQ(ESP_OK, scheduler.AddDevice(&this->devices[i], 0x01));
+    }
+    ASSERT_EQ(ESP_OK, scheduler.Start());
+    mcp342x_sim_fail(ADDRESSES[2], MCP342X_SIM_FOREVER);
+
+    mcp342x_sample_t samples[32];
+    ASSERT_EQ(32U, scheduler.Collect(samples, 32));
+    size_t ok[DEVICES] = {};
+    for (const mcp342x_sample_t &sample : samples)
+    {
+        if (sample.status == MCP342X_STATUS_OK)
+        {
+            ok[sample.device]++;
+        }
+        else
+        {
+            EXPECT_EQ(2, sample.device);
+            EXPECT_EQ(MCP342X_STATUS_I2C, sample.status);
+        }
+    }
+    EXPECT_GE(ok[0], 6U);
+    EXPECT_LE(ok[2], 1U);
+}
+
+TEST_F(SchedulerTest, LateResultsTimeOut)
+{
+    cm::MCP342xScheduler scheduler;
+    ASSERT_EQ(ESP_OK, scheduler.AddDevice(&this->devices[0], 0x01));
+
+    /**
+     * 2 s conversions, so a stalled host never sees one finish before the timeout
+     */
+    mcp342x_sim_set_timing(ADDRESSES[0], 50000);
+    ASSERT_EQ(ESP_OK, scheduler.Start());
+
+    mcp342x_sample_t samples[2];
+    ASSERT_EQ(2U, scheduler.Collect(samples, 2));
+    EXPECT_EQ(MCP342X_STATUS_TIMEOUT, samples[0].status);
+    EXPECT_EQ(MCP342X_STATUS_TIMEOUT, samples[1].status);
+
+    mcp342x_stats_t stats;
+    this->devices[0].GetStats(&stats);
+    EXPECT_EQ(2U, stats.timeouts);
+}
@@ -0,0 +1,142 @@
+/*
+    Craft Metrics
+
+    This product includes software developed by
+    Craft Metrics (https://craftmetrics.ca/).
+
+    MIT License
+    Copyright (c) 2018 Craft Metrics
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#include "mcp342x_sim.h"
+
+#include <gtest/gtest.h>
+
+/**
+ * Shadow config tracking: config writes per scan on the simulated bus
+ */
+static const mcp342x_address_t ADDRESS = MCP342X_A0GND_A1GND;
+
+class ShadowTest : public ::testing::Test
+{
+protected:
+    cm::MCP342x device = cm::MCP342x(ADDRESS);
+
+    void SetUp() override
+    {
+        mcp342x_sim_reset();
+        mcp342x_sim_add_device(ADDRESS, 4, true);
+        for (uint8_t channel = 0; channel < 4; channel++)
+        {
+            mcp342x_sim_set_input(ADDRESS, channel, 10000000 * (channel + 1));
+        }
+    }
+
+    void Init(mcp342x_conversion_mode_t mode)
+    {
+        mcp342x_config_t config = {MCP342X_CHANNEL_1, mode, MCP342X_SRATE_12BIT, MCP342X_GAIN_1X};
+        ASSERT_EQ(ESP_OK, this->device.Init(0, config));
+        mcp342x_sim_reset_stats();
+    }
+
+    uint32_t Writes(void)
+    {
+        mcp342x_sim_stats_t stats;
+        mcp342x_sim_get_stats(&stats);
+        return stats.writes;
+    }
+};
+
+TEST_F(ShadowTest, ContinuousSameChannelNeedsNoWrites)
+{
+    this->Init(MCP342X_MODE_CONTINUOUS);
+    for (int i = 0; i < 20; i++)
+    {
+        mcp342x_sample_t sample;
+        ASSERT_EQ(ESP_OK, this->device.StartNewConversion(MCP342X_CHANNEL_1));
+        ASSERT_EQ(MCP342X_STATUS_OK, this->device.ReadSample(&sample));
+        EXPECT_EQ(10, sample.code);
+    }
+    EXPECT_EQ(0U, this->Writes());
+    EXPECT_EQ(20U, this->device.GetInfoPtr()->stats.writes_skipped);
+
+    /**
+     * Without the shadow every trigger goes out
+     */
+    for (int i = 0; i < 20; i++)
+    {
+        mcp342x_sample_t sample;
+        mcp342x_invalidate_config(this->device.GetInfoPtr());
+        ASSERT_EQ(ESP_OK, this->device.StartNewConversion(MCP342X_CHANNEL_1));
+        ASSERT_EQ(MCP342X_STATUS_OK, this->device.ReadSample(&sample));
+    }
+    EXPECT_EQ(20U, this->Writes());
+}
+
+TEST_F(ShadowTest, ScanWritesOncePerChannel)
+{
+    this->Init(MCP342X_MODE_ONESHOT);
+    this->device.SetAutoRange(MCP342X_CHANNEL_1, true);
+    mcp342x_sample_t samples[4];
+    const int scans = 3 * MCP342X_AUTORANGE_HOLD + 1;
+    for (int i = 0; i < scans; i++)
+    {
+        ASSERT_EQ(ESP_OK, this->device.ScanChannels(0x0F, samples));
+        for (uint8_t channel = 1; channel < 4; channel++)
+        {
+            EXPECT_EQ(10 * (channel + 1), samples[channel].code);
+        }
+    }
+
+    /**
+     * The gain steps of channel 1 ride on its trigger writes
+     */
+    EXPECT_EQ(MCP342X_GAIN_8X, samples[0].config & MCP342X_GAIN_MASK);
+    EXPECT_EQ(4U * scans, this->Writes());
+}
+
+TEST_F(ShadowTest, UnchangedConfigIsNotRewritten)
+{
+    this->Init(MCP342X_MODE_ONESHOT);
+    ASSERT_EQ(ESP_OK, mcp342x_write_config(this->device.GetInfoPtr()));
+    ASSERT_EQ(ESP_OK, mcp342x_write_config(this->device.GetInfoPtr()));
+    EXPECT_EQ(0U, this->Writes());
+
+    mcp342x_config_t config = {MCP342X_CHANNEL_2, MCP342X_MODE_ONESHOT, MCP342X_SRATE_14BIT, MCP342X_GAIN_2X};
+    mcp342x_set_config(this->device.GetInfoPtr(), config);
+    ASSERT_EQ(ESP_OK, mcp342x_write_config(this->device.GetInfoPtr()));
+    ASSERT_EQ(ESP_OK, mcp342x_write_config(this->device.GetInfoPtr()));
+    EXPECT_EQ(1U, this->Writes());
+    EXPECT_EQ(MCP342X_CHANNEL_2 | MCP342X_SRATE_14BIT | MCP342X_GAIN_2X, mcp342x_sim_config(ADDRESS) & ~MCP342X_CNTRL_MASK);
+}
+
+TEST_F(ShadowTest, InvalidBitsAreMasked)
+{
+    this->Init(MCP342X_MODE_ONESHOT);
+
+    /**
+     * Stray bits within the range of each enum, anything wider is undefined before it is masked
+     */
+    mcp342x_config_t config = {(mcp342x_channel_t)0x7F, (mcp342x_conversion_mode_t)0x0F,
+                               (mcp342x_sample_rate_t)0x07, MCP342X_GAIN_4X};
+    mcp342x_set_config(this->device.GetInfoPtr(), config);
+    EXPECT_EQ(MCP342X_CHANNEL_4 | MCP342X_SRATE_14BIT | MCP342X_GAIN_4X, this->device.GetInfoPtr()->config);
+}
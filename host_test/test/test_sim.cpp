@@ -0,0 +1,231 @@
+/*
+    Craft Metrics
+
+    This product includes software developed by
+    Craft Metrics (https://craftmetrics.ca/).
+
+    MIT License
+    Copyright (c) 2018 Craft Metrics
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#include "mcp342x_sim.h"
+
+#include <gtest/gtest.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+/**
+ * Checks of the simulator itself, so the driver tests built on it measure the driver
+ */
+static const uint8_t ADDRESS = MCP342X_A0GND_A1GND;
+
+class SimTest : public ::testing::Test
+{
+protected:
+    smbus_info_t smbus_info;
+
+    void SetUp() override
+    {
+        mcp342x_sim_reset();
+        smbus_init(&this->smbus_info, 0, ADDRESS);
+    }
+
+    void TearDown() override
+    {
+        mcp342x_sim_set_time_scale(1);
+    }
+
+    void Write(uint8_t config)
+    {
+        ASSERT_EQ(ESP_OK, mcp342x_sim_bus.write(NULL, &this->smbus_info, &config, 1));
+    }
+
+    void Read(uint8_t *data, size_t len)
+    {
+        ASSERT_EQ(ESP_OK, mcp342x_sim_bus.read(NULL, &this->smbus_info, data, len));
+    }
+};
+
+TEST_F(SimTest, PowersUpContinuousTwelveBit)
+{
+    mcp342x_sim_add_device(ADDRESS, 4, true);
+    EXPECT_EQ(0x90, mcp342x_sim_config(ADDRESS));
+}
+
+TEST_F(SimTest, ConversionTimeFollowsResolution)
+{
+    /**
+     * Ten times slower, so a host stall while polling stays within the 5 ms bound
+     */
+    mcp342x_sim_set_time_scale(10);
+    mcp342x_sim_add_device(ADDRESS, 4, true);
+    static const mcp342x_sample_rate_t rates[] = {MCP342X_SRATE_12BIT, MCP342X_SRATE_14BIT, MCP342X_SRATE_16BIT, MCP342X_SRATE_18BIT};
+    for (mcp342x_sample_rate_t rate : rates)
+    {
+        uint8_t buffer[4];
+        int64_t start_us = esp_timer_get_time();
+        this->Write(MCP342X_CNTRL_TRIGGER_CONVERSION | MCP342X_MODE_ONESHOT | rate);
+        do
+        {
+            this->Read(buffer, sizeof(buffer));
+        } while (buffer[3] & MCP342X_CNTRL_MASK);
+        int64_t elapsed_us = esp_timer_get_time() - start_us;
+        EXPECT_GE(elapsed_us, mcp342x_conversion_time_us(rate)) << "rate " << rate;
+        EXPECT_LT(elapsed_us, mcp342x_conversion_time_us(rate) + 5000) << "rate " << rate;
+    }
+}
+
+TEST_F(SimTest, ReadyBitClearsOnReadAndSetsOnTrigger)
+{
+    mcp342x_sim_add_device(ADDRESS, 4, true);
+    mcp342x_sim_set_timing(ADDRESS, 0);
+    uint8_t buffer[3];
+
+    this->Write(MCP342X_CNTRL_TRIGGER_CONVERSION | MCP342X_MODE_ONESHOT);
+    this->Read(buffer, sizeof(buffer));
+    EXPECT_EQ(MCP342X_CNTRL_RESULT_UPDATED, buffer[2] & MCP342X_CNTRL_MASK);
+    this->Read(buffer, sizeof(buffer));
+    EXPECT_EQ(MCP342X_CNTRL_RESULT_NOT_UPDATED, buffer[2] & MCP342X_CNTRL_MASK);
+
+    mcp342x_sim_set_timing(ADDRESS, 100);
+    this->Write(MCP342X_CNTRL_TRIGGER_CONVERSION | MCP342X_MODE_ONESHOT);
+    this->Read(buffer, sizeof(buffer));
+    EXPECT_EQ(MCP342X_CNTRL_RESULT_NOT_UPDATED, buffer[2] & MCP342X_CNTRL_MASK);
+}
+
+TEST_F(SimTest, OneShotConvertsOnceContinuousKeepsGoing)
+{
+    mcp342x_sim_add_device(ADDRESS, 4, true);
+    this->Write(MCP342X_CNTRL_TRIGGER_CONVERSION | MCP342X_MODE_ONESHOT);
+    uint32_t before = mcp342x_sim_conversions(ADDRESS);
+    vTaskDelay(5);
+    EXPECT_EQ(before + 1, mcp342x_sim_conversions(ADDRESS));
+
+    this->Write(MCP342X_MODE_CONTINUOUS);
+    before = mcp342x_sim_conversions(ADDRESS);
+    vTaskDelay(5);
+    EXPECT_GE(mcp342x_sim_conversions(ADDRESS), before + 8);
+}
+
+TEST_F(SimTest, GeneralCallsReachEveryDevice)
+{
+    mcp342x_sim_add_device(ADDRESS, 4, true);
+    mcp342x_sim_add_device(ADDRESS + 1, 2, false);
+    smbus_info_t other = this->smbus_info;
+    other.address = ADDRESS + 1;
+    uint8_t config = MCP342X_MODE_ONESHOT | MCP342X_SRATE_16BIT | MCP342X_GAIN_4X;
+    ASSERT_EQ(ESP_OK, mcp342x_sim_bus.write(NULL, &this->smbus_info, &config, 1));
+    ASSERT_EQ(ESP_OK, mcp342x_sim_bus.write(NULL, &other, &config, 1));
+
+    smbus_info_t general_call = this->smbus_info;
+    general_call.address = MCP342X_GC_START;
+    uint8_t command = MCP342X_GC_CONVERSION;
+    uint32_t before = mcp342x_sim_conversions(ADDRESS + 1);
+    ASSERT_EQ(ESP_OK, mcp342x_sim_bus.write(NULL, &general_call, &command, 1));
+    vTaskDelay(pdMS_TO_TICKS(80));
+    EXPECT_EQ(before + 1, mcp342x_sim_conversions(ADDRESS + 1));
+
+    command = MCP342X_GC_RESET;
+    ASSERT_EQ(ESP_OK, mcp342x_sim_bus.write(NULL, &general_call, &command, 1));
+    EXPECT_EQ(0x90, mcp342x_sim_config(ADDRESS));
+    EXPECT_EQ(0x90, mcp342x_sim_config(ADDRESS + 1));
+
+    mcp342x_sim_stats_t stats;
+    mcp342x_sim_get_stats(&stats);
+    EXPECT_EQ(2U, stats.general_calls);
+}
+
+TEST_F(SimTest, ChannelsConvertTheirOwnInputs)
+{
+    mcp342x_sim_add_device(ADDRESS, 4, true);
+    mcp342x_sim_add_device(ADDRESS + 1, 2, true);
+    static const int32_t inputs_nv[] = {500000000, -250000000, 1000000000, 1000000};
+    for (uint8_t channel = 0; channel < 4; channel++)
+    {
+        mcp342x_sim_set_input(ADDRESS, channel, inputs_nv[channel]);
+        mcp342x_sim_set_input(ADDRESS + 1, channel, inputs_nv[channel]);
+    }
+
+    /**
+     * Through the driver and the default i2c command link backend
+     */
+    mcp342x_info_t info = {};
+    mcp342x_config_t config = {MCP342X_CHANNEL_1, MCP342X_MODE_ONESHOT, MCP342X_SRATE_16BIT, MCP342X_GAIN_1X};
+    for (uint8_t address = ADDRESS; address <= ADDRESS + 1; address++)
+    {
+        this->smbus_info.address = address;
+        for (uint8_t channel = 0; channel < 4; channel++)
+        {
+            config.channel = (mcp342x_channel_t)(channel << 5);
+            ASSERT_EQ(ESP_OK, mcp342x_init(&info, &this->smbus_info, config));
+            ASSERT_EQ(ESP_OK, mcp342x_start_new_conversion(&info));
+            int32_t nanovolts = 0;
+            ASSERT_EQ(MCP342X_STATUS_OK, mcp342x_read_nanovolts(&info, &nanovolts));
+            uint8_t input = (address == ADDRESS) ? channel : (channel & 1);
+            EXPECT_NEAR(inputs_nv[input], nanovolts, 62500) << "address " << (int)address << " channel " << (int)channel;
+        }
+    }
+}
+
+TEST_F(SimTest, OutputLayoutFollowsResolution)
+{
+    mcp342x_sim_add_device(ADDRESS, 1, true);
+    mcp342x_sim_add_device(ADDRESS + 1, 1, false);
+    mcp342x_sim_force_code(ADDRESS, true, -2);
+    mcp342x_sim_force_code(ADDRESS + 1, true, -2);
+    mcp342x_sim_set_timing(ADDRESS, 0);
+    mcp342x_sim_set_timing(ADDRESS + 1, 0);
+    uint8_t config = MCP342X_CNTRL_TRIGGER_CONVERSION | MCP342X_MODE_ONESHOT | MCP342X_SRATE_18BIT;
+    uint8_t buffer[4];
+
+    this->Write(config);
+    this->Read(buffer, sizeof(buffer));
+    EXPECT_EQ(0xFF, buffer[0]);
+    EXPECT_EQ(0xFF, buffer[1]);
+    EXPECT_EQ(0xFE, buffer[2]);
+    EXPECT_EQ(MCP342X_SRATE_18BIT, buffer[3] & MCP342X_SRATE_MASK);
+
+    this->smbus_info.address = ADDRESS + 1;
+    this->Write(config);
+    this->Read(buffer, sizeof(buffer));
+    EXPECT_EQ(0xFF, buffer[0]);
+    EXPECT_EQ(0xFE, buffer[1]);
+    EXPECT_EQ(buffer[2], buffer[3]);
+}
+
+TEST_F(SimTest, FaultsAreNacked)
+{
+    mcp342x_sim_add_device(ADDRESS, 4, true);
+    mcp342x_sim_fail(ADDRESS, 2);
+    uint8_t config = MCP342X_MODE_CONTINUOUS;
+    EXPECT_EQ(ESP_FAIL, mcp342x_sim_bus.write(NULL, &this->smbus_info, &config, 1));
+    EXPECT_EQ(ESP_FAIL, mcp342x_sim_bus.write(NULL, &this->smbus_info, &config, 1));
+    EXPECT_EQ(ESP_OK, mcp342x_sim_bus.write(NULL, &this->smbus_info, &config, 1));
+
+    this->smbus_info.address = ADDRESS + 1;
+    EXPECT_EQ(ESP_FAIL, mcp342x_sim_bus.write(NULL, &this->smbus_info, &config, 1));
+
+    mcp342x_sim_stats_t stats;
+    mcp342x_sim_get_stats(&stats);
+    EXPECT_EQ(3U, stats.nacks);
+    EXPECT_EQ(4U, stats.transactions);
+}
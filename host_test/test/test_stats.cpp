@@ -0,0 +1,125 @@
+/*
+    Craft Metrics
+
+    This product includes software developed by
+    Craft Metrics (https://craftmetrics.ca/).
+
+    MIT License
+    Copyright (c) 2018 Craft Metrics
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#include "mcp342x_sim.h"
+
+#include <gtest/gtest.h>
+
+/**
+ * Latency statistics against the documented histogram buckets
+ */
+static const uint8_t ADDRESS = MCP342X_A0GND_A1GND;
+
+static uint8_t _bucket(uint32_t latency_us)
+{
+    uint8_t bucket = 0;
+    while (bucket < MCP342X_LATENCY_BUCKETS - 1 && latency_us >= ((uint32_t)MCP342X_LATENCY_UNIT_US << bucket))
+    {
+        bucket++;
+    }
+    return bucket;
+}
+
+class StatsTest : public ::testing::Test
+{
+protected:
+    smbus_info_t smbus_info;
+    mcp342x_info_t info;
+
+    void SetUp() override
+    {
+        mcp342x_sim_reset();
+        mcp342x_sim_add_device(ADDRESS, 4, true);
+        smbus_init(&this->smbus_info, 0, ADDRESS);
+        this->info = {};
+        mcp342x_set_bus(&this->info, &mcp342x_sim_bus);
+    }
+
+    void Read(mcp342x_sample_rate_t rate, int samples)
+    {
+        mcp342x_config_t config = {MCP342X_CHANNEL_1, MCP342X_MODE_ONESHOT, rate, MCP342X_GAIN_1X};
+        ASSERT_EQ(ESP_OK, mcp342x_init(&this->info, &this->smbus_info, config));
+        mcp342x_reset_stats(&this->info);
+        for (int i = 0; i < samples; i++)
+        {
+            int32_t code;
+            ASSERT_EQ(ESP_OK, mcp342x_start_new_conversion(&this->info));
+            ASSERT_EQ(MCP342X_STATUS_OK, mcp342x_read_raw(&this->info, &code));
+        }
+    }
+};
+
+TEST(StatsBucketTest, BucketEdges)
+{
+    EXPECT_EQ(0, _bucket(0));
+    EXPECT_EQ(0, _bucket(MCP342X_LATENCY_UNIT_US - 1));
+    EXPECT_EQ(1, _bucket(MCP342X_LATENCY_UNIT_US));
+    EXPECT_EQ(2, _bucket(2 * MCP342X_LATENCY_UNIT_US));
+    EXPECT_EQ(MCP342X_LATENCY_BUCKETS - 1, _bucket(UINT32_MAX));
+}
+
+TEST_F(StatsTest, InstantConversionsLandInBucketZero)
+{
+    mcp342x_sim_set_timing(ADDRESS, 0);
+    mcp342x_set_wait_mode(&this->info, MCP342X_WAIT_POLL);
+    this->Read(MCP342X_SRATE_12BIT, 5);
+    mcp342x_stats_t stats;
+    mcp342x_get_stats(&this->info, &stats);
+    ASSERT_LT(stats.latency_max_us, (uint32_t)MCP342X_LATENCY_UNIT_US);
+    EXPECT_EQ(5U, stats.latency_histogram[0]);
+}
+
+TEST_F(StatsTest, HistogramMatchesLatencies)
+{
+    /**
+     * 16-bit conversions take 66.7 ms, 65 units, so they land in bucket 7
+     */
+    this->Read(MCP342X_SRATE_16BIT, 3);
+    mcp342x_stats_t stats;
+    mcp342x_get_stats(&this->info, &stats);
+    EXPECT_EQ(3U, stats.samples);
+    EXPECT_GE(stats.latency_min_us, mcp342x_conversion_time_us(MCP342X_SRATE_16BIT));
+    uint8_t low = _bucket(stats.latency_min_us);
+    uint8_t high = _bucket(stats.latency_max_us);
+    EXPECT_EQ(7, low);
+    uint32_t in_range = 0;
+    for (uint8_t bucket = 0; bucket < MCP342X_LATENCY_BUCKETS; bucket++)
+    {
+        if (bucket >= low && bucket <= high)
+        {
+            in_range += stats.latency_histogram[bucket];
+        }
+        else
+        {
+            EXPECT_EQ(0U, stats.latency_histogram[bucket]) << (int)bucket;
+        }
+    }
+    EXPECT_EQ(3U, in_range);
+    EXPECT_LE(stats.latency_sum_us, 3ULL * stats.latency_max_us);
+    EXPECT_GE(stats.latency_sum_us, 3ULL * stats.latency_min_us);
+}
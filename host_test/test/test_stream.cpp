@@ -0,0 +1,213 @@
+/*
+    Craft Metrics
+
+    This product includes software developed by
+    Craft Metrics (https://craftmetrics.ca/).
+
+    MIT License
+    Copyright (c) 2018 Craft Metrics
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#include "mcp342x_stream.h"
+#include "mcp342x_sim.h"
+
+#include <gtest/gtest.h>
+
+/**
+ * Continuous mode streaming of a ramp, every conversion counts up by one.
+ * Simulated time runs thirty times slower than the host clock, so host scheduling
+ * stalls of up to about 100 ms stay shorter than a 240 samples/s conversion and
+ * every sample can be checked for.
+ */
+static const uint8_t ADDRESS = MCP342X_A0GND_A1GND;
+static const uint32_t TIME_SCALE = 30;
+
+class StreamTest : public ::testing::Test
+{
+protected:
+    cm::MCP342x device{MCP342X_A0GND_A1GND};
+
+    void SetUp() override
+    {
+        mcp342x_sim_set_time_scale(TIME_SCALE);
+        mcp342x_sim_reset();
+        mcp342x_sim_add_device(ADDRESS, 4, true);
+        mcp342x_sim_set_ramp(ADDRESS, true);
+    }
+
+    void TearDown() override
+    {
+        mcp342x_sim_set_time_scale(1);
+    }
+
+    void Init(mcp342x_sample_rate_t rate)
+    {
+        mcp342x_config_t config = {MCP342X_CHANNEL_1, MCP342X_MODE_CONTINUOUS, rate, MCP342X_GAIN_1X};
+        ASSERT_EQ(ESP_OK, this->device.Init(0, config));
+    }
+};
+
+/**
+ * Drain a running stream every 50 ms for 300 ms, counting codes skipped and repeated
+ */
+static void _collect(cm::MCP342xStream *stream, size_t *total, uint32_t *skipped, uint32_t *repeats)
+{
+    mcp342x_sample_t samples[64];
+    int32_t previous = -1;
+    *total = 0;
+    *skipped = 0;
+    *repeats = 0;
+    for (int i = 0; i < 6; i++)
+    {
+        vTaskDelay(pdMS_TO_TICKS(50));
+        size_t n = stream->Drain(samples, 64);
+        for (size_t j = 0; j < n; j++)
+        {
+            if (previous >= 0 && samples[j].code > previous + 1)
+            {
+                *skipped += samples[j].code - previous - 1;
+            }
+            *repeats += (previous >= 0 && samples[j].code <= previous) ? 1 : 0;
+            previous = samples[j].code;
+        }
+        *total += n;
+    }
+}
+
+TEST_F(StreamTest, EverySampleOnceAt240Sps)
+{
+    this->Init(MCP342X_SRATE_12BIT);
+    static mcp342x_sample_t buffer[64];
+    cm::MCP342xStream stream(&this->device, buffer, 64);
+    ASSERT_EQ(ESP_OK, stream.Start(5));
+    size_t total;
+    uint32_t skipped;
+    uint32_t repeats;
+    _collect(&stream, &total, &skipped, &repeats);
+    ASSERT_EQ(ESP_OK, stream.Stop());
+
+    /**
+     * Conversions are 4.2 ms apart, well under the 10 ms tick
+     */
+    EXPECT_EQ(0U, repeats);
+    EXPECT_EQ(0U, skipped);
+    EXPECT_EQ(skipped, stream.GetMissed());
+    EXPECT_EQ(0U, stream.GetOverruns());
+    EXPECT_GE(total, 68U);
+    EXPECT_LE(total, 73U);
+}
+
+TEST_F(StreamTest, NoDropsAt60Sps)
+{
+    this->Init(MCP342X_SRATE_14BIT);
+    static mcp342x_sample_t buffer[64];
+    cm::MCP342xStream stream(&this->device, buffer, 64);
+    ASSERT_EQ(ESP_OK, stream.Start(5));
+    size_t total;
+    uint32_t skipped;
+    uint32_t repeats;
+    _collect(&stream, &total, &skipped, &repeats);
+    ASSERT_EQ(ESP_OK, stream.Stop());
+
+    EXPECT_EQ(0U, repeats);
+    EXPECT_EQ(0U, skipped);
+    EXPECT_EQ(skipped, stream.GetMissed());
+    EXPECT_GE(total, 16U);
+    EXPECT_LE(total, 19U);
+}
+
+TEST_F(StreamTest, FastPartKeepsUp)
+{
+    /**
+     * The datasheet allows 328 samples/s at the 240 samples/s setting
+     */
+    mcp342x_sim_set_timing(ADDRESS, 73);
+    this->Init(MCP342X_SRATE_12BIT);
+    static mcp342x_sample_t buffer[128];
+    cm::MCP342xStream stream(&this->device, buffer, 128);
+    ASSERT_EQ(ESP_OK, stream.Start(5));
+    size_t total;
+    uint32_t skipped;
+    uint32_t repeats;
+    _collect(&stream, &total, &skipped, &repeats);
+    ASSERT_EQ(ESP_OK, stream.Stop());
+
+    EXPECT_EQ(0U, repeats);
+    EXPECT_EQ(0U, skipped);
+    EXPECT_EQ(skipped, stream.GetMissed());
+    EXPECT_GE(total, 92U);
+}
+
+TEST_F(StreamTest, FullBufferCountsOverruns)
+{
+    this->Init(MCP342X_SRATE_12BIT);
+    static mcp342x_sample_t buffer[8];
+    cm::MCP342xStream stream(&this->device, buffer, 8);
+    ASSERT_EQ(ESP_OK, stream.Start(5));
+    vTaskDelay(pdMS_TO_TICKS(200));
+    ASSERT_EQ(ESP_OK, stream.Stop());
+
+    /**
+     * The oldest samples are kept, the rest are counted as dropped
+     */
+    mcp342x_sample_t samples[16];
+    ASSERT_EQ(8U, stream.Drain(samples, 16));
+    for (size_t i = 1; i < 8; i++)
+    {
+        EXPECT_EQ(samples[0].code + (int32_t)i, samples[i].code);
+    }
+    EXPECT_GE(stream.GetOverruns(), 30U);
+}
+
+TEST_F(StreamTest, InvalidCapacityRefusesToStart)
+{
+    this->Init(MCP342X_SRATE_12BIT);
+    static mcp342x_sample_t buffer[12];
+    cm::MCP342xStream stream(&this->device, buffer, 12);
+    EXPECT_EQ(ESP_ERR_INVALID_ARG, stream.Start(5));
+}
+
+TEST_F(StreamTest, StopRestoresOneShotMode)
+{
+    mcp342x_config_t config = {MCP342X_CHANNEL_1, MCP342X_MODE_ONESHOT, MCP342X_SRATE_12BIT, MCP342X_GAIN_1X};
+    ASSERT_EQ(ESP_OK, this->device.Init(0, config));
+    static mcp342x_sample_t buffer[64];
+    cm::MCP342xStream stream(&this->device, buffer, 64);
+    ASSERT_EQ(ESP_OK, stream.Start(5));
+    EXPECT_EQ(MCP342X_MODE_CONTINUOUS, mcp342x_sim_config(ADDRESS) & MCP342X_MODE_MASK);
+    vTaskDelay(pdMS_TO_TICKS(20));
+    ASSERT_EQ(ESP_OK, stream.Stop());
+
+    /**
+     * The device converts once per trigger again
+     */
+    EXPECT_EQ(MCP342X_MODE_ONESHOT, this->device.GetInfoPtr()->config & MCP342X_MODE_MASK);
+    EXPECT_EQ(MCP342X_MODE_ONESHOT, mcp342x_sim_config(ADDRESS) & MCP342X_MODE_MASK);
+    vTaskDelay(pdMS_TO_TICKS(20));
+    uint32_t conversions = mcp342x_sim_conversions(ADDRESS);
+    vTaskDelay(pdMS_TO_TICKS(20));
+    EXPECT_EQ(conversions, mcp342x_sim_conversions(ADDRESS));
+
+    int32_t code;
+    ASSERT_EQ(ESP_OK, this->device.StartNewConversion());
+    ASSERT_EQ(MCP342X_STATUS_OK, this->device.ReadRaw(&code));
+    EXPECT_EQ(conversions + 1, mcp342x_sim_conversions(ADDRESS));
+}
@@ -0,0 +1,141 @@
+/*
+    Craft Metrics
+
+    This product includes software developed by
+    Craft Metrics (https://craftmetrics.ca/).
+
+    MIT License
+    Copyright (c) 2018 Craft Metrics
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#include "mcp342x_sync.h"
+#include "mcp342x_sim.h"
+
+#include <gtest/gtest.h>
+
+/**
+ * Three devices on one bus triggered together by a general call
+ */
+static const mcp342x_address_t ADDRESSES[] = {MCP342X_A0GND_A1GND, MCP342X_A0GND_A1FLT, MCP342X_A0FLT_A1GND};
+static const size_t DEVICES = sizeof(ADDRESSES) / sizeof(ADDRESSES[0]);
+
+class SyncTest : public ::testing::Test
+{
+protected:
+    cm::MCP342x devices[DEVICES] = {cm::MCP342x(ADDRESSES[0]), cm::MCP342x(ADDRESSES[1]), cm::MCP342x(ADDRESSES[2])};
+    cm::MCP342xSyncGroup group;
+
+    void SetUp() override
+    {
+        mcp342x_sim_reset();
+
+        /**
+         * Devices start out in continuous mode, Configure() has to switch them
+         */
+        mcp342x_config_t config = {MCP342X_CHANNEL_1, MCP342X_MODE_CONTINUOUS, MCP342X_SRATE_14BIT, MCP342X_GAIN_1X};
+        for (size_t i = 0; i < DEVICES; i++)
+        {
+            mcp342x_sim_add_device(ADDRESSES[i], 4, true);
+            mcp342x_sim_set_input(ADDRESSES[i], 0, (int32_t)(i + 1) * 100000000);
+            ASSERT_EQ(ESP_OK, this->devices[i].Init(0, config));
+            ASSERT_EQ(ESP_OK, this->group.AddDevice(&this->devices[i]));
+        }
+        ASSERT_EQ(ESP_OK, this->group.Configure());
+    }
+};
+
+TEST_F(SyncTest, ConfigureSelectsOneShotMode)
+{
+    for (size_t i = 0; i < DEVICES; i++)
+    {
+        EXPECT_EQ(MCP342X_MODE_ONESHOT, this->devices[i].GetInfoPtr()->config & MCP342X_MODE_MASK);
+        EXPECT_EQ(MCP342X_MODE_ONESHOT, mcp342x_sim_config(ADDRESSES[i]) & MCP342X_MODE_MASK);
+    }
+}
+
+TEST_F(SyncTest, OneGeneralCallStartsEveryDevice)
+{
+    uint32_t conversions[DEVICES];
+    for (size_t i = 0; i < DEVICES; i++)
+    {
+        conversions[i] = mcp342x_sim_conversions(ADDRESSES[i]);
+    }
+    mcp342x_sim_reset_stats();
+
+    ASSERT_EQ(ESP_OK, this->group.Trigger());
+    mcp342x_sample_t samples[DEVICES];
+    ASSERT_EQ(ESP_OK, this->group.Collect(samples));
+
+    /**
+     * The general call is the only write, each device is read for its result
+     */
+    mcp342x_sim_stats_t stats;
+    mcp342x_sim_get_stats(&stats);
+    EXPECT_EQ(1U, stats.general_calls);
+    EXPECT_EQ(1U, stats.writes);
+    EXPECT_GE(stats.reads, DEVICES);
+
+    for (size_t i = 0; i < DEVICES; i++)
+    {
+        EXPECT_EQ(MCP342X_STATUS_OK, samples[i].status);
+        EXPECT_EQ(i, samples[i].device);
+        EXPECT_EQ(400 * (int32_t)(i + 1), samples[i].code);
+        EXPECT_EQ(samples[0].start_us, samples[i].start_us);
+        EXPECT_EQ(conversions[i] + 1, mcp342x_sim_conversions(ADDRESSES[i]));
+    }
+}
+
+TEST_F(SyncTest, EachTriggerIsOneGeneralCall)
+{
+    mcp342x_sim_reset_stats();
+    mcp342x_sample_t samples[DEVICES];
+    for (int i = 0; i < 3; i++)
+    {
+        ASSERT_EQ(ESP_OK, this->group.Trigger());
+        ASSERT_EQ(ESP_OK, this->group.Collect(samples));
+    }
+    mcp342x_sim_stats_t stats;
+    mcp342x_sim_get_stats(&stats);
+    EXPECT_EQ(3U, stats.general_calls);
+    EXPECT_EQ(3U, stats.writes);
+}
+
+TEST_F(SyncTest, FailedReadFailsCollect)
+{
+    ASSERT_EQ(ESP_OK, this->group.Trigger());
+    mcp342x_sim_remove_device(ADDRESSES[1]);
+    mcp342x_sample_t samples[DEVICES];
+    EXPECT_NE(ESP_OK, this->group.Collect(samples));
+
+    /**
+     * The other devices still deliver their samples
+     */
+    EXPECT_EQ(MCP342X_STATUS_OK, samples[0].status);
+    EXPECT_NE(MCP342X_STATUS_OK, samples[1].status);
+    EXPECT_EQ(MCP342X_STATUS_OK, samples[2].status);
+    EXPECT_EQ(1200, samples[2].code);
+}
+
+TEST_F(SyncTest, CollectNeedsTrigger)
+{
+    mcp342x_sample_t samples[DEVICES];
+    EXPECT_EQ(ESP_ERR_INVALID_STATE, this->group.Collect(samples));
+}
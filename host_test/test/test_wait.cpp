@@ -0,0 +1,159 @@
+/*
+    Craft Metrics
+
+    This product includes software developed by
+    Craft Metrics (https://craftmetrics.ca/).
+
+    MIT License
+    Copyright (c) 2018 Craft Metrics
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#include "mcp342x_sim.h"
+#include "mcp342x_priv.h"
+
+#include <time.h>
+#include <gtest/gtest.h>
+#include <esp_timer.h>
+
+/**
+ * Conversion-time-aware waiting: bus transactions per sample, timeouts, and
+ * delays that neither spin nor end early
+ */
+static const uint8_t ADDRESS = MCP342X_A0GND_A1GND;
+
+static int64_t _thread_cpu_us(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+    return (int64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+class WaitTest : public ::testing::TestWithParam<mcp342x_sample_rate_t>
+{
+protected:
+    smbus_info_t smbus_info;
+    mcp342x_info_t info;
+
+    void SetUp() override
+    {
+        mcp342x_sim_reset();
+        mcp342x_sim_add_device(ADDRESS, 4, true);
+        mcp342x_sim_set_input(ADDRESS, 0, 10000000);
+        smbus_init(&this->smbus_info, 0, ADDRESS);
+        this->info = {};
+    }
+
+    void Init(mcp342x_sample_rate_t rate, mcp342x_wait_mode_t wait_mode)
+    {
+        mcp342x_config_t config = {MCP342X_CHANNEL_1, MCP342X_MODE_ONESHOT, rate, MCP342X_GAIN_1X};
+        ASSERT_EQ(ESP_OK, mcp342x_init(&this->info, &this->smbus_info, config));
+        mcp342x_set_wait_mode(&this->info, wait_mode);
+        mcp342x_sim_reset_stats();
+    }
+};
+
+TEST_P(WaitTest, SleepModeReadsOncePerSample)
+{
+    const int samples = GetParam() == MCP342X_SRATE_18BIT ? 2 : 5;
+    this->Init(GetParam(), MCP342X_WAIT_SLEEP);
+    for (int i = 0; i < samples; i++)
+    {
+        int32_t code;
+        ASSERT_EQ(ESP_OK, mcp342x_start_new_conversion(&this->info));
+        ASSERT_EQ(MCP342X_STATUS_OK, mcp342x_read_raw(&this->info, &code));
+    }
+
+    /**
+     * One trigger write and one read of the output register per sample
+     */
+    mcp342x_sim_stats_t stats;
+    mcp342x_sim_get_stats(&stats);
+    EXPECT_EQ((uint32_t)samples, stats.writes);
+    EXPECT_EQ((uint32_t)samples, stats.reads);
+    EXPECT_EQ((uint32_t)samples, this->info.stats.polls);
+}
+
+TEST_P(WaitTest, PollModeHammersTheBus)
+{
+    this->Init(GetParam(), MCP342X_WAIT_POLL);
+    int32_t code;
+    ASSERT_EQ(ESP_OK, mcp342x_start_new_conversion(&this->info));
+    ASSERT_EQ(MCP342X_STATUS_OK, mcp342x_read_raw(&this->info, &code));
+
+    mcp342x_sim_stats_t stats;
+    mcp342x_sim_get_stats(&stats);
+    EXPECT_GT(stats.reads, 10U);
+}
+
+INSTANTIATE_TEST_SUITE_P(Rates, WaitTest,
+                         ::testing::Values(MCP342X_SRATE_12BIT, MCP342X_SRATE_14BIT, MCP342X_SRATE_16BIT, MCP342X_SRATE_18BIT));
+
+TEST_F(WaitTest, SlowConversionTimesOut)
+{
+    this->Init(MCP342X_SRATE_12BIT, MCP342X_WAIT_SLEEP);
+    mcp342x_sim_set_timing(ADDRESS, 50000);
+    int32_t code;
+    ASSERT_EQ(ESP_OK, mcp342x_start_new_conversion(&this->info));
+    EXPECT_EQ(MCP342X_STATUS_TIMEOUT, mcp342x_read_raw(&this->info, &code));
+    EXPECT_EQ(1U, this->info.stats.timeouts);
+
+    /**
+     * Backoff from 1/16 up to 1/4 of the conversion time bounds the polls
+     */
+    EXPECT_LT(this->info.stats.polls, 12U);
+}
+
+TEST_F(WaitTest, DelayNeverEndsEarly)
+{
+    for (int64_t delay_us = 1; delay_us < 40000; delay_us = delay_us * 3 + 7)
+    {
+        int64_t start_us = esp_timer_get_time();
+        mcp342x_delay_us(delay_us);
+        EXPECT_GE(esp_timer_get_time() - start_us, delay_us);
+    }
+}
+
+TEST_F(WaitTest, DelayDoesNotSpin)
+{
+    /**
+     * Sub-tick and multi-tick delays block instead of yielding in a loop
+     */
+    static const int64_t delays_us[] = {200, 2000, 15000, 45000};
+    for (int64_t delay_us : delays_us)
+    {
+        int64_t cpu_us = _thread_cpu_us();
+        mcp342x_delay_us(delay_us);
+        EXPECT_LT(_thread_cpu_us() - cpu_us, 500) << delay_us << " us delay";
+    }
+}
+
+TEST_F(WaitTest, SleepModeLeavesTheCpuIdle)
+{
+    this->Init(MCP342X_SRATE_16BIT, MCP342X_WAIT_SLEEP);
+    int64_t cpu_us = _thread_cpu_us();
+    for (int i = 0; i < 3; i++)
+    {
+        int32_t code;
+        ASSERT_EQ(ESP_OK, mcp342x_start_new_conversion(&this->info));
+        ASSERT_EQ(MCP342X_STATUS_OK, mcp342x_read_raw(&this->info, &code));
+    }
+    EXPECT_LT(_thread_cpu_us() - cpu_us, 3000);
+}
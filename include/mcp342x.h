@@ -139,9 +139,20 @@ typedef enum MCP342xConvStatus
     MCP342X_STATUS_OVERFLOW,
     MCP342X_STATUS_I2C,
     MCP342X_STATUS_IN_PROGRESS,
-    MCP342X_STATUS_TIMEOUT
+    MCP342X_STATUS_TIMEOUT,
+    MCP342X_STATUS_INVALID_STATE
 } mcp342x_conversion_status_t;
 
+/** Strategy used by mcp342x_read_result while a conversion is in progress
+ * SLEEP sleeps for the datasheet conversion time, then polls with bounded backoff
+ * POLL reads the output register back-to-back until the result is ready
+ */
+typedef enum MCP342xWaitMode
+{
+    MCP342X_WAIT_SLEEP,
+    MCP342X_WAIT_POLL,
+} mcp342x_wait_mode_t;
+
 /** Configuration Register values of the MCP342x device
  * Initialized with default settings partially according to
  * datasheet Section 4.1
@@ -154,14 +165,154 @@ typedef struct MCP342xConfig
     mcp342x_gain_t gain;
 } mcp342x_config_t;
 
+/** Number of start-to-ready latency histogram buckets
+ * Latencies are binned in units of MCP342X_LATENCY_UNIT_US, a power of two close to 1 ms.
+ * Bucket 0 counts latencies under 1 unit, bucket n from 2^(n-1) units up to 2^n units,
+ * and the last bucket everything longer.
+ */
+#define MCP342X_LATENCY_BUCKETS (10)
+#define MCP342X_LATENCY_UNIT_US (1024)
+
+/** Per-device counters kept on the sample path instead of logging
+ * conversions counts triggers, polls every read of the output register.
+ * writes_skipped counts config writes left out because the device already held the config.
+ * retries counts repeated bus transfers, recoveries the config resends of error recovery.
+ * Latency runs from the trigger, or the previous continuous mode result,
+ * to the read that returned the result.
+ */
+typedef struct MCP342xStats
+{
+    uint32_t conversions;
+    uint32_t samples;
+    uint32_t polls;
+    uint32_t overflows;
+    uint32_t underflows;
+    uint32_t i2c_errors;
+    uint32_t timeouts;
+    uint32_t channel_swaps;
+    uint32_t writes_skipped;
+    uint32_t retries;
+    uint32_t recoveries;
+    uint32_t bytes_written;
+    uint32_t bytes_read;
+    uint32_t latency_min_us;
+    uint32_t latency_max_us;
+    uint64_t latency_sum_us;
+    uint32_t latency_histogram[MCP342X_LATENCY_BUCKETS];
+} mcp342x_stats_t;
+
+/** Bus backend carrying all transfers of a device
+ * write sends bytes to smbus_info->address, read receives bytes from it.
+ * Address 0x00 is used for general calls. context is passed through unchanged.
+ */
+typedef struct MCP342xBus
+{
+    void *context;
+    esp_err_t (*write)(void *context, const smbus_info_t *smbus_info, const uint8_t *data, size_t len);
+    esp_err_t (*read)(void *context, const smbus_info_t *smbus_info, uint8_t *data, size_t len);
+} mcp342x_bus_t;
+
+/** Default backend using the ESP-IDF i2c master driver
+ */
+extern const mcp342x_bus_t mcp342x_i2c_bus;
+
+/** Timestamped conversion result, packed into 16 bytes
+ * config is the config byte the result was converted with, holding channel, resolution and gain,
+ * or the requested config when there is no code. status is a mcp342x_conversion_status_t.
+ * start_us is the trigger time, or the previous result in continuous mode, and ready_us the
+ * estimated completion: start_us plus the conversion time, but never later than the read.
+ * Both are the low 32 bits of esp_timer_get_time(), wrapping after about 71 minutes.
+ * device is left 0 by the C API and set to the device index by the batch APIs.
+ */
+typedef struct MCP342xSample
+{
+    int32_t code;
+    uint32_t start_us;
+    uint32_t ready_us;
+    uint8_t config;
+    uint8_t status;
+    uint8_t device;
+    uint8_t reserved;
+} mcp342x_sample_t;
+
+/** Number of consecutive small results before auto-ranging steps the gain up
+ */
+#define MCP342X_AUTORANGE_HOLD (4)
+
+/** Longest wait the retry backoff doubles up to, a larger backoff_us is used as is
+ */
+#define MCP342X_RECOVERY_BACKOFF_MAX_US (100000)
+
+/** Error recovery settings of a device, all zero by default which disables recovery
+ * A failed transfer is retried up to max_retries times, waiting backoff_us before
+ * the first retry and doubling the wait for each further one, up to
+ * MCP342X_RECOVERY_BACKOFF_MAX_US.
+ * Transfers still failing after that count against error_budget and successful
+ * ones pay it back. Once more than error_budget transfers have failed, the config of
+ * the device is sent again. If that fails too the device is marked degraded and every
+ * call fails straight away until mcp342x_recover succeeds.
+ * Recovery never uses the general call reset, which would also reset the other
+ * devices on the port and abort their conversions.
+ */
+typedef struct MCP342xRecovery
+{
+    uint8_t max_retries;
+    uint32_t backoff_us;
+    uint16_t error_budget;
+    uint16_t errors;
+} mcp342x_recovery_t;
+
+/** Number of calibration entries, one per channel, resolution and gain
+ */
+#define MCP342X_CALIBRATION_ENTRIES (64)
+
+/** Fractional bits of the calibration gain trim
+ */
+#define MCP342X_CALIBRATION_TRIM_SHIFT (24)
+
+/** Offset and gain correction of one channel, resolution and gain
+ * offset_q8 is subtracted from the output code in 1/256 LSB, then the code is
+ * scaled by 1 + gain_trim_q24 / 2^24. An all zero entry leaves codes unchanged.
+ */
+typedef struct MCP342xCalibrationEntry
+{
+    int32_t offset_q8;
+    int32_t gain_trim_q24;
+} mcp342x_calibration_entry_t;
+
+/** Calibration table of a device, see mcp342x_calibration_index for the layout
+ */
+typedef struct MCP342xCalibration
+{
+    mcp342x_calibration_entry_t entry[MCP342X_CALIBRATION_ENTRIES];
+} mcp342x_calibration_t;
+
 /** Struct for controlling a MCP342x device
  * smbus_info contains the i2c address of the device
+ * result_config is the config byte read back with the last result,
+ * holding the channel, resolution and gain it was converted with
+ * shadow_config is the config byte the device holds, known when shadow_valid is set
+ * calibration, when set, corrects every in-range output code as it is decoded,
+ * corrected codes that reach full scale report MCP342X_STATUS_OVERFLOW or MCP342X_STATUS_UNDERFLOW
+ * degraded is set when error recovery gave up on the device
  */
 typedef struct MCP342xInfo_t
 {
     bool init : 1;
+    bool shadow_valid : 1;
+    bool degraded : 1;
+    bool recovering : 1;
     smbus_info_t *smbus_info;
+    const mcp342x_bus_t *bus;
     uint8_t config;
+    uint8_t shadow_config;
+    uint8_t result_config;
+    uint32_t lsb_nv_q3;
+    mcp342x_wait_mode_t wait_mode;
+    int64_t conversion_start_us;
+    const mcp342x_calibration_t *calibration;
+    mcp342x_recovery_t recovery;
+    mcp342x_stats_t stats;
 } mcp342x_info_t;
 
 /*-----------------------------------------------------------
@@ -171,6 +322,9 @@ typedef struct MCP342xInfo_t
 /**
  * @brief Construct a new MCP342x info instance.
  *        New instance should be initialised before calling other functions.
+ *        Taken from a static pool when CONFIG_MCP342X_STATIC_POOL_SIZE is set,
+ *        otherwise from the heap. Statically allocated instances may also be
+ *        passed to mcp342x_init directly.
  *
  * @return Pointer to new device info instance, or NULL if it cannot be created.
  */
@@ -178,6 +332,8 @@ mcp342x_info_t *mcp342x_malloc(void);
 
 /**
  * @brief Delete an existing MCP342x info instance.
+ *        With the static pool, pointers that did not come from mcp342x_malloc
+ *        or were already freed are logged as errors and the pool is left unchanged.
  *
  * @param[in,out] Pointer to MCP342x info instance that will be freed and set to NULL.
  */
@@ -195,35 +351,282 @@ esp_err_t mcp342x_init(mcp342x_info_t *mcp342x_info, smbus_info_t *smbus_info, m
 
 /**
  * @brief Set the configuration values for the MCP342x instance
+ *        Nothing is sent, the change goes out with the next config write or trigger.
  *
  * @param[in] mcp342x_info Pointer to MCP342x info instance.
  * @param[in] in_config Configuration bitmask.
  */
 void mcp342x_set_config(mcp342x_info_t *mcp342x_info_ptr, mcp342x_config_t in_config); 
 
+/**
+ * @brief Select the input channel of the next conversion, counted as a channel swap if it changes
+ *        Nothing is sent, the change goes out with the next config write or trigger.
+ *
+ * @param[in] mcp342x_info Pointer to MCP342x info instance.
+ * @param[in] in_channel Input channel.
+ */
+void mcp342x_set_channel(mcp342x_info_t *mcp342x_info_ptr, mcp342x_channel_t in_channel);
+
+/**
+ * @brief Forget the config the device is known to hold, so the next write is always sent
+ *        A general call reset returns every MCP342x on the bus to its power-on config,
+ *        call this for each of them after one. mcp342x_general_call does so only for
+ *        the device it was called on.
+ *
+ * @param[in] mcp342x_info_ptr Pointer to MCP342x info instance.
+ */
+void mcp342x_invalidate_config(mcp342x_info_t *mcp342x_info_ptr);
+
+/**
+ * @brief Route the transfers of a device through another bus backend,
+ *        for example a simulator or a shared bus arbiter.
+ *        May be called before mcp342x_init.
+ *
+ * @param[in] mcp342x_info_ptr Pointer to MCP342x info instance.
+ * @param[in] bus Backend to use, or NULL for mcp342x_i2c_bus.
+ */
+void mcp342x_set_bus(mcp342x_info_t *mcp342x_info_ptr, const mcp342x_bus_t *bus);
+
+/**
+ * @brief Select how mcp342x_read_result waits for a conversion to complete
+ *
+ * @param[in] mcp342x_info_ptr Pointer to MCP342x info instance.
+ * @param[in] wait_mode Wait strategy, MCP342X_WAIT_SLEEP by default.
+ */
+void mcp342x_set_wait_mode(mcp342x_info_t *mcp342x_info_ptr, mcp342x_wait_mode_t wait_mode);
+
+/**
+ * @brief Enable bounded retries and error recovery, see mcp342x_recovery_t
+ *
+ * @param[in] mcp342x_info_ptr Pointer to MCP342x info instance.
+ * @param[in] max_retries Retries of a failed transfer, 0 for none.
+ * @param[in] backoff_us Wait before the first retry, doubled for each further one up to MCP342X_RECOVERY_BACKOFF_MAX_US.
+ * @param[in] error_budget Failed transfers tolerated before recovery, 0 to never recover.
+ */
+void mcp342x_set_recovery(mcp342x_info_t *mcp342x_info_ptr, uint8_t max_retries, uint32_t backoff_us, uint16_t error_budget);
+
+/**
+ * @brief Send the config of the device again, whatever it is known to hold
+ *        Only this device is touched, conversions on other devices carry on.
+ *        To reset a wedged bus use mcp342x_general_call with MCP342X_GC_RESET instead,
+ *        then mcp342x_invalidate_config on every device of the port.
+ *        Clears the degraded flag if the config was sent.
+ *
+ * @param[in] mcp342x_info_ptr Pointer to MCP342x info instance.
+ *
+ * @return ESP_OK if successful, otherwise an error constant and the device stays degraded.
+ */
+esp_err_t mcp342x_recover(mcp342x_info_t *mcp342x_info_ptr);
+
+/**
+ * @brief Attach a calibration table, applied to output codes in fixed point as they are decoded
+ *
+ * @param[in] mcp342x_info_ptr Pointer to MCP342x info instance.
+ * @param[in] calibration Table to use, or NULL for raw codes. It must outlive its use.
+ */
+void mcp342x_set_calibration(mcp342x_info_t *mcp342x_info_ptr, const mcp342x_calibration_t *calibration);
+
+/**
+ * @brief Index of the calibration entry for a config byte
+ *        Bits 5-4 hold the channel, bits 3-2 the resolution and bits 1-0 the gain.
+ *
+ * @param[in] config Config byte.
+ *
+ * @return Index into mcp342x_calibration_t.entry.
+ */
+uint8_t mcp342x_calibration_index(uint8_t config);
+
+/**
+ * @brief Apply a calibration table to an output code
+ *
+ * @param[in] calibration Calibration table.
+ * @param[in] config Config byte the code was converted with.
+ * @param[in] code Sign-extended output code.
+ *
+ * @return Corrected output code, clamped to the full scale codes of the resolution in config.
+ */
+int32_t mcp342x_calibrate_code(const mcp342x_calibration_t *calibration, uint8_t config, int32_t code);
+
+/**
+ * @brief Size of one output code step
+ *
+ * @param[in] config Config byte, only the sample rate and gain bits are used.
+ *
+ * @return LSB size in 1/8 nV: 2.048 V / 2^(bits - 1) divided by the PGA gain.
+ */
+uint32_t mcp342x_lsb_nv_q3(uint8_t config);
+
+/**
+ * @brief Typical conversion time for a sample rate according to the datasheet
+ *
+ * @param[in] sample_rate Sample rate / resolution of the conversion.
+ *
+ * @return Conversion time in microseconds.
+ */
+uint32_t mcp342x_conversion_time_us(mcp342x_sample_rate_t sample_rate);
+
+/**
+ * @brief Slowest conversion time for a sample rate allowed by the datasheet
+ *
+ * @param[in] sample_rate Sample rate / resolution of the conversion.
+ *
+ * @return Conversion time in microseconds, rounded up.
+ */
+uint32_t mcp342x_conversion_time_max_us(mcp342x_sample_rate_t sample_rate);
+
 /**
  * @brief Specific call to the device samples the logic status 
  *        of the Adr0 and Adr1 pins in the general call events
+ *        The call is sent to the general call address 0x00 on the device's
+ *        i2c port, so every MCP342x on that bus acts on it.
+ *        MCP342X_GC_RESET returns all of them to their power-on config and aborts
+ *        their conversions, it is a port-wide action the caller has to coordinate.
  * 
- * @param[in] smbus_info_ptr Pointer to smbus info instance.
+ * @param[in] mcp342x_info_ptr Pointer to MCP342x info instance providing the i2c port.
  * @param[in] call General call to write.
  * 
  * @return ESP_OK if successful, otherwise an error constant.
  */
-esp_err_t mcp342x_general_call(const mcp342x_info_t *mcp342x_info_ptr, mcp342x_general_call_t call);
+esp_err_t mcp342x_general_call(mcp342x_info_t *mcp342x_info_ptr, mcp342x_general_call_t call);
+
+/**
+ * @brief Write the configuration byte without triggering a one-shot conversion
+ *        Skipped when the device already holds the same config.
+ *
+ * @param[in] mcp342x_info_ptr Pointer to MCP342x info instance.
+ *
+ * @return ESP_OK if successful, otherwise an error constant.
+ */
+esp_err_t mcp342x_write_config(mcp342x_info_t *mcp342x_info_ptr);
 
 /**
  * @brief Trigger a conversion on the MCP342x instance
+ *        Pending config changes are sent with the trigger. In continuous mode
+ *        the write is skipped when the device already holds the same config,
+ *        since conversions are running and a write would only restart them.
  *
  * @param[in] mcp342x_info_ptr Pointer to MCP342x info instance.
  * @param[in] smbus_info_ptr Pointer to SMBus info instance.
  * 
  * @return ESP_OK if successful, otherwise an error constant.
  */
-esp_err_t mcp342x_start_new_conversion(const mcp342x_info_t *mcp342x_info_ptr);
+esp_err_t mcp342x_start_new_conversion(mcp342x_info_t *mcp342x_info_ptr);
+
+/**
+ * @brief Read the output register once without waiting
+ *
+ * @param[in] mcp342x_info_ptr Pointer to MCP342x info instance.
+ * @param[out] result Reference to result variable, only written when a new result is available.
+ *
+ * @return MCP342X_STATUS_IN_PROGRESS while the conversion is running, otherwise the conversion status
+ */
+mcp342x_conversion_status_t mcp342x_poll_result(mcp342x_info_t *mcp342x_info_ptr, double *result);
+
+/**
+ * @brief Read the output register once without waiting, returning the raw code
+ *
+ * @param[in] mcp342x_info_ptr Pointer to MCP342x info instance.
+ * @param[out] code Sign-extended output code, only written when a new result is available.
+ *
+ * @return MCP342X_STATUS_IN_PROGRESS while the conversion is running, otherwise the conversion status
+ */
+mcp342x_conversion_status_t mcp342x_poll_raw(mcp342x_info_t *mcp342x_info_ptr, int32_t *code);
+
+/**
+ * @brief Read the raw result of the conversion, waiting like mcp342x_read_result
+ *
+ * @param[in] mcp342x_info_ptr Pointer to MCP342x info instance.
+ * @param[out] code Sign-extended output code.
+ *
+ * @return Conversion Status
+ */
+mcp342x_conversion_status_t mcp342x_read_raw(mcp342x_info_t *mcp342x_info_ptr, int32_t *code);
+
+/**
+ * @brief Check once for a finished conversion and record it with its timestamps
+ *
+ * @param[in] mcp342x_info_ptr Pointer to MCP342x info instance.
+ * @param[out] sample Sample record.
+ *
+ * @return Status of the conversion, MCP342X_STATUS_IN_PROGRESS if it is not done yet.
+ */
+mcp342x_conversion_status_t mcp342x_poll_sample(mcp342x_info_t *mcp342x_info_ptr, mcp342x_sample_t *sample);
+
+/**
+ * @brief Wait for the conversion and record it with its timestamps
+ *
+ * @param[in] mcp342x_info_ptr Pointer to MCP342x info instance.
+ * @param[out] sample Sample record.
+ *
+ * @return Status of the conversion.
+ */
+mcp342x_conversion_status_t mcp342x_read_sample(mcp342x_info_t *mcp342x_info_ptr, mcp342x_sample_t *sample);
+
+/**
+ * @brief Convert a sample record to nanovolts at the input, using the config stored in it
+ *
+ * @param[in] sample Sample record.
+ *
+ * @return Input voltage in nanovolts.
+ */
+int32_t mcp342x_sample_to_nanovolts(const mcp342x_sample_t *sample);
+
+/**
+ * @brief Copy the per-device counters
+ *        The mean latency is latency_sum_us / samples.
+ *
+ * @param[in] mcp342x_info_ptr Pointer to MCP342x info instance.
+ * @param[out] stats Counters since initialisation or the last reset.
+ */
+void mcp342x_get_stats(const mcp342x_info_t *mcp342x_info_ptr, mcp342x_stats_t *stats);
+
+/**
+ * @brief Clear the per-device counters
+ *
+ * @param[in] mcp342x_info_ptr Pointer to MCP342x info instance.
+ */
+void mcp342x_reset_stats(mcp342x_info_t *mcp342x_info_ptr);
+
+/**
+ * @brief Choose the gain for the next conversion of a channel from its last result
+ *        Steps down one gain at once when the result saturates or passes 7/8 of full scale.
+ *        Steps up one gain after MCP342X_AUTORANGE_HOLD results in a row below 3/8 of full scale,
+ *        so the doubled signal stays below the step down threshold.
+ *
+ * @param[in] result_config Config byte read back with the result, see mcp342x_info_t.result_config.
+ * @param[in] code Sign-extended output code.
+ * @param[in] status Status returned with the code.
+ * @param[in,out] hold Consecutive small results, kept by the caller for each channel.
+ *
+ * @return Gain to use for the next conversion of the channel.
+ */
+mcp342x_gain_t mcp342x_autorange_gain(uint8_t result_config, int32_t code, mcp342x_conversion_status_t status, uint8_t *hold);
+
+/**
+ * @brief Convert an output code to nanovolts at the input, using integer math only
+ *        The scale is precomputed whenever the configuration is set.
+ *
+ * @param[in] mcp342x_info_ptr Pointer to MCP342x info instance.
+ * @param[in] code Sign-extended output code.
+ *
+ * @return Input voltage in nanovolts.
+ */
+int32_t mcp342x_code_to_nanovolts(const mcp342x_info_t *mcp342x_info_ptr, int32_t code);
+
+/**
+ * @brief Read the result of the conversion in nanovolts, waiting like mcp342x_read_result
+ *
+ * @param[in] mcp342x_info_ptr Pointer to MCP342x info instance.
+ * @param[out] nanovolts Input voltage in nanovolts.
+ *
+ * @return Conversion Status
+ */
+mcp342x_conversion_status_t mcp342x_read_nanovolts(mcp342x_info_t *mcp342x_info_ptr, int32_t *nanovolts);
 
 /**
  * @brief Read the result of the conversion
+ *        Waits according to the configured wait mode, giving up with
+ *        MCP342X_STATUS_TIMEOUT once twice the conversion time has passed.
  *
  * @param[in] mcp342x_info_ptr Pointer to MCP342x info instance.
  * @param[in] smbus_info_ptr Pointer to SMBus info instance.
@@ -231,7 +634,7 @@ esp_err_t mcp342x_start_new_conversion(const mcp342x_info_t *mcp342x_info_ptr);
  * 
  * @return Conversion Status
  */
-mcp342x_conversion_status_t mcp342x_read_result(const mcp342x_info_t *mcp342x_info_ptr, double *result);
+mcp342x_conversion_status_t mcp342x_read_result(mcp342x_info_t *mcp342x_info_ptr, double *result);
 
 #ifdef __cplusplus
 }
@@ -246,6 +649,10 @@ class MCP342x
 {
   public:
     MCP342x(mcp342x_address_t in_address);
+    MCP342x(const MCP342x &) = delete;
+    MCP342x &operator=(const MCP342x &) = delete;
+    MCP342x(MCP342x &&other);
+    MCP342x &operator=(MCP342x &&other);
     ~MCP342x();
     esp_err_t Init(i2c_port_t in_i2c_master, mcp342x_config_t in_config);
     esp_err_t GeneralCall(mcp342x_general_call_t call);
@@ -253,12 +660,34 @@ class MCP342x
     esp_err_t StartNewConversion(void);
     esp_err_t StartNewConversion(mcp342x_channel_t in_channel);
     double Read(void);
+    mcp342x_conversion_status_t TryRead(double *result);
+    mcp342x_conversion_status_t ReadRaw(int32_t *code);
+    mcp342x_conversion_status_t ReadNanovolts(int32_t *nanovolts);
+    void SetChannelConfig(mcp342x_channel_t in_channel, mcp342x_sample_rate_t in_sample_rate, mcp342x_gain_t in_gain);
+    mcp342x_conversion_status_t TryReadSample(mcp342x_sample_t *sample);
+    mcp342x_conversion_status_t ReadSample(mcp342x_sample_t *sample);
+    esp_err_t ScanChannels(uint8_t channel_mask, mcp342x_sample_t *samples);
+    void SetCalibration(const mcp342x_calibration_t *calibration);
+    void SetRecovery(uint8_t max_retries, uint32_t backoff_us, uint16_t error_budget);
+    esp_err_t Recover(void);
+    bool IsDegraded(void);
+    void SetAutoRange(mcp342x_channel_t in_channel, bool enable);
+    mcp342x_gain_t GetResultGain(void);
+    void GetStats(mcp342x_stats_t *stats);
+    void ResetStats(void);
     mcp342x_address_t GetAddress(void);
     mcp342x_info_t *GetInfoPtr(void);
 
   private:
     mcp342x_address_t address;
-    mcp342x_info_t *mcp342x_info;
+    smbus_info_t smbus_info;
+    mcp342x_info_t mcp342x_info;
+    uint8_t channel_config[4];
+    uint8_t autorange_mask;
+    uint8_t autorange_hold[4];
+
+    mcp342x_conversion_status_t AutoRange(mcp342x_conversion_status_t status, const int32_t *code);
+    void ApplyChannelGain(void);
 };
 
 } // namespace cm
@@ -0,0 +1,137 @@
+/*
+Craft Metrics
+
+This product includes software developed by
+Craft Metrics (https://craftmetrics.ca/).
+
+MIT License
+Copyright (c) 2018 Craft Metrics
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#ifndef ESP32_MCP342X_ARBITER_H
+#define ESP32_MCP342X_ARBITER_H
+
+#include "mcp342x.h"
+
+#include <freertos/FreeRTOS.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/*-----------------------------------------------------------
+* MACROS & ENUMS
+*----------------------------------------------------------*/
+
+/** Most transfers the arbiter sends in one i2c command link
+ */
+#define MCP342X_ARBITER_MAX_BATCH (8)
+
+/** Times a queued transfer may be overtaken by shorter ones before it is served in turn
+ */
+#define MCP342X_ARBITER_MAX_BYPASS (4)
+
+/** Counters of a port arbiter
+ * transfers counts the transfers carried, links the i2c command links they
+ * were batched into. contentions counts transfers queued behind others,
+ * bypasses the times a shorter transfer overtook a queued one.
+ */
+typedef struct MCP342xArbiterStats
+{
+    uint32_t transfers;
+    uint32_t links;
+    uint32_t contentions;
+    uint32_t bypasses;
+} mcp342x_arbiter_stats_t;
+
+/*-----------------------------------------------------------
+* DEFINITIONS
+*----------------------------------------------------------*/
+
+/**
+ * @brief Create the arbiter of an i2c port and start its worker task
+ *        Call once per port before any task uses it. Devices attached with
+ *        mcp342x_set_bus(info, mcp342x_arbiter_bus(port)) queue their transfers
+ *        with the worker, which owns the port. Whatever is queued when the worker
+ *        gets to it goes out back-to-back in one command link, joined by repeated
+ *        starts. The queue is ordered shortest transfer first, so config writes and
+ *        short reads go ahead of longer ones, with a bound on how often a transfer
+ *        can be overtaken. If a device does not acknowledge, the transfers before
+ *        it in the batch succeed, its own fails and the ones after it are queued again.
+ *
+ * @param[in] i2c_port I2C port shared by the devices.
+ * @param[in] priority Priority of the worker task, above that of the tasks using the port.
+ *
+ * @return ESP_OK if successful, ESP_ERR_NO_MEM if the worker could not be created.
+ */
+esp_err_t mcp342x_arbiter_init(i2c_port_t i2c_port, UBaseType_t priority);
+
+/**
+ * @brief Get the bus backend queueing transfers on an i2c port
+ *
+ * @param[in] i2c_port I2C port passed to mcp342x_arbiter_init.
+ *
+ * @return Bus backend, NULL if the port has no arbiter.
+ */
+const mcp342x_bus_t *mcp342x_arbiter_bus(i2c_port_t i2c_port);
+
+/**
+ * @brief Reserve the port for the transfers of the calling task, e.g. triggering several devices back-to-back
+ *        Transfers of other tasks stay queued until the matching unlock. Locks nest.
+ *
+ * @param[in] i2c_port I2C port passed to mcp342x_arbiter_init.
+ * @param[in] timeout Ticks to wait while another task holds the port.
+ *
+ * @return ESP_OK if successful, ESP_ERR_TIMEOUT if the port stayed reserved.
+ */
+esp_err_t mcp342x_arbiter_lock(i2c_port_t i2c_port, TickType_t timeout);
+
+/**
+ * @brief Release a port reserved by mcp342x_arbiter_lock
+ *
+ * @param[in] i2c_port I2C port passed to mcp342x_arbiter_init.
+ */
+void mcp342x_arbiter_unlock(i2c_port_t i2c_port);
+
+/**
+ * @brief Number of transfers that had to queue behind others
+ *
+ * @param[in] i2c_port I2C port passed to mcp342x_arbiter_init.
+ *
+ * @return Contention count since init.
+ */
+uint32_t mcp342x_arbiter_contentions(i2c_port_t i2c_port);
+
+/**
+ * @brief Read the counters of a port arbiter
+ *
+ * @param[in] i2c_port I2C port passed to mcp342x_arbiter_init.
+ * @param[out] stats Counters since init, all zero if the port has no arbiter.
+ */
+void mcp342x_arbiter_get_stats(i2c_port_t i2c_port, mcp342x_arbiter_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // ESP32_MCP342X_ARBITER_H
@@ -0,0 +1,119 @@
+/*
+Craft Metrics
+
+This product includes software developed by
+Craft Metrics (https://craftmetrics.ca/).
+
+MIT License
+Copyright (c) 2018 Craft Metrics
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#ifndef ESP32_MCP342X_ASYNC_H
+#define ESP32_MCP342X_ASYNC_H
+
+#include "mcp342x.h"
+
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/semphr.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/*-----------------------------------------------------------
+* MACROS & ENUMS
+*----------------------------------------------------------*/
+
+/** Completion callback, run from the worker task of the async instance
+ * It may start the next conversion with mcp342x_async_start.
+ */
+typedef void (*mcp342x_async_callback_t)(mcp342x_info_t *mcp342x_info_ptr, const mcp342x_sample_t *sample, void *arg);
+
+/** Timer driven conversion of one device
+ * The device is read once when the conversion is expected to be done, and
+ * again after a short remainder while it is not. The CPU and bus stay idle
+ * in between. The timer callback only wakes a worker task, which does the read
+ * and delivers the result, so bus transfers and backoff never block the esp_timer
+ * task that all timers share. sample holds the last result and stays valid until the next start.
+ */
+typedef struct MCP342xAsync
+{
+    mcp342x_info_t *mcp342x_info;
+    esp_timer_handle_t timer;
+    mcp342x_async_callback_t callback;
+    void *arg;
+    TaskHandle_t notify_task;
+    TaskHandle_t worker;
+    SemaphoreHandle_t stopped;
+    mcp342x_sample_t sample;
+    volatile bool busy;
+    volatile bool stopping;
+} mcp342x_async_t;
+
+/*-----------------------------------------------------------
+* DEFINITIONS
+*----------------------------------------------------------*/
+
+/**
+ * @brief Initialise timer driven conversions of a device and start its worker task
+ *
+ * @param[out] async Pointer to async instance.
+ * @param[in] mcp342x_info_ptr Pointer to an initialised MCP342x info instance.
+ * @param[in] callback Called with each result, or NULL.
+ * @param[in] arg Passed to the callback.
+ * @param[in] notify_task Task notified with xTaskNotifyGive after each result, or NULL.
+ * @param[in] priority Priority of the worker task reading the device.
+ *
+ * @return ESP_OK if successful, ESP_ERR_NO_MEM if the worker cannot be created,
+ *         otherwise an error constant from esp_timer_create.
+ */
+esp_err_t mcp342x_async_init(mcp342x_async_t *async, mcp342x_info_t *mcp342x_info_ptr,
+                             mcp342x_async_callback_t callback, void *arg, TaskHandle_t notify_task,
+                             UBaseType_t priority);
+
+/**
+ * @brief Delete the timer and worker task of an async instance, stopping any pending conversion read
+ *        Must not be called from the completion callback.
+ *
+ * @param[in] async Pointer to async instance.
+ */
+void mcp342x_async_deinit(mcp342x_async_t *async);
+
+/**
+ * @brief Trigger a conversion and arm the timer for its expected end
+ *        In continuous mode the running conversion is waited for instead.
+ *
+ * @param[in] async Pointer to async instance.
+ *
+ * @return ESP_OK if successful, ESP_ERR_INVALID_STATE while a conversion is pending,
+ *         otherwise an error constant.
+ */
+esp_err_t mcp342x_async_start(mcp342x_async_t *async);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // ESP32_MCP342X_ASYNC_H
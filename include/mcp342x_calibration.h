@@ -0,0 +1,132 @@
+/*
+Craft Metrics
+
+This product includes software developed by
+Craft Metrics (https://craftmetrics.ca/).
+
+MIT License
+Copyright (c) 2018 Craft Metrics
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#ifndef ESP32_MCP342X_CALIBRATION_H
+#define ESP32_MCP342X_CALIBRATION_H
+
+#include "mcp342x.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/*-----------------------------------------------------------
+* MACROS & ENUMS
+*----------------------------------------------------------*/
+
+/** Largest serialised calibration table
+ * A 4 byte header, 9 bytes per entry that is not all zero and a 2 byte checksum.
+ */
+#define MCP342X_CALIBRATION_BLOB_MAX (4 + 9 * MCP342X_CALIBRATION_ENTRIES + 2)
+
+/*-----------------------------------------------------------
+* DEFINITIONS
+*----------------------------------------------------------*/
+
+/**
+ * @brief Average output codes of a known input with the current config
+ *        Calibration is bypassed while measuring. In one-shot mode every
+ *        sample is triggered, in continuous mode the running conversions are read.
+ *
+ * @param[in] mcp342x_info_ptr Pointer to MCP342x info instance.
+ * @param[in] samples Number of codes to average.
+ * @param[out] mean_q8 Mean output code in 1/256 LSB.
+ *
+ * @return ESP_OK if successful, ESP_ERR_INVALID_RESPONSE if a code saturated, otherwise an error constant.
+ */
+esp_err_t mcp342x_calibration_measure(mcp342x_info_t *mcp342x_info_ptr, uint16_t samples, int32_t *mean_q8);
+
+/**
+ * @brief Compute the calibration entry of a config from two measured reference inputs
+ *
+ * @param[in,out] calibration Calibration table to update.
+ * @param[in] config Config byte the measurements were taken with.
+ * @param[in] low_q8 Mean code measured for low_nv, from mcp342x_calibration_measure.
+ * @param[in] low_nv Low reference input in nanovolts, e.g. 0 for shorted inputs.
+ * @param[in] high_q8 Mean code measured for high_nv.
+ * @param[in] high_nv High reference input in nanovolts.
+ *
+ * @return ESP_OK if successful, ESP_ERR_INVALID_ARG if the points are degenerate or the gain is far off.
+ */
+esp_err_t mcp342x_calibration_two_point(mcp342x_calibration_t *calibration, uint8_t config,
+                                        int32_t low_q8, int32_t low_nv, int32_t high_q8, int32_t high_nv);
+
+/**
+ * @brief Serialise a calibration table into a compact blob, e.g. for nvs_set_blob
+ *        Only entries that are not all zero are stored.
+ *
+ * @param[in] calibration Calibration table.
+ * @param[out] blob Destination buffer.
+ * @param[in,out] len Size of blob, set to the bytes used.
+ *
+ * @return ESP_OK if successful, ESP_ERR_INVALID_SIZE if blob is too small.
+ */
+esp_err_t mcp342x_calibration_serialize(const mcp342x_calibration_t *calibration, uint8_t *blob, size_t *len);
+
+/**
+ * @brief Restore a calibration table from a blob made by mcp342x_calibration_serialize
+ *
+ * @param[out] calibration Calibration table, entries missing from the blob are cleared.
+ *                         Left unchanged if the blob is refused.
+ * @param[in] blob Serialised table.
+ * @param[in] len Size of blob.
+ *
+ * @return ESP_OK if successful, ESP_ERR_INVALID_VERSION, ESP_ERR_INVALID_SIZE or
+ *         ESP_ERR_INVALID_CRC if the blob is not a valid table.
+ */
+esp_err_t mcp342x_calibration_deserialize(mcp342x_calibration_t *calibration, const uint8_t *blob, size_t len);
+
+/**
+ * @brief Write a calibration table to a file as a serialised blob
+ *        Works on the host build and on any mounted VFS, e.g. SPIFFS or FAT.
+ *
+ * @param[in] calibration Calibration table.
+ * @param[in] path File to create or overwrite.
+ *
+ * @return ESP_OK if successful, ESP_ERR_NOT_FOUND if the file cannot be created, otherwise ESP_FAIL.
+ */
+esp_err_t mcp342x_calibration_save_file(const mcp342x_calibration_t *calibration, const char *path);
+
+/**
+ * @brief Restore a calibration table from a file made by mcp342x_calibration_save_file
+ *
+ * @param[out] calibration Calibration table, left unchanged if the file is refused.
+ * @param[in] path File to read.
+ *
+ * @return ESP_OK if successful, ESP_ERR_NOT_FOUND if the file does not exist, otherwise
+ *         the errors of mcp342x_calibration_deserialize or ESP_FAIL.
+ */
+esp_err_t mcp342x_calibration_load_file(mcp342x_calibration_t *calibration, const char *path);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // ESP32_MCP342X_CALIBRATION_H
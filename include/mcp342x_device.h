@@ -0,0 +1,164 @@
+/*
+Craft Metrics
+
+This product includes software developed by
+Craft Metrics (https://craftmetrics.ca/).
+
+MIT License
+Copyright (c) 2018 Craft Metrics
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#ifndef ESP32_MCP342X_DEVICE_H
+#define ESP32_MCP342X_DEVICE_H
+
+#include "mcp342x.h"
+
+#ifdef __cplusplus
+
+namespace cm
+{
+
+/** MCP342x family members
+ * MCP3421-MCP3424 support 18-bit conversions, MCP3425-MCP3428 stop at 16 bits
+ */
+enum class MCP342xVariant
+{
+    MCP3421,
+    MCP3422,
+    MCP3423,
+    MCP3424,
+    MCP3425,
+    MCP3426,
+    MCP3427,
+    MCP3428,
+};
+
+constexpr uint8_t mcp342x_channel_count(MCP342xVariant variant)
+{
+    return (variant == MCP342xVariant::MCP3421 || variant == MCP342xVariant::MCP3425)   ? 1
+           : (variant == MCP342xVariant::MCP3424 || variant == MCP342xVariant::MCP3428) ? 4
+                                                                                        : 2;
+}
+
+constexpr bool mcp342x_has_18bit(MCP342xVariant variant)
+{
+    return variant <= MCP342xVariant::MCP3424;
+}
+
+/** Device front end specialised for one variant at compile time
+ * Channels the part does not have and 18-bit mode on parts without it are
+ * rejected by static_assert. The device and bus state are held in the object,
+ * so no heap is used.
+ */
+template <MCP342xVariant V>
+class MCP342xDevice
+{
+  public:
+    static constexpr uint8_t Channels(void) { return mcp342x_channel_count(V); }
+    static constexpr bool Has18Bit(void) { return mcp342x_has_18bit(V); }
+
+    explicit MCP342xDevice(mcp342x_address_t in_address)
+        : address(in_address), smbus_info(), mcp342x_info()
+    {
+    }
+    MCP342xDevice(const MCP342xDevice &) = delete;
+    MCP342xDevice &operator=(const MCP342xDevice &) = delete;
+
+    template <mcp342x_channel_t C, mcp342x_sample_rate_t R, mcp342x_gain_t G>
+    esp_err_t Init(i2c_port_t in_i2c_master, mcp342x_conversion_mode_t in_mode = MCP342X_MODE_ONESHOT)
+    {
+        static_assert((C >> 5) < Channels(), "channel not available on this variant");
+        static_assert(R != MCP342X_SRATE_18BIT || Has18Bit(), "18-bit mode not available on this variant");
+
+        esp_err_t err = smbus_init(&this->smbus_info, in_i2c_master, this->address);
+        if (err != ESP_OK)
+        {
+            return err;
+        }
+        smbus_set_timeout(&this->smbus_info, 1000 / portTICK_RATE_MS);
+
+        mcp342x_config_t config;
+        config.channel = C;
+        config.conversion_mode = in_mode;
+        config.sample_rate = R;
+        config.gain = G;
+        return mcp342x_init(&this->mcp342x_info, &this->smbus_info, config);
+    }
+
+    esp_err_t StartNewConversion(void)
+    {
+        return mcp342x_start_new_conversion(&this->mcp342x_info);
+    }
+
+    template <mcp342x_channel_t C>
+    esp_err_t StartNewConversion(void)
+    {
+        static_assert((C >> 5) < Channels(), "channel not available on this variant");
+        mcp342x_set_channel(&this->mcp342x_info, C);
+        return mcp342x_start_new_conversion(&this->mcp342x_info);
+    }
+
+    mcp342x_conversion_status_t TryReadRaw(int32_t *code)
+    {
+        return mcp342x_poll_raw(&this->mcp342x_info, code);
+    }
+
+    mcp342x_conversion_status_t ReadRaw(int32_t *code)
+    {
+        return mcp342x_read_raw(&this->mcp342x_info, code);
+    }
+
+    mcp342x_conversion_status_t ReadNanovolts(int32_t *nanovolts)
+    {
+        return mcp342x_read_nanovolts(&this->mcp342x_info, nanovolts);
+    }
+
+    mcp342x_address_t GetAddress(void)
+    {
+        return this->address;
+    }
+
+    mcp342x_info_t *GetInfoPtr(void)
+    {
+        return &this->mcp342x_info;
+    }
+
+  private:
+    mcp342x_address_t address;
+    smbus_info_t smbus_info;
+    mcp342x_info_t mcp342x_info;
+};
+
+typedef MCP342xDevice<MCP342xVariant::MCP3421> MCP3421;
+typedef MCP342xDevice<MCP342xVariant::MCP3422> MCP3422;
+typedef MCP342xDevice<MCP342xVariant::MCP3423> MCP3423;
+typedef MCP342xDevice<MCP342xVariant::MCP3424> MCP3424;
+typedef MCP342xDevice<MCP342xVariant::MCP3425> MCP3425;
+typedef MCP342xDevice<MCP342xVariant::MCP3426> MCP3426;
+typedef MCP342xDevice<MCP342xVariant::MCP3427> MCP3427;
+typedef MCP342xDevice<MCP342xVariant::MCP3428> MCP3428;
+
+} // namespace cm
+
+#endif // __cplusplus
+
+#endif // ESP32_MCP342X_DEVICE_H
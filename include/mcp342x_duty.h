@@ -0,0 +1,95 @@
+/*
+Craft Metrics
+
+This product includes software developed by
+Craft Metrics (https://craftmetrics.ca/).
+
+MIT License
+Copyright (c) 2018 Craft Metrics
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#ifndef ESP32_MCP342X_DUTY_H
+#define ESP32_MCP342X_DUTY_H
+
+#include "mcp342x.h"
+
+#ifdef __cplusplus
+
+namespace cm
+{
+
+/** Cost model for the energy estimate of MCP342xDutyCycle
+ * nj_per_byte is the energy of one byte on the bus, address bytes included.
+ * awake_uw is the extra power drawn while the CPU is busy with a transfer
+ * instead of sleeping.
+ */
+typedef struct MCP342xEnergyModel
+{
+    uint32_t nj_per_byte;
+    uint32_t awake_uw;
+} mcp342x_energy_model_t;
+
+/** Duty-cycled one-shot sampling for battery powered nodes
+ * Each channel is sampled at its own period. A sample is triggered when due,
+ * the task sleeps until the expected completion and reads the result once,
+ * so the system can drop into light sleep for the rest of the time when
+ * tickless idle is enabled. Devices must be in one-shot mode.
+ * Collected samples carry the index of their channel in the order it was added.
+ * Next returns MCP342X_STATUS_INVALID_STATE until a channel has been added.
+ */
+class MCP342xDutyCycle
+{
+  public:
+    static const size_t MAX_CHANNELS = 8;
+
+    MCP342xDutyCycle(const mcp342x_energy_model_t &in_model);
+    esp_err_t AddChannel(MCP342x *device, mcp342x_channel_t channel, uint32_t period_us);
+    mcp342x_conversion_status_t Next(mcp342x_sample_t *sample);
+    uint64_t GetEnergyNj(void);
+    uint32_t GetEnergyPerSampleNj(void);
+    uint32_t GetAwakeUs(void);
+    void ResetEnergy(void);
+
+  private:
+    typedef struct Entry
+    {
+        MCP342x *device;
+        mcp342x_channel_t channel;
+        uint32_t period_us;
+        int64_t due_us;
+    } entry_t;
+
+    void Account(const mcp342x_stats_t *before, const mcp342x_stats_t *after, int64_t busy_us);
+
+    mcp342x_energy_model_t model;
+    entry_t entries[MAX_CHANNELS];
+    size_t count;
+    uint64_t energy_nj;
+    uint32_t awake_us;
+    uint32_t samples;
+};
+
+} // namespace cm
+
+#endif // __cplusplus
+
+#endif // ESP32_MCP342X_DUTY_H
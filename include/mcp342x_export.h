@@ -0,0 +1,167 @@
+/*
+Craft Metrics
+
+This product includes software developed by
+Craft Metrics (https://craftmetrics.ca/).
+
+MIT License
+Copyright (c) 2018 Craft Metrics
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#ifndef ESP32_MCP342X_EXPORT_H
+#define ESP32_MCP342X_EXPORT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/*-----------------------------------------------------------
+* MACROS & ENUMS
+*----------------------------------------------------------*/
+
+/** Binary export format
+ * A capture is a sequence of blocks, each holding samples of one config byte
+ * (channel, resolution and gain). All fields are little endian.
+ *
+ *   offset size
+ *   0      2    magic "MX"
+ *   2      1    format version
+ *   3      1    config byte
+ *   4      2    sample count
+ *   6      4    timestamp of the first sample in us
+ *   10     4    period in us, the interval between the first two samples
+ *
+ * followed by one record per sample: the change of the output code from the
+ * previous sample, then from the second sample on the deviation of the
+ * interval from the period. Both are zigzag encoded varints, so a slowly
+ * changing 18-bit signal at a steady rate costs 2 to 3 bytes per sample.
+ * This header only depends on the C library, the decoder builds on a host as is.
+ */
+#define MCP342X_EXPORT_HEADER_SIZE (14)
+#define MCP342X_EXPORT_VERSION (1)
+
+struct MCP342xSample;
+
+/** Encoder appending samples into a caller buffer
+ */
+typedef struct MCP342xExportEncoder
+{
+    uint8_t *buffer;
+    size_t capacity;
+    size_t length;
+    size_t block;
+    bool open;
+    uint8_t config;
+    uint16_t count;
+    int32_t last_code;
+    uint32_t last_us;
+    uint32_t period_us;
+    uint32_t skipped;
+} mcp342x_export_encoder_t;
+
+/** Sample as read back from an export
+ */
+typedef struct MCP342xExportRecord
+{
+    int32_t code;
+    uint32_t timestamp_us;
+    uint8_t config;
+} mcp342x_export_record_t;
+
+/** Decoder walking an export buffer
+ */
+typedef struct MCP342xExportDecoder
+{
+    const uint8_t *data;
+    size_t length;
+    size_t offset;
+    uint16_t remaining;
+    bool first;
+    uint8_t config;
+    int32_t code;
+    uint32_t timestamp_us;
+    uint32_t period_us;
+} mcp342x_export_decoder_t;
+
+/*-----------------------------------------------------------
+* DEFINITIONS
+*----------------------------------------------------------*/
+
+/**
+ * @brief Start an export into a caller buffer
+ *
+ * @param[out] encoder Pointer to encoder instance.
+ * @param[in] buffer Destination buffer, nothing is allocated.
+ * @param[in] capacity Size of buffer.
+ */
+void mcp342x_export_init(mcp342x_export_encoder_t *encoder, uint8_t *buffer, size_t capacity);
+
+/**
+ * @brief Append a sample, using its ready_us as timestamp
+ *        A new block is started when the config changes or the block is full.
+ *        Samples without an output code are counted in skipped and left out.
+ *        Interleaved channels each start a block, so export one channel per encoder.
+ *
+ * @param[in] encoder Pointer to encoder instance.
+ * @param[in] sample Sample record.
+ *
+ * @return true if the sample was appended or skipped, false if the buffer is full.
+ */
+bool mcp342x_export_append(mcp342x_export_encoder_t *encoder, const struct MCP342xSample *sample);
+
+/**
+ * @brief Finish the current block, writing its sample count
+ *        encoder->length is then the size of the export.
+ *
+ * @param[in] encoder Pointer to encoder instance.
+ */
+void mcp342x_export_close(mcp342x_export_encoder_t *encoder);
+
+/**
+ * @brief Start reading an export
+ *
+ * @param[out] decoder Pointer to decoder instance.
+ * @param[in] data Export data.
+ * @param[in] length Size of data.
+ */
+void mcp342x_export_decoder_init(mcp342x_export_decoder_t *decoder, const uint8_t *data, size_t length);
+
+/**
+ * @brief Read the next sample
+ *
+ * @param[in] decoder Pointer to decoder instance.
+ * @param[out] record Decoded sample.
+ *
+ * @return true if a sample was read, false at the end of the data or on malformed data.
+ */
+bool mcp342x_export_next(mcp342x_export_decoder_t *decoder, mcp342x_export_record_t *record);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // ESP32_MCP342X_EXPORT_H
@@ -0,0 +1,164 @@
+/*
+Craft Metrics
+
+This product includes software developed by
+Craft Metrics (https://craftmetrics.ca/).
+
+MIT License
+Copyright (c) 2018 Craft Metrics
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#ifndef ESP32_MCP342X_FILTER_H
+#define ESP32_MCP342X_FILTER_H
+
+#include "mcp342x.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/*-----------------------------------------------------------
+* MACROS & ENUMS
+*----------------------------------------------------------*/
+
+/** Digital filter applied to raw output codes before decimation
+ * BOXCAR sums each block of decimation codes
+ * CIC is a cascaded integrator-comb of the given order with a differential delay of 1
+ * MEDIAN takes the median of a moving window once every decimation codes
+ */
+typedef enum MCP342xFilterType
+{
+    MCP342X_FILTER_BOXCAR,
+    MCP342X_FILTER_CIC,
+    MCP342X_FILTER_MEDIAN,
+} mcp342x_filter_type_t;
+
+#define MCP342X_FILTER_CIC_MAX_ORDER (4)
+
+// Largest filter gain, keeping full scale 18-bit codes within 32 bits
+#define MCP342X_FILTER_MAX_GAIN (1 << 14)
+
+// Input range of the filters, the 18-bit output codes. Codes outside it are clamped.
+#define MCP342X_FILTER_CODE_MIN (-(1 << 17))
+#define MCP342X_FILTER_CODE_MAX ((1 << 17) - 1)
+
+/** Filter state, all storage is preallocated
+ * Outputs are in units of output codes multiplied by gain.
+ */
+typedef struct MCP342xFilter
+{
+    mcp342x_filter_type_t type;
+    uint16_t decimation;
+    uint16_t count;
+    uint32_t gain;
+    uint8_t order;
+    uint32_t integrator[MCP342X_FILTER_CIC_MAX_ORDER];
+    uint32_t comb[MCP342X_FILTER_CIC_MAX_ORDER];
+    int32_t *window;
+    uint16_t window_size;
+    uint16_t window_fill;
+    uint16_t window_pos;
+} mcp342x_filter_t;
+
+/*-----------------------------------------------------------
+* DEFINITIONS
+*----------------------------------------------------------*/
+
+/**
+ * @brief Initialise a boxcar filter summing blocks of codes
+ *
+ * @param[out] filter Pointer to filter instance.
+ * @param[in] decimation Number of codes per output, up to MCP342X_FILTER_MAX_GAIN.
+ *
+ * @return ESP_OK if successful, otherwise ESP_ERR_INVALID_ARG.
+ */
+esp_err_t mcp342x_filter_init_boxcar(mcp342x_filter_t *filter, uint16_t decimation);
+
+/**
+ * @brief Initialise a CIC decimation filter
+ *
+ * @param[out] filter Pointer to filter instance.
+ * @param[in] decimation Number of codes per output.
+ * @param[in] order Number of integrator and comb stages, up to MCP342X_FILTER_CIC_MAX_ORDER.
+ *
+ * @return ESP_OK if successful, ESP_ERR_INVALID_ARG if decimation^order exceeds MCP342X_FILTER_MAX_GAIN.
+ */
+esp_err_t mcp342x_filter_init_cic(mcp342x_filter_t *filter, uint16_t decimation, uint8_t order);
+
+/**
+ * @brief Initialise a moving median filter
+ *
+ * @param[out] filter Pointer to filter instance.
+ * @param[in] decimation Number of codes per output.
+ * @param[in] window_size Number of codes the median is taken over.
+ * @param[in] buffer Caller storage for 2 * window_size codes.
+ *
+ * @return ESP_OK if successful, otherwise ESP_ERR_INVALID_ARG.
+ */
+esp_err_t mcp342x_filter_init_median(mcp342x_filter_t *filter, uint16_t decimation, uint16_t window_size, int32_t *buffer);
+
+/**
+ * @brief Feed one output code into the filter
+ *
+ * @param[in] filter Pointer to filter instance.
+ * @param[in] code Sign-extended output code, clamped to MCP342X_FILTER_CODE_MIN thru
+ *                 MCP342X_FILTER_CODE_MAX so that sums at MCP342X_FILTER_MAX_GAIN can not wrap.
+ * @param[out] output Filter output scaled by filter->gain, written when one is produced.
+ *
+ * @return true when an output was produced.
+ */
+bool mcp342x_filter_push(mcp342x_filter_t *filter, int32_t code, int32_t *output);
+
+/**
+ * @brief Convert a filter output to nanovolts at the input
+ *
+ * @param[in] filter Pointer to filter instance.
+ * @param[in] mcp342x_info_ptr Pointer to MCP342x info instance the codes came from.
+ * @param[in] output Filter output.
+ *
+ * @return Input voltage in nanovolts.
+ */
+int32_t mcp342x_filter_to_nanovolts(const mcp342x_filter_t *filter, const mcp342x_info_t *mcp342x_info_ptr, int32_t output);
+
+/**
+ * @brief Choose between hardware resolution and oversampling for a latency budget
+ *        Picks the sample rate and decimation with the lowest expected noise,
+ *        assuming averaging N codes reduces noise by sqrt(N). Ties go to the
+ *        higher hardware resolution, which needs fewer bus transfers.
+ *        Conversions are budgeted at the slowest datasheet data rate, so
+ *        the latency holds for parts with a slow internal oscillator.
+ *
+ * @param[in] max_latency_us Time allowed for one filtered output.
+ * @param[in] has_18bit Whether the device supports 18-bit conversions.
+ * @param[out] sample_rate Chosen sample rate.
+ * @param[out] decimation Chosen number of codes per output.
+ *
+ * @return ESP_OK if successful, ESP_ERR_NOT_FOUND if even a single 12-bit conversion takes too long.
+ */
+esp_err_t mcp342x_filter_plan(uint32_t max_latency_us, bool has_18bit, mcp342x_sample_rate_t *sample_rate, uint16_t *decimation);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // ESP32_MCP342X_FILTER_H
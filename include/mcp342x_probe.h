@@ -0,0 +1,96 @@
+/*
+Craft Metrics
+
+This product includes software developed by
+Craft Metrics (https://craftmetrics.ca/).
+
+MIT License
+Copyright (c) 2018 Craft Metrics
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+
+#ifndef ESP32_MCP342X_PROBE_H
+#define ESP32_MCP342X_PROBE_H
+
+#include "mcp342x.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/*-----------------------------------------------------------
+* MACROS & ENUMS
+*----------------------------------------------------------*/
+
+// Number of addresses an MCP342x can answer on, 0x68 thru 0x6F
+#define MCP342X_PROBE_ADDRESSES (8)
+
+/** Device found by mcp342x_probe
+ * identified is set when the output register layout could be read back, has_18bit then
+ * tells the 18 bit parts from the 16 bit ones. channels is 1 if the channel bits are
+ * unimplemented, otherwise 0 for unknown: two and four channel parts can not be told apart.
+ * mcp342x_info is initialised and points at smbus_info, so results must not be copied or moved.
+ */
+typedef struct MCP342xProbeResult
+{
+    mcp342x_address_t address;
+    bool identified;
+    uint8_t channels;
+    bool has_18bit;
+    smbus_info_t smbus_info;
+    mcp342x_info_t mcp342x_info;
+} mcp342x_probe_result_t;
+
+/*-----------------------------------------------------------
+* DEFINITIONS
+*----------------------------------------------------------*/
+
+/**
+ * @brief Find every MCP342x on an i2c port and identify its variant
+ *        A general call latch first resolves the address pins, then one write
+ *        per address finds the devices. The variant tests run on all devices
+ *        at once: a single general call triggers an 18 bit conversion on every
+ *        device, then the output register is read before and after a config write
+ *        that changes the gain and channel bits without converting. Both results
+ *        come from the config bits and the register layout, never from the data.
+ *        This takes about 270 ms whatever the number of devices. The general calls reach every
+ *        MCP342x on the port.
+ *
+ * @param[in] i2c_port I2C port to sweep.
+ * @param[in] bus Bus backend for the devices, or NULL for mcp342x_i2c_bus.
+ * @param[in] in_config Configuration loaded into every device found.
+ * @param[out] results Storage for up to max_results devices, in address order.
+ * @param[in] max_results Number of entries in results, at most MCP342X_PROBE_ADDRESSES are used.
+ * @param[out] found Number of devices found.
+ *
+ * @return ESP_OK if successful, ESP_ERR_NOT_FOUND if no device answered,
+ *         ESP_ERR_INVALID_ARG if results or found is NULL.
+ */
+esp_err_t mcp342x_probe(i2c_port_t i2c_port, const mcp342x_bus_t *bus, mcp342x_config_t in_config,
+                        mcp342x_probe_result_t *results, size_t max_results, size_t *found);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // ESP32_MCP342X_PROBE_H
@@ -0,0 +1,81 @@
+/*
+Craft Metrics
+
+This product includes software developed by
+Craft Metrics (https://craftmetrics.ca/).
+
+MIT License
+Copyright (c) 2018 Craft Metrics
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#ifndef ESP32_MCP342X_SCHEDULER_H
+#define ESP32_MCP342X_SCHEDULER_H
+
+#include "mcp342x.h"
+
+#ifdef __cplusplus
+
+namespace cm
+{
+
+/** Pipelines conversions across several MCP342x devices
+ * Every device converts in parallel; results are harvested in order of
+ * their expected completion time and the next channel is triggered straight away.
+ * channel_mask selects the channels to cycle through, bit 0 is channel 1.
+ * Collected samples carry the index of their device in the order it was added.
+ * A failed trigger yields an MCP342X_STATUS_I2C sample for its channel one conversion
+ * time later, so Collect still returns when a device or the whole bus is down.
+ */
+class MCP342xScheduler
+{
+  public:
+    static const size_t MAX_DEVICES = 8;
+
+    MCP342xScheduler();
+    esp_err_t AddDevice(MCP342x *device, uint8_t channel_mask);
+    esp_err_t Start(void);
+    size_t Collect(mcp342x_sample_t *samples, size_t max_samples);
+
+  private:
+    typedef struct Slot
+    {
+        MCP342x *device;
+        uint8_t channel_mask;
+        uint8_t channel_index;
+        bool triggered;
+        int64_t deadline_us;
+    } slot_t;
+
+    esp_err_t Trigger(uint8_t slot);
+    void Enqueue(uint8_t slot);
+
+    slot_t slots[MAX_DEVICES];
+    uint8_t queue[MAX_DEVICES];
+    size_t count;
+    size_t queued;
+};
+
+} // namespace cm
+
+#endif // __cplusplus
+
+#endif // ESP32_MCP342X_SCHEDULER_H
@@ -0,0 +1,95 @@
+/*
+Craft Metrics
+
+This product includes software developed by
+Craft Metrics (https://craftmetrics.ca/).
+
+MIT License
+Copyright (c) 2018 Craft Metrics
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#ifndef ESP32_MCP342X_STREAM_H
+#define ESP32_MCP342X_STREAM_H
+
+#include "mcp342x.h"
+
+#ifdef __cplusplus
+
+#include <atomic>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/semphr.h>
+#include <esp_timer.h>
+
+namespace cm
+{
+
+/** Continuous mode reader
+ * A producer task reads every new continuous mode result once, detected
+ * through the ready bit, and pushes it into a single-producer single-consumer
+ * ring buffer as a sample record. The buffer is provided by the caller and its capacity must be
+ * a power of two. A single consumer drains it in batches with Drain().
+ * The producer sleeps on an esp_timer rather than the tick, so 240 samples/s
+ * keep up with the default 100 Hz tick rate.
+ * Start() switches the device to continuous mode, Stop() puts it back in the
+ * mode it had before.
+ * Overruns counts samples dropped because the buffer was full,
+ * Missed counts conversions the producer did not read in time.
+ */
+class MCP342xStream
+{
+  public:
+    MCP342xStream(MCP342x *in_device, mcp342x_sample_t *in_buffer, size_t in_capacity);
+    ~MCP342xStream();
+    esp_err_t Start(UBaseType_t priority);
+    esp_err_t Stop(void);
+    size_t Drain(mcp342x_sample_t *samples, size_t max_samples);
+    uint32_t GetOverruns(void);
+    uint32_t GetMissed(void);
+
+  private:
+    static void Task(void *arg);
+    static void OnTimer(void *arg);
+    void Run(void);
+    void Sleep(int64_t delay_us);
+    esp_err_t SetMode(mcp342x_conversion_mode_t mode);
+    void Push(const mcp342x_sample_t *sample);
+
+    MCP342x *device;
+    mcp342x_sample_t *buffer;
+    uint32_t mask;
+    std::atomic<uint32_t> head;
+    std::atomic<uint32_t> tail;
+    std::atomic<bool> running;
+    std::atomic<uint32_t> overruns;
+    std::atomic<uint32_t> missed;
+    TaskHandle_t task;
+    SemaphoreHandle_t stopped;
+    esp_timer_handle_t timer;
+    mcp342x_conversion_mode_t saved_mode;
+};
+
+} // namespace cm
+
+#endif // __cplusplus
+
+#endif // ESP32_MCP342X_STREAM_H
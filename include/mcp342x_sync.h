@@ -0,0 +1,71 @@
+/*
+Craft Metrics
+
+This product includes software developed by
+Craft Metrics (https://craftmetrics.ca/).
+
+MIT License
+Copyright (c) 2018 Craft Metrics
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#ifndef ESP32_MCP342X_SYNC_H
+#define ESP32_MCP342X_SYNC_H
+
+#include "mcp342x.h"
+
+#ifdef __cplusplus
+
+namespace cm
+{
+
+/** Phase-coherent sampling of several MCP342x devices on one bus
+ * Configure() loads every device's configuration in one-shot mode,
+ * Trigger() starts all conversions with a single general call and
+ * Collect() reads one sample per device, all sharing the trigger time as start_us.
+ * Every sample is filled in, but Collect() returns ESP_ERR_TIMEOUT or ESP_FAIL
+ * if any of them does not have MCP342X_STATUS_OK.
+ * The general call reaches every MCP342x on the port, including devices
+ * that are not part of the group.
+ */
+class MCP342xSyncGroup
+{
+  public:
+    static const size_t MAX_DEVICES = 8;
+
+    MCP342xSyncGroup();
+    esp_err_t AddDevice(MCP342x *device);
+    esp_err_t Configure(void);
+    esp_err_t Trigger(void);
+    esp_err_t Collect(mcp342x_sample_t *samples);
+
+  private:
+    MCP342x *devices[MAX_DEVICES];
+    size_t count;
+    bool triggered;
+    int64_t trigger_us;
+};
+
+} // namespace cm
+
+#endif // __cplusplus
+
+#endif // ESP32_MCP342X_SYNC_H
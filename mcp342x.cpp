@@ -27,9 +27,14 @@
 */
 
 #include "mcp342x.h"
+#include "mcp342x_priv.h"
 
 #include <string.h>
+#include <sdkconfig.h>
 #include <esp_log.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
 #include <smbus.h>
 
 static const char *TAG = "mcp342x";
@@ -58,12 +63,386 @@ static bool _is_init(const mcp342x_info_t *mcp342x_info_ptr)
     return ok;
 }
 
+void mcp342x_delay_us(int64_t delay_us)
+{
+    mcp342x_delay_until_us(esp_timer_get_time() + delay_us);
+}
+
+void mcp342x_delay_until_us(int64_t until_us)
+{
+    /**
+     * Block for whole ticks, rounded up. A delay of n ticks ends at the n-th tick
+     * interrupt, which can come up to a tick early, so sleep again until the time has passed.
+     */
+    int64_t tick_us = 1000000 / configTICK_RATE_HZ;
+    for (int64_t now_us = esp_timer_get_time(); now_us < until_us; now_us = esp_timer_get_time())
+    {
+        vTaskDelay((until_us - now_us + tick_us - 1) / tick_us);
+    }
+}
+
+/**
+ * Decoding parameters for each sample rate and gain, indexed by the config
+ * bits MCP342X_SRATE_MASK | MCP342X_GAIN_MASK
+ */
+typedef struct MCP342xDecode
+{
+    uint8_t data_bytes;
+    uint32_t mask;
+    uint32_t sign;
+    int32_t code_min;
+    int32_t code_max;
+    uint32_t lsb_nv_q3;
+} mcp342x_decode_t;
+
+/**
+ * LSB size in 1/8 nV: 1 mV, 250 uV, 62.5 uV and 15.625 uV at 12, 14, 16 and 18 bits,
+ * divided by the PGA gain
+ */
+static constexpr mcp342x_decode_t _decode_entry(uint8_t bits, uint8_t gain)
+{
+    return {static_cast<uint8_t>(bits == 18 ? 3 : 2),
+            (1U << bits) - 1,
+            1U << (bits - 1),
+            -static_cast<int32_t>(1U << (bits - 1)),
+            static_cast<int32_t>(1U << (bits - 1)) - 1,
+            (8000000U >> (bits - 12)) >> gain};
+}
+
+static constexpr mcp342x_decode_t MCP342X_DECODE[16] = {
+    _decode_entry(12, 0), _decode_entry(12, 1), _decode_entry(12, 2), _decode_entry(12, 3),
+    _decode_entry(14, 0), _decode_entry(14, 1), _decode_entry(14, 2), _decode_entry(14, 3),
+    _decode_entry(16, 0), _decode_entry(16, 1), _decode_entry(16, 2), _decode_entry(16, 3),
+    _decode_entry(18, 0), _decode_entry(18, 1), _decode_entry(18, 2), _decode_entry(18, 3),
+};
+
+static_assert(MCP342X_DECODE[MCP342X_SRATE_12BIT | MCP342X_GAIN_1X].code_max == 2047, "12-bit full scale");
+static_assert(MCP342X_DECODE[MCP342X_SRATE_16BIT | MCP342X_GAIN_2X].data_bytes == 2, "16-bit data bytes");
+static_assert(MCP342X_DECODE[MCP342X_SRATE_18BIT | MCP342X_GAIN_1X].code_min == -131072, "18-bit full scale");
+static_assert(MCP342X_DECODE[MCP342X_SRATE_18BIT | MCP342X_GAIN_8X].lsb_nv_q3 == 15625, "18-bit 8x LSB");
+
+static const mcp342x_decode_t *_decode_params(uint8_t config)
+{
+    return &MCP342X_DECODE[config & (MCP342X_SRATE_MASK | MCP342X_GAIN_MASK)];
+}
+
+/**
+ * Default backend: plain i2c transfers on the port, address and timeout of the smbus info
+ */
+static esp_err_t _i2c_write(void *, const smbus_info_t *smbus_info, const uint8_t *data, size_t len)
+{
+    i2c_cmd_handle_t cmd = i2c_cmd_link_create();
+    if (cmd == NULL)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    i2c_master_start(cmd);
+    i2c_master_write_byte(cmd, (smbus_info->address << 1) | I2C_MASTER_WRITE, true);
+    i2c_master_write(cmd, (uint8_t *)data, len, true);
+    i2c_master_stop(cmd);
+    esp_err_t err = i2c_master_cmd_begin(smbus_info->i2c_port, cmd, smbus_info->timeout);
+    i2c_cmd_link_delete(cmd);
+    return err;
+}
+
+static esp_err_t _i2c_read(void *, const smbus_info_t *smbus_info, uint8_t *data, size_t len)
+{
+    i2c_cmd_handle_t cmd = i2c_cmd_link_create();
+    if (cmd == NULL)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    i2c_master_start(cmd);
+    i2c_master_write_byte(cmd, (smbus_info->address << 1) | I2C_MASTER_READ, true);
+    if (len > 1)
+    {
+        i2c_master_read(cmd, data, len - 1, I2C_MASTER_ACK);
+    }
+    i2c_master_read_byte(cmd, &data[len - 1], I2C_MASTER_NACK);
+    i2c_master_stop(cmd);
+    esp_err_t err = i2c_master_cmd_begin(smbus_info->i2c_port, cmd, smbus_info->timeout);
+    i2c_cmd_link_delete(cmd);
+    return err;
+}
+
+const mcp342x_bus_t mcp342x_i2c_bus = {NULL, _i2c_write, _i2c_read};
+
+static const mcp342x_bus_t *_bus(const mcp342x_info_t *mcp342x_info_ptr)
+{
+    return mcp342x_info_ptr->bus != NULL ? mcp342x_info_ptr->bus : &mcp342x_i2c_bus;
+}
+
+/**
+ * Charge a transfer that failed all its retries against the error budget,
+ * successful transfers pay it back one at a time
+ */
+static void _account_transfer(mcp342x_info_t *mcp342x_info_ptr, esp_err_t err)
+{
+    mcp342x_recovery_t *recovery = &mcp342x_info_ptr->recovery;
+    if (err == ESP_OK)
+    {
+        if (recovery->errors > 0)
+        {
+            recovery->errors--;
+        }
+        return;
+    }
+    if (recovery->error_budget == 0 || mcp342x_info_ptr->recovering)
+    {
+        return;
+    }
+    if (++recovery->errors > recovery->error_budget)
+    {
+        if (mcp342x_recover(mcp342x_info_ptr) != ESP_OK)
+        {
+            ESP_LOGW(TAG, "device 0x%02x degraded", mcp342x_info_ptr->smbus_info->address);
+        }
+    }
+}
+
+/**
+ * One bus transfer with bounded retries and exponential backoff.
+ * Degraded devices fail straight away without touching the bus.
+ */
+static esp_err_t _bus_transfer(mcp342x_info_t *mcp342x_info_ptr, const smbus_info_t *smbus_info, uint8_t *data, size_t len, bool read)
+{
+    if (mcp342x_info_ptr->degraded)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    const mcp342x_bus_t *bus = _bus(mcp342x_info_ptr);
+    uint32_t backoff_us = mcp342x_info_ptr->recovery.backoff_us;
+    esp_err_t err;
+    for (uint8_t attempt = 0;; attempt++)
+    {
+        if (read)
+        {
+            mcp342x_info_ptr->stats.bytes_read += len + 1;
+            err = bus->read(bus->context, smbus_info, data, len);
+        }
+        else
+        {
+            mcp342x_info_ptr->stats.bytes_written += len + 1;
+            err = bus->write(bus->context, smbus_info, data, len);
+        }
+        if (err == ESP_OK || attempt >= mcp342x_info_ptr->recovery.max_retries)
+        {
+            break;
+        }
+        mcp342x_info_ptr->stats.retries++;
+        mcp342x_delay_us(backoff_us);
+        if (backoff_us <= MCP342X_RECOVERY_BACKOFF_MAX_US / 2)
+        {
+            backoff_us *= 2;
+        }
+        else if (backoff_us < MCP342X_RECOVERY_BACKOFF_MAX_US)
+        {
+            backoff_us = MCP342X_RECOVERY_BACKOFF_MAX_US;
+        }
+    }
+    _account_transfer(mcp342x_info_ptr, err);
+    return err;
+}
+
+static esp_err_t _bus_write(mcp342x_info_t *mcp342x_info_ptr, const smbus_info_t *smbus_info, const uint8_t *data, size_t len)
+{
+    return _bus_transfer(mcp342x_info_ptr, smbus_info, (uint8_t *)data, len, false);
+}
+
+/**
+ * Keep the shadow in step with the device, a failed write leaves its config unknown
+ */
+static esp_err_t _send_config(mcp342x_info_t *mcp342x_info_ptr, uint8_t config)
+{
+    esp_err_t err = _bus_write(mcp342x_info_ptr, mcp342x_info_ptr->smbus_info, &config, 1);
+    mcp342x_info_ptr->shadow_config = config & ~MCP342X_CNTRL_MASK;
+    mcp342x_info_ptr->shadow_valid = (err == ESP_OK);
+    return err;
+}
+
+static bool _shadow_matches(const mcp342x_info_t *mcp342x_info_ptr)
+{
+    return mcp342x_info_ptr->shadow_valid && mcp342x_info_ptr->shadow_config == mcp342x_info_ptr->config;
+}
+
+static uint8_t _config_byte(mcp342x_config_t in_config)
+{
+    return ((in_config.conversion_mode & MCP342X_MODE_MASK) |
+            (in_config.channel & MCP342X_CHANNEL_MASK) |
+            (in_config.gain & MCP342X_GAIN_MASK) |
+            (in_config.sample_rate & MCP342X_SRATE_MASK));
+}
+
+mcp342x_config_t mcp342x_config_from_byte(uint8_t config)
+{
+    mcp342x_config_t in_config;
+    in_config.channel = (mcp342x_channel_t)(config & MCP342X_CHANNEL_MASK);
+    in_config.conversion_mode = (mcp342x_conversion_mode_t)(config & MCP342X_MODE_MASK);
+    in_config.sample_rate = (mcp342x_sample_rate_t)(config & MCP342X_SRATE_MASK);
+    in_config.gain = (mcp342x_gain_t)(config & MCP342X_GAIN_MASK);
+    return in_config;
+}
+
+/**
+ * Read the output register, the data bytes followed by the config byte.
+ * No command byte is needed, so this is 3 bytes up to 16 bits and 4 bytes at 18 bits.
+ */
+static esp_err_t _read_output(mcp342x_info_t *mcp342x_info_ptr, uint8_t *buffer, size_t len)
+{
+    mcp342x_info_ptr->stats.polls++;
+    esp_err_t err = _bus_transfer(mcp342x_info_ptr, mcp342x_info_ptr->smbus_info, buffer, len, true);
+    MCP342X_SAMPLE_LOGV(TAG, "%02x %02x %02x %02x", buffer[0], buffer[1], buffer[2], buffer[3]);
+    return err;
+}
+
+/**
+ * The output saturates at the full scale codes, calibrated codes are clamped to them
+ */
+static mcp342x_conversion_status_t _full_scale_status(uint8_t config, int32_t code)
+{
+    const mcp342x_decode_t *decode = _decode_params(config);
+    if (code >= decode->code_max)
+    {
+        return MCP342X_STATUS_OVERFLOW;
+    }
+    if (code <= decode->code_min)
+    {
+        return MCP342X_STATUS_UNDERFLOW;
+    }
+    return MCP342X_STATUS_OK;
+}
+
+mcp342x_conversion_status_t mcp342x_output_code(uint8_t config, const uint8_t *buffer, int32_t *code)
+{
+    const mcp342x_decode_t *decode = _decode_params(config);
+    uint32_t raw = (buffer[0] << 16) | (buffer[1] << 8) | buffer[2];
+    raw = (raw >> (8 * (3 - decode->data_bytes))) & decode->mask;
+    *code = (int32_t)(raw ^ decode->sign) - (int32_t)decode->sign;
+
+    return _full_scale_status(config, *code);
+}
+
+static void _record_latency(mcp342x_stats_t *stats, uint32_t latency_us)
+{
+    if (stats->samples == 0 || latency_us < stats->latency_min_us)
+    {
+        stats->latency_min_us = latency_us;
+    }
+    if (latency_us > stats->latency_max_us)
+    {
+        stats->latency_max_us = latency_us;
+    }
+    stats->latency_sum_us += latency_us;
+
+    uint8_t bucket = 0;
+    for (uint32_t units = latency_us / MCP342X_LATENCY_UNIT_US; units != 0 && bucket < MCP342X_LATENCY_BUCKETS - 1; units >>= 1)
+    {
+        bucket++;
+    }
+    stats->latency_histogram[bucket]++;
+}
+
+/**
+ * Under- and overflow results still carry the saturated output code
+ */
+static bool _has_code(mcp342x_conversion_status_t status)
+{
+    return status == MCP342X_STATUS_OK || status == MCP342X_STATUS_UNDERFLOW || status == MCP342X_STATUS_OVERFLOW;
+}
+
+/**
+ * Cache the fixed-point LSB size for the current sample rate and gain
+ */
+static void _update_scale(mcp342x_info_t *mcp342x_info_ptr)
+{
+    mcp342x_info_ptr->lsb_nv_q3 = _decode_params(mcp342x_info_ptr->config)->lsb_nv_q3;
+}
+
+static_assert(sizeof(mcp342x_sample_t) == 16, "sample record size");
+
+/**
+ * Record a result of the conversion started at start_us. The output register
+ * only says the result is ready, so completion is estimated from the data rate.
+ */
+static void _fill_sample(const mcp342x_info_t *mcp342x_info_ptr, mcp342x_sample_t *sample,
+                         mcp342x_conversion_status_t status, int32_t code, int64_t start_us)
+{
+    int64_t now_us = esp_timer_get_time();
+    int64_t ready_us = start_us + mcp342x_conversion_time_us((mcp342x_sample_rate_t)(mcp342x_info_ptr->config & MCP342X_SRATE_MASK));
+    bool has_code = _has_code(status);
+
+    sample->code = has_code ? code : 0;
+    sample->start_us = (uint32_t)start_us;
+    sample->ready_us = (uint32_t)(ready_us < now_us ? ready_us : now_us);
+    sample->config = has_code ? mcp342x_info_ptr->result_config : mcp342x_info_ptr->config;
+    sample->status = status;
+    sample->device = 0;
+    sample->reserved = 0;
+}
+
+#if defined(CONFIG_MCP342X_STATIC_POOL_SIZE) && CONFIG_MCP342X_STATIC_POOL_SIZE > 0
+#define MCP342X_POOL_SIZE CONFIG_MCP342X_STATIC_POOL_SIZE
+
+/**
+ * Static pool backing mcp342x_malloc, so no heap is used after boot
+ */
+static mcp342x_info_t _pool[MCP342X_POOL_SIZE];
+static bool _pool_used[MCP342X_POOL_SIZE];
+static portMUX_TYPE _pool_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static mcp342x_info_t *_pool_alloc(void)
+{
+    mcp342x_info_t *mcp342x_info = NULL;
+    portENTER_CRITICAL(&_pool_lock);
+    for (size_t i = 0; i < MCP342X_POOL_SIZE; i++)
+    {
+        if (!_pool_used[i])
+        {
+            _pool_used[i] = true;
+            mcp342x_info = &_pool[i];
+            break;
+        }
+    }
+    portEXIT_CRITICAL(&_pool_lock);
+    return mcp342x_info;
+}
+
+/**
+ * Instances not taken from the pool, or freed twice, are left alone
+ */
+static void _pool_free(mcp342x_info_t *mcp342x_info)
+{
+    uintptr_t offset = (uintptr_t)mcp342x_info - (uintptr_t)_pool;
+    size_t index = offset / sizeof(_pool[0]);
+    if ((uintptr_t)mcp342x_info < (uintptr_t)_pool || index >= MCP342X_POOL_SIZE || offset % sizeof(_pool[0]) != 0)
+    {
+        ESP_LOGE(TAG, "free mcp342x_info_t %p not from the pool", mcp342x_info);
+        return;
+    }
+    bool used;
+    portENTER_CRITICAL(&_pool_lock);
+    used = _pool_used[index];
+    _pool[index].init = false;
+    _pool_used[index] = false;
+    portEXIT_CRITICAL(&_pool_lock);
+    if (!used)
+    {
+        ESP_LOGE(TAG, "free mcp342x_info_t %p already free", mcp342x_info);
+    }
+}
+#endif
+
 /*-----------------------------------------------------------
 * PUBLIC C API
 *----------------------------------------------------------*/
 mcp342x_info_t *mcp342x_malloc(void)
 {
+#ifdef MCP342X_POOL_SIZE
+    mcp342x_info_t *mcp342x_info = _pool_alloc();
+#else
     mcp342x_info_t *mcp342x_info = (mcp342x_info_t *)malloc(sizeof(*mcp342x_info));
+#endif
     if (mcp342x_info != NULL)
     {
         memset(mcp342x_info, 0, sizeof(*mcp342x_info));
@@ -80,10 +459,13 @@ void mcp342x_free(mcp342x_info_t **mcp342x_info_ptr_ptr)
 {
     if (mcp342x_info_ptr_ptr != NULL && (*mcp342x_info_ptr_ptr != NULL))
     {
-        (*mcp342x_info_ptr_ptr)->init = false;
-
         ESP_LOGD(TAG, "free mcp342x_info_t %p", *mcp342x_info_ptr_ptr);
+#ifdef MCP342X_POOL_SIZE
+        _pool_free(*mcp342x_info_ptr_ptr);
+#else
+        (*mcp342x_info_ptr_ptr)->init = false;
         free(*mcp342x_info_ptr_ptr);
+#endif
         *mcp342x_info_ptr_ptr = NULL;
     }
     else
@@ -105,13 +487,14 @@ esp_err_t mcp342x_init(mcp342x_info_t *mcp342x_info_ptr, smbus_info_t *smbus_inf
         ESP_LOGD(TAG, "config.gain = 0x%02x", in_config.gain);
         ESP_LOGD(TAG, "config.sample_rate = 0x%02x", in_config.sample_rate);
         mcp342x_info_ptr->smbus_info = smbus_info_ptr;
-        mcp342x_info_ptr->config = ((in_config.conversion_mode & MCP342X_MODE_MASK) |
-                                    (in_config.channel & MCP342X_CHANNEL_MASK) |
-                                    (in_config.gain & MCP342X_GAIN_MASK) |
-                                    (in_config.sample_rate & MCP342X_SRATE_MASK));
+        mcp342x_info_ptr->config = _config_byte(in_config);
+        mcp342x_info_ptr->shadow_valid = false;
+        mcp342x_info_ptr->degraded = false;
+        _update_scale(mcp342x_info_ptr);
         // Test connection
         ESP_LOGD(TAG, "send mcp342x_info config 0x%02x", mcp342x_info_ptr->config);
-        err = smbus_send_byte(smbus_info_ptr, mcp342x_info_ptr->config);
+        err = _send_config(mcp342x_info_ptr, mcp342x_info_ptr->config);
+        mcp342x_info_ptr->conversion_start_us = esp_timer_get_time();
     }
     else
     {
@@ -122,114 +505,371 @@ esp_err_t mcp342x_init(mcp342x_info_t *mcp342x_info_ptr, smbus_info_t *smbus_inf
 
 void mcp342x_set_config(mcp342x_info_t *mcp342x_info_ptr, mcp342x_config_t in_config)
 {
-    mcp342x_info_ptr->config = (in_config.channel |
-                                in_config.conversion_mode |
-                                in_config.gain |
-                                in_config.sample_rate);
+    mcp342x_info_ptr->config = _config_byte(in_config);
+    _update_scale(mcp342x_info_ptr);
     return;
 }
 
-esp_err_t mcp342x_general_call(const mcp342x_info_t *mcp342x_info_ptr, mcp342x_general_call_t call)
+void mcp342x_set_channel(mcp342x_info_t *mcp342x_info_ptr, mcp342x_channel_t in_channel)
 {
-    return smbus_write_byte(mcp342x_info_ptr->smbus_info, MCP342X_GC_START, call);
+    /**
+     * Swap out the channel bits by first zeroing and then OR with new channel
+     */
+    if ((mcp342x_info_ptr->config & MCP342X_CHANNEL_MASK) != (in_channel & MCP342X_CHANNEL_MASK))
+    {
+        MCP342X_SAMPLE_LOGD(TAG, "Channel swap: %02x -> %02x", (mcp342x_info_ptr->config & MCP342X_CHANNEL_MASK), in_channel);
+        mcp342x_info_ptr->stats.channel_swaps++;
+        mcp342x_info_ptr->config = ((mcp342x_info_ptr->config & ~MCP342X_CHANNEL_MASK) | (in_channel & MCP342X_CHANNEL_MASK));
+    }
 }
 
-esp_err_t mcp342x_start_new_conversion(const mcp342x_info_t *mcp342x_info_ptr)
+void mcp342x_invalidate_config(mcp342x_info_t *mcp342x_info_ptr)
 {
-    esp_err_t err = ESP_FAIL;
-    if (_is_init(mcp342x_info_ptr))
-    {
-        err = smbus_send_byte(mcp342x_info_ptr->smbus_info, mcp342x_info_ptr->config | MCP342X_CNTRL_TRIGGER_CONVERSION);
-    }
+    mcp342x_info_ptr->shadow_valid = false;
+}
+
+void mcp342x_set_bus(mcp342x_info_t *mcp342x_info_ptr, const mcp342x_bus_t *bus)
+{
+    mcp342x_info_ptr->bus = bus;
+}
+
+void mcp342x_set_wait_mode(mcp342x_info_t *mcp342x_info_ptr, mcp342x_wait_mode_t wait_mode)
+{
+    mcp342x_info_ptr->wait_mode = wait_mode;
+}
+
+void mcp342x_set_recovery(mcp342x_info_t *mcp342x_info_ptr, uint8_t max_retries, uint32_t backoff_us, uint16_t error_budget)
+{
+    mcp342x_info_ptr->recovery.max_retries = max_retries;
+    mcp342x_info_ptr->recovery.backoff_us = backoff_us;
+    mcp342x_info_ptr->recovery.error_budget = error_budget;
+    mcp342x_info_ptr->recovery.errors = 0;
+}
+
+esp_err_t mcp342x_recover(mcp342x_info_t *mcp342x_info_ptr)
+{
+    /**
+     * Transfers made while recovering neither retry recovery nor see the degraded flag.
+     * Only this device's config is resent: a general call reset would also reset the
+     * other devices on the port behind the backs of their shadows.
+     */
+    mcp342x_info_ptr->recovering = true;
+    mcp342x_info_ptr->degraded = false;
+    mcp342x_info_ptr->stats.recoveries++;
+
+    mcp342x_info_ptr->shadow_valid = false;
+    esp_err_t err = mcp342x_write_config(mcp342x_info_ptr);
+    mcp342x_info_ptr->recovery.errors = 0;
+    mcp342x_info_ptr->degraded = (err != ESP_OK);
+    mcp342x_info_ptr->recovering = false;
     return err;
 }
 
-mcp342x_conversion_status_t mcp342x_read_result(const mcp342x_info_t *mcp342x_info_ptr, double *result)
+void mcp342x_set_calibration(mcp342x_info_t *mcp342x_info_ptr, const mcp342x_calibration_t *calibration)
 {
-    int32_t i32;
-    uint8_t buffer[5] = {};
+    mcp342x_info_ptr->calibration = calibration;
+}
+
+uint8_t mcp342x_calibration_index(uint8_t config)
+{
+    return ((config & MCP342X_CHANNEL_MASK) >> 1) | (config & (MCP342X_SRATE_MASK | MCP342X_GAIN_MASK));
+}
+
+int32_t mcp342x_calibrate_code(const mcp342x_calibration_t *calibration, uint8_t config, int32_t code)
+{
+    /**
+     * One 64-bit multiply per code: 26-bit offset corrected value times a trim well below 2^31
+     */
+    const mcp342x_calibration_entry_t *entry = &calibration->entry[mcp342x_calibration_index(config)];
+    int64_t value_q8 = (int64_t)code * 256 - entry->offset_q8;
+    value_q8 += (value_q8 * entry->gain_trim_q24) >> MCP342X_CALIBRATION_TRIM_SHIFT;
+    int64_t corrected = (value_q8 + 128) >> 8;
 
-    do
+    /**
+     * Corrections never leave the output range of the resolution
+     */
+    const mcp342x_decode_t *decode = _decode_params(config);
+    if (corrected > decode->code_max)
+    {
+        return decode->code_max;
+    }
+    if (corrected < decode->code_min)
     {
-        smbus_i2c_read_block(mcp342x_info_ptr->smbus_info, mcp342x_info_ptr->config, buffer, 5);
-        ESP_LOGV(TAG, "%02x %02x %02x %02x", buffer[0], buffer[1], buffer[2], buffer[3]);
-    } while ((buffer[3] & MCP342X_CNTRL_MASK) == MCP342X_CNTRL_RESULT_NOT_UPDATED);
+        return decode->code_min;
+    }
+    return (int32_t)corrected;
+}
 
-    ESP_LOGI(TAG, "Conversion done");
-    ESP_LOGD(TAG, "Buffer: %02x %02x %02x | %02x %02x",buffer[0], buffer[1], buffer[2], buffer[3], buffer[4]);
+uint32_t mcp342x_lsb_nv_q3(uint8_t config)
+{
+    return _decode_params(config)->lsb_nv_q3;
+}
 
+uint32_t mcp342x_conversion_time_us(mcp342x_sample_rate_t sample_rate)
+{
     /**
-     * Choose the LSB voltage value and discard repeated MSB
+     * 1 / data rate for 240, 60, 15 and 3.75 samples per second
      */
-    double LSB = 0;
-    uint8_t MSB = 0x80 & buffer[0];
-    switch ((mcp342x_info_ptr->config & MCP342X_SRATE_MASK))
+    switch (sample_rate & MCP342X_SRATE_MASK)
     {
     case MCP342X_SRATE_12BIT:
-    {
-        LSB = 0.001;
-        buffer[0] &= 0x0F;
-        break;
+        return 4167;
+    case MCP342X_SRATE_14BIT:
+        return 16667;
+    case MCP342X_SRATE_16BIT:
+        return 66667;
+    default:
+        return 266667;
     }
+}
+
+uint32_t mcp342x_conversion_time_max_us(mcp342x_sample_rate_t sample_rate)
+{
+    /**
+     * 1 / minimum data rate for 176, 44, 11 and 2.75 samples per second
+     */
+    switch (sample_rate & MCP342X_SRATE_MASK)
+    {
+    case MCP342X_SRATE_12BIT:
+        return 5682;
     case MCP342X_SRATE_14BIT:
+        return 22728;
+    case MCP342X_SRATE_16BIT:
+        return 90910;
+    default:
+        return 363637;
+    }
+}
+
+esp_err_t mcp342x_general_call(mcp342x_info_t *mcp342x_info_ptr, mcp342x_general_call_t call)
+{
+    /**
+     * Reuse the port and timeout of the device, addressed to MCP342X_GC_START (0x00)
+     */
+    smbus_info_t general_call_info = *mcp342x_info_ptr->smbus_info;
+    general_call_info.address = MCP342X_GC_START;
+    uint8_t data = call;
+    if (call == MCP342X_GC_RESET)
     {
-        LSB = 0.000250;
-        buffer[0] &= 0x3F;
-        break;
+        mcp342x_info_ptr->shadow_valid = false;
     }
-    case MCP342X_SRATE_16BIT:
+    return _bus_write(mcp342x_info_ptr, &general_call_info, &data, 1);
+}
+
+esp_err_t mcp342x_write_config(mcp342x_info_t *mcp342x_info_ptr)
+{
+    esp_err_t err = ESP_FAIL;
+    if (_is_init(mcp342x_info_ptr))
     {
-        LSB = 0.0000625;
-        buffer[0] &= 0xFF;
-        break;
+        if (_shadow_matches(mcp342x_info_ptr))
+        {
+            mcp342x_info_ptr->stats.writes_skipped++;
+            return ESP_OK;
+        }
+        err = _send_config(mcp342x_info_ptr, mcp342x_info_ptr->config);
+        mcp342x_info_ptr->conversion_start_us = esp_timer_get_time();
     }
-    case MCP342X_SRATE_18BIT:
+    return err;
+}
+
+esp_err_t mcp342x_start_new_conversion(mcp342x_info_t *mcp342x_info_ptr)
+{
+    esp_err_t err = ESP_FAIL;
+    if (_is_init(mcp342x_info_ptr))
     {
-        LSB = 0.000015625;
-        buffer[0] &= 0x3F;
-        break;
+        if ((mcp342x_info_ptr->config & MCP342X_MODE_MASK) == MCP342X_MODE_CONTINUOUS && _shadow_matches(mcp342x_info_ptr))
+        {
+            mcp342x_info_ptr->stats.writes_skipped++;
+            return ESP_OK;
+        }
+        err = _send_config(mcp342x_info_ptr, mcp342x_info_ptr->config | MCP342X_CNTRL_TRIGGER_CONVERSION);
+        mcp342x_info_ptr->conversion_start_us = esp_timer_get_time();
+        mcp342x_info_ptr->stats.conversions++;
+    }
+    return err;
+}
+
+mcp342x_conversion_status_t mcp342x_poll_raw(mcp342x_info_t *mcp342x_info_ptr, int32_t *code)
+{
+    uint8_t buffer[4] = {};
+    uint8_t data_bytes = _decode_params(mcp342x_info_ptr->config)->data_bytes;
+
+    if (_read_output(mcp342x_info_ptr, buffer, data_bytes + 1) != ESP_OK)
+    {
+        mcp342x_info_ptr->stats.i2c_errors++;
+        return MCP342X_STATUS_I2C;
     }
+    if ((buffer[data_bytes] & MCP342X_CNTRL_MASK) == MCP342X_CNTRL_RESULT_NOT_UPDATED)
+    {
+        return MCP342X_STATUS_IN_PROGRESS;
     }
+    mcp342x_info_ptr->result_config = buffer[data_bytes] & ~MCP342X_CNTRL_MASK;
 
-    /**
-     * Arrage bytes to form output code
-     * MSB <| Byte1 | Byte2 |[ Byte3 ]|> LSB
-     */
-    if ((mcp342x_info_ptr->config & MCP342X_SRATE_MASK) == MCP342X_SRATE_18BIT)
+    mcp342x_conversion_status_t status = mcp342x_output_code(mcp342x_info_ptr->config, buffer, code);
+    if (status == MCP342X_STATUS_OK && mcp342x_info_ptr->calibration != NULL)
     {
-        i32 = (buffer[0] << 16) | (buffer[1] << 8) | buffer[2];
+        *code = mcp342x_calibrate_code(mcp342x_info_ptr->calibration, mcp342x_info_ptr->result_config, *code);
+        status = _full_scale_status(mcp342x_info_ptr->result_config, *code);
     }
-    else
+    int64_t now_us = esp_timer_get_time();
+    _record_latency(&mcp342x_info_ptr->stats, now_us - mcp342x_info_ptr->conversion_start_us);
+    mcp342x_info_ptr->stats.samples++;
+    if ((mcp342x_info_ptr->config & MCP342X_MODE_MASK) == MCP342X_MODE_CONTINUOUS)
     {
-        i32 = (buffer[0] << 8) | buffer[1]; // MSB / byte1 | byte2 / LSB
+        // The next continuous conversion is already under way
+        mcp342x_info_ptr->conversion_start_us = now_us;
     }
+    if (status == MCP342X_STATUS_OVERFLOW)
+    {
+        mcp342x_info_ptr->stats.overflows++;
+    }
+    else if (status == MCP342X_STATUS_UNDERFLOW)
+    {
+        mcp342x_info_ptr->stats.underflows++;
+    }
+    MCP342X_SAMPLE_LOGD(TAG, "Conversion done: %d", *code);
+    return status;
+}
+
+mcp342x_conversion_status_t mcp342x_read_raw(mcp342x_info_t *mcp342x_info_ptr, int32_t *code)
+{
+    mcp342x_conversion_status_t status;
 
-    ESP_LOGD(TAG, "i32: %08x | %d", i32, i32);
+    if (mcp342x_info_ptr->degraded)
+    {
+        mcp342x_info_ptr->stats.i2c_errors++;
+        return MCP342X_STATUS_I2C;
+    }
 
     /**
-     * Based on the sign, calculate the input voltage signal
-     * MSB = 0 (Positive) 
-     * MSB = 1 (Negative)
+     * Sleep through the expected conversion time, then poll with a backoff
+     * that doubles from 1/16 up to 1/4 of the conversion time
      */
-    if (MSB == 0)
+    int64_t conversion_us = mcp342x_conversion_time_us((mcp342x_sample_rate_t)(mcp342x_info_ptr->config & MCP342X_SRATE_MASK));
+    int64_t now_us = esp_timer_get_time();
+    int64_t ready_us = mcp342x_info_ptr->conversion_start_us + conversion_us;
+    int64_t deadline_us = (ready_us > now_us ? ready_us : now_us) + conversion_us + MCP342X_TIMEOUT_SLACK_US;
+    int64_t backoff_us = conversion_us / 16;
+
+    if (mcp342x_info_ptr->wait_mode == MCP342X_WAIT_SLEEP && ready_us > now_us)
     {
-        *result = i32 * (LSB / (1 << (mcp342x_info_ptr->config & MCP342X_GAIN_MASK)));
+        mcp342x_delay_us(ready_us - now_us);
     }
-    else
+
+    while ((status = mcp342x_poll_raw(mcp342x_info_ptr, code)) == MCP342X_STATUS_IN_PROGRESS)
     {
-        *result = (~(i32) + 1) * (LSB / (1 << (mcp342x_info_ptr->config & MCP342X_GAIN_MASK)));
+        if (esp_timer_get_time() >= deadline_us)
+        {
+            MCP342X_SAMPLE_LOGD(TAG, "Conversion timed out");
+            mcp342x_info_ptr->stats.timeouts++;
+            return MCP342X_STATUS_TIMEOUT;
+        }
+        if (mcp342x_info_ptr->wait_mode == MCP342X_WAIT_SLEEP)
+        {
+            mcp342x_delay_us(backoff_us);
+            if (backoff_us < conversion_us / 4)
+            {
+                backoff_us *= 2;
+            }
+        }
     }
+    return status;
+}
+
+mcp342x_conversion_status_t mcp342x_poll_sample(mcp342x_info_t *mcp342x_info_ptr, mcp342x_sample_t *sample)
+{
+    int32_t code = 0;
+    int64_t start_us = mcp342x_info_ptr->conversion_start_us;
+    mcp342x_conversion_status_t status = mcp342x_poll_raw(mcp342x_info_ptr, &code);
+    _fill_sample(mcp342x_info_ptr, sample, status, code, start_us);
+    return status;
+}
+
+mcp342x_conversion_status_t mcp342x_read_sample(mcp342x_info_t *mcp342x_info_ptr, mcp342x_sample_t *sample)
+{
+    int32_t code = 0;
+    int64_t start_us = mcp342x_info_ptr->conversion_start_us;
+    mcp342x_conversion_status_t status = mcp342x_read_raw(mcp342x_info_ptr, &code);
+    _fill_sample(mcp342x_info_ptr, sample, status, code, start_us);
+    return status;
+}
+
+int32_t mcp342x_sample_to_nanovolts(const mcp342x_sample_t *sample)
+{
+    return ((int64_t)sample->code * _decode_params(sample->config)->lsb_nv_q3) >> 3;
+}
+
+void mcp342x_get_stats(const mcp342x_info_t *mcp342x_info_ptr, mcp342x_stats_t *stats)
+{
+    *stats = mcp342x_info_ptr->stats;
+}
+
+void mcp342x_reset_stats(mcp342x_info_t *mcp342x_info_ptr)
+{
+    memset(&mcp342x_info_ptr->stats, 0, sizeof(mcp342x_info_ptr->stats));
+}
+
+mcp342x_gain_t mcp342x_autorange_gain(uint8_t result_config, int32_t code, mcp342x_conversion_status_t status, uint8_t *hold)
+{
+    uint8_t gain = result_config & MCP342X_GAIN_MASK;
+    int32_t code_max = _decode_params(result_config)->code_max;
+    int32_t magnitude = (code < 0) ? -code : code;
 
-    if (*result > 2.048)
+    if (status == MCP342X_STATUS_OVERFLOW || status == MCP342X_STATUS_UNDERFLOW ||
+        magnitude > code_max - (code_max >> 3))
     {
-        return MCP342X_STATUS_OVERFLOW;
+        *hold = 0;
+        return (mcp342x_gain_t)((gain > MCP342X_GAIN_1X) ? gain - 1 : gain);
     }
-    if (*result < -2.048)
+    if (magnitude < (code_max >> 3) * 3 && gain < MCP342X_GAIN_8X)
     {
-        return MCP342X_STATUS_UNDERFLOW;
+        if (++(*hold) >= MCP342X_AUTORANGE_HOLD)
+        {
+            *hold = 0;
+            return (mcp342x_gain_t)(gain + 1);
+        }
+        return (mcp342x_gain_t)gain;
     }
+    *hold = 0;
+    return (mcp342x_gain_t)gain;
+}
 
-    return MCP342X_STATUS_OK;
+int32_t mcp342x_code_to_nanovolts(const mcp342x_info_t *mcp342x_info_ptr, int32_t code)
+{
+    return ((int64_t)code * mcp342x_info_ptr->lsb_nv_q3) >> 3;
+}
+
+mcp342x_conversion_status_t mcp342x_read_nanovolts(mcp342x_info_t *mcp342x_info_ptr, int32_t *nanovolts)
+{
+    int32_t code;
+    mcp342x_conversion_status_t status = mcp342x_read_raw(mcp342x_info_ptr, &code);
+    if (_has_code(status))
+    {
+        *nanovolts = mcp342x_code_to_nanovolts(mcp342x_info_ptr, code);
+    }
+    return status;
+}
+
+mcp342x_conversion_status_t mcp342x_poll_result(mcp342x_info_t *mcp342x_info_ptr, double *result)
+{
+    int32_t code;
+    mcp342x_conversion_status_t status = mcp342x_poll_raw(mcp342x_info_ptr, &code);
+    if (_has_code(status))
+    {
+        *result = mcp342x_code_to_nanovolts(mcp342x_info_ptr, code) * 1e-9;
+    }
+    return status;
+}
+
+mcp342x_conversion_status_t mcp342x_read_result(mcp342x_info_t *mcp342x_info_ptr, double *result)
+{
+    int32_t code;
+    mcp342x_conversion_status_t status = mcp342x_read_raw(mcp342x_info_ptr, &code);
+    if (_has_code(status))
+    {
+        *result = mcp342x_code_to_nanovolts(mcp342x_info_ptr, code) * 1e-9;
+    }
+    return status;
 }
 
 /*-----------------------------------------------------------
@@ -239,58 +879,91 @@ namespace cm
 {
 
 MCP342x::MCP342x(mcp342x_address_t in_address)
+    : smbus_info(), mcp342x_info(), channel_config(), autorange_mask(0), autorange_hold()
 {
     this->address = in_address;
 }
 
+MCP342x::MCP342x(MCP342x &&other)
+    : smbus_info(), mcp342x_info(), channel_config(), autorange_mask(0), autorange_hold()
+{
+    *this = static_cast<MCP342x &&>(other);
+}
+
+MCP342x &MCP342x::operator=(MCP342x &&other)
+{
+    if (this != &other)
+    {
+        this->address = other.address;
+        this->smbus_info = other.smbus_info;
+        this->mcp342x_info = other.mcp342x_info;
+        memcpy(this->channel_config, other.channel_config, sizeof(this->channel_config));
+        this->autorange_mask = other.autorange_mask;
+        memcpy(this->autorange_hold, other.autorange_hold, sizeof(this->autorange_hold));
+
+        /**
+         * The device info points at the bus info it owns, follow it to the new object
+         */
+        if (this->mcp342x_info.smbus_info == &other.smbus_info)
+        {
+            this->mcp342x_info.smbus_info = &this->smbus_info;
+        }
+        other.mcp342x_info.init = false;
+        other.mcp342x_info.smbus_info = NULL;
+        other.smbus_info.init = false;
+    }
+    return *this;
+}
+
 MCP342x::~MCP342x()
 {
-    mcp342x_free(&this->mcp342x_info);
+    this->mcp342x_info.init = false;
 }
 
 esp_err_t MCP342x::Init(i2c_port_t in_i2c_master, mcp342x_config_t in_config)
 {
     ESP_LOGI(TAG, "Initialize MCP342x device");
-    smbus_info_t *smbus_info = smbus_malloc();
-    smbus_init(smbus_info, in_i2c_master, this->address);
-    smbus_set_timeout(smbus_info, 1000 / portTICK_RATE_MS);
-
-    assert(smbus_info != NULL);
-    this->mcp342x_info = mcp342x_malloc();
-    return mcp342x_init(this->mcp342x_info,
-                        smbus_info,
+    esp_err_t err = smbus_init(&this->smbus_info, in_i2c_master, this->address);
+    if (err != ESP_OK)
+    {
+        return err;
+    }
+    smbus_set_timeout(&this->smbus_info, 1000 / portTICK_RATE_MS);
+
+    for (uint8_t i = 0; i < 4; i++)
+    {
+        this->channel_config[i] = (in_config.sample_rate & MCP342X_SRATE_MASK) | (in_config.gain & MCP342X_GAIN_MASK);
+    }
+    return mcp342x_init(&this->mcp342x_info,
+                        &this->smbus_info,
                         in_config);
 }
 
 esp_err_t MCP342x::GeneralCall(mcp342x_general_call_t call)
 {
     ESP_LOGI(TAG, "General call %02x", call);
-    return mcp342x_general_call(this->mcp342x_info, call);
+    return mcp342x_general_call(&this->mcp342x_info, call);
 }
 
 void MCP342x::SetConfig(mcp342x_config_t in_config)
 {
-    return mcp342x_set_config(this->mcp342x_info, in_config);
+    return mcp342x_set_config(&this->mcp342x_info, in_config);
 }
 
 esp_err_t MCP342x::StartNewConversion(void)
 {
-    return mcp342x_start_new_conversion(this->mcp342x_info);
+    this->ApplyChannelGain();
+    return mcp342x_start_new_conversion(&this->mcp342x_info);
 }
 
 esp_err_t MCP342x::StartNewConversion(mcp342x_channel_t in_channel)
 {
-    /**
-     * Swap out the channel bits by first zeroing and then OR with new channel
-     */
-    if ((this->mcp342x_info->config & MCP342X_CHANNEL_MASK) != in_channel)
-    {
-        ESP_LOGI(TAG, "Channel swap: %02x -> %02x", (this->mcp342x_info->config & MCP342X_CHANNEL_MASK), in_channel);    
-        this->mcp342x_info->config = ((this->mcp342x_info->config & ~MCP342X_CHANNEL_MASK) | (in_channel & MCP342X_CHANNEL_MASK));
-    }
-    return mcp342x_start_new_conversion(this->mcp342x_info);
+    mcp342x_set_channel(&this->mcp342x_info, in_channel);
+    this->ApplyChannelGain();
+    return mcp342x_start_new_conversion(&this->mcp342x_info);
 }
 
+#ifdef CONFIG_MCP342X_SAMPLE_LOG
 static const char* errmsg[] = {
     "",
     "underflow",
@@ -298,20 +971,178 @@ static const char* errmsg[] = {
     "i2c",
     "in progress",
     "timeout",
+    "invalid state",
 };
+#endif
+
+mcp342x_conversion_status_t MCP342x::TryRead(double *result)
+{
+    int32_t code = 0;
+    mcp342x_conversion_status_t status = this->AutoRange(mcp342x_poll_raw(&this->mcp342x_info, &code), &code);
+    if (_has_code(status))
+    {
+        *result = mcp342x_code_to_nanovolts(&this->mcp342x_info, code) * 1e-9;
+    }
+    return status;
+}
+
+mcp342x_conversion_status_t MCP342x::ReadRaw(int32_t *code)
+{
+    return this->AutoRange(mcp342x_read_raw(&this->mcp342x_info, code), code);
+}
+
+mcp342x_conversion_status_t MCP342x::ReadNanovolts(int32_t *nanovolts)
+{
+    int32_t code = 0;
+    mcp342x_conversion_status_t status = this->ReadRaw(&code);
+    if (_has_code(status))
+    {
+        *nanovolts = mcp342x_code_to_nanovolts(&this->mcp342x_info, code);
+    }
+    return status;
+}
 
 double MCP342x::Read(void)
 {
     mcp342x_conversion_status_t err;
-    double result;
+    int32_t nanovolts = 0;
 
-    err = mcp342x_read_result(this->mcp342x_info, &result);
+    err = this->ReadNanovolts(&nanovolts);
     if (err != MCP342xConvStatus::MCP342X_STATUS_OK)
     {
-        ESP_LOGW(TAG, "%s", errmsg[err]);
+        MCP342X_SAMPLE_LOGW(TAG, "%s", errmsg[err]);
     }
 
-    return result;
+    return nanovolts * 1e-9;
+}
+
+mcp342x_conversion_status_t MCP342x::TryReadSample(mcp342x_sample_t *sample)
+{
+    return this->AutoRange(mcp342x_poll_sample(&this->mcp342x_info, sample), &sample->code);
+}
+
+mcp342x_conversion_status_t MCP342x::ReadSample(mcp342x_sample_t *sample)
+{
+    return this->AutoRange(mcp342x_read_sample(&this->mcp342x_info, sample), &sample->code);
+}
+
+void MCP342x::SetChannelConfig(mcp342x_channel_t in_channel, mcp342x_sample_rate_t in_sample_rate, mcp342x_gain_t in_gain)
+{
+    this->channel_config[(in_channel & MCP342X_CHANNEL_MASK) >> 5] = (in_sample_rate & MCP342X_SRATE_MASK) | (in_gain & MCP342X_GAIN_MASK);
+}
+
+esp_err_t MCP342x::ScanChannels(uint8_t channel_mask, mcp342x_sample_t *samples)
+{
+    esp_err_t err = ESP_OK;
+    uint8_t saved_config = this->mcp342x_info.config;
+
+    /**
+     * Each channel is converted in one-shot mode with its own sample rate and gain.
+     * The trigger write carries the whole configuration, so no separate config write is needed.
+     * samples holds one entry per channel, entries of channels not scanned are left untouched.
+     */
+    for (uint8_t i = 0; i < 4; i++)
+    {
+        if ((channel_mask & (1 << i)) == 0)
+        {
+            continue;
+        }
+
+        mcp342x_set_config(&this->mcp342x_info, mcp342x_config_from_byte(MCP342X_MODE_ONESHOT | (i << 5) | this->channel_config[i]));
+        esp_err_t trigger_err = mcp342x_start_new_conversion(&this->mcp342x_info);
+        if (trigger_err != ESP_OK)
+        {
+            err = trigger_err;
+            _fill_sample(&this->mcp342x_info, &samples[i], MCP342X_STATUS_I2C, 0, this->mcp342x_info.conversion_start_us);
+            continue;
+        }
+        this->ReadSample(&samples[i]);
+    }
+
+    mcp342x_set_config(&this->mcp342x_info, mcp342x_config_from_byte(saved_config));
+    return err;
+}
+
+void MCP342x::SetAutoRange(mcp342x_channel_t in_channel, bool enable)
+{
+    uint8_t index = (in_channel & MCP342X_CHANNEL_MASK) >> 5;
+    if (enable)
+    {
+        /**
+         * Start from the gain the channel is configured with, if it is the current one
+         */
+        uint8_t config = this->mcp342x_info.config;
+        if ((config & MCP342X_CHANNEL_MASK) == (in_channel & MCP342X_CHANNEL_MASK))
+        {
+            this->channel_config[index] = (this->channel_config[index] & ~MCP342X_GAIN_MASK) | (config & MCP342X_GAIN_MASK);
+        }
+        this->autorange_mask |= (1 << index);
+    }
+    else
+    {
+        this->autorange_mask &= ~(1 << index);
+    }
+    this->autorange_hold[index] = 0;
+}
+
+mcp342x_gain_t MCP342x::GetResultGain(void)
+{
+    return (mcp342x_gain_t)(this->mcp342x_info.result_config & MCP342X_GAIN_MASK);
+}
+
+mcp342x_conversion_status_t MCP342x::AutoRange(mcp342x_conversion_status_t status, const int32_t *code)
+{
+    uint8_t index = (this->mcp342x_info.result_config & MCP342X_CHANNEL_MASK) >> 5;
+    if (_has_code(status) && (this->autorange_mask & (1 << index)))
+    {
+        mcp342x_gain_t gain = mcp342x_autorange_gain(this->mcp342x_info.result_config, *code, status, &this->autorange_hold[index]);
+        this->channel_config[index] = (this->channel_config[index] & ~MCP342X_GAIN_MASK) | gain;
+    }
+    return status;
+}
+
+void MCP342x::ApplyChannelGain(void)
+{
+    /**
+     * Gain changes ride on the next trigger write instead of a separate config write
+     */
+    uint8_t config = this->mcp342x_info.config;
+    uint8_t index = (config & MCP342X_CHANNEL_MASK) >> 5;
+    uint8_t gain = this->channel_config[index] & MCP342X_GAIN_MASK;
+    if ((this->autorange_mask & (1 << index)) && (config & MCP342X_GAIN_MASK) != gain)
+    {
+        mcp342x_set_config(&this->mcp342x_info, mcp342x_config_from_byte((config & ~MCP342X_GAIN_MASK) | gain));
+    }
+}
+
+void MCP342x::SetCalibration(const mcp342x_calibration_t *calibration)
+{
+    mcp342x_set_calibration(&this->mcp342x_info, calibration);
+}
+
+void MCP342x::SetRecovery(uint8_t max_retries, uint32_t backoff_us, uint16_t error_budget)
+{
+    mcp342x_set_recovery(&this->mcp342x_info, max_retries, backoff_us, error_budget);
+}
+
+esp_err_t MCP342x::Recover(void)
+{
+    return mcp342x_recover(&this->mcp342x_info);
+}
+
+bool MCP342x::IsDegraded(void)
+{
+    return this->mcp342x_info.degraded;
+}
+
+void MCP342x::GetStats(mcp342x_stats_t *stats)
+{
+    mcp342x_get_stats(&this->mcp342x_info, stats);
+}
+
+void MCP342x::ResetStats(void)
+{
+    mcp342x_reset_stats(&this->mcp342x_info);
 }
 
 mcp342x_address_t MCP342x::GetAddress(void)
@@ -321,7 +1152,7 @@ mcp342x_address_t MCP342x::GetAddress(void)
 
 mcp342x_info_t *MCP342x::GetInfoPtr(void)
 {
-    return this->mcp342x_info;
+    return &this->mcp342x_info;
 }
 
 }; // namespace cm
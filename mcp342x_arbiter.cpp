@@ -0,0 +1,494 @@
+/*
+    Craft Metrics
+
+    This product includes software developed by
+    Craft Metrics (https://craftmetrics.ca/).
+
+    MIT License
+    Copyright (c) 2018 Craft Metrics
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+
+#include "mcp342x_arbiter.h"
+
+#include <string.h>
+#include <esp_log.h>
+#include <freertos/task.h>
+#include <freertos/semphr.h>
+
+static const char *TAG = "mcp342x_arbiter";
+
+static const uint32_t MCP342X_ARBITER_STACK_SIZE = 3072;
+
+/*-----------------------------------------------------------
+* PRIVATE
+*----------------------------------------------------------*/
+typedef enum
+{
+    REQUEST_PENDING,
+    REQUEST_ACTIVE,
+    REQUEST_DONE,
+} request_state_t;
+
+/**
+ * A transfer waiting for the worker, it lives on the stack of the calling task
+ */
+typedef struct MCP342xArbiterRequest
+{
+    struct MCP342xArbiterRequest *next;
+    const smbus_info_t *smbus_info;
+    uint8_t *data;
+    size_t len;
+    bool read;
+    uint8_t bypassed;
+    TaskHandle_t task;
+    request_state_t state;
+    esp_err_t err;
+    SemaphoreHandle_t done;
+} request_t;
+
+typedef struct MCP342xArbiter
+{
+    i2c_port_t i2c_port;
+    portMUX_TYPE lock;
+    request_t *pending;
+    bool active;
+    TaskHandle_t worker;
+    SemaphoreHandle_t burst;
+    TaskHandle_t burst_owner;
+    uint32_t burst_depth;
+    mcp342x_arbiter_stats_t stats;
+    mcp342x_bus_t bus;
+} mcp342x_arbiter_t;
+
+static mcp342x_arbiter_t _arbiters[I2C_NUM_MAX];
+
+static mcp342x_arbiter_t *_arbiter(i2c_port_t i2c_port)
+{
+    if (i2c_port < 0 || i2c_port >= I2C_NUM_MAX || _arbiters[i2c_port].worker == NULL)
+    {
+        return NULL;
+    }
+    return &_arbiters[i2c_port];
+}
+
+/**
+ * Bytes on the wire, the address byte included
+ */
+static size_t _cost(const request_t *request)
+{
+    return request->len + 1;
+}
+
+/**
+ * Queue behind every transfer that is no longer than this one or has been
+ * overtaken too often already, then overtake the rest
+ */
+static void _enqueue(mcp342x_arbiter_t *arbiter, request_t *request)
+{
+    request_t **link = &arbiter->pending;
+    request_t **position = link;
+    for (; *link != NULL; link = &(*link)->next)
+    {
+        if (_cost(*link) <= _cost(request) || (*link)->bypassed >= MCP342X_ARBITER_MAX_BYPASS)
+        {
+            position = &(*link)->next;
+        }
+    }
+    request->next = *position;
+    *position = request;
+    for (request_t *overtaken = request->next; overtaken != NULL; overtaken = overtaken->next)
+    {
+        overtaken->bypassed++;
+        arbiter->stats.bypasses++;
+    }
+}
+
+static void _unlink(mcp342x_arbiter_t *arbiter, request_t *request)
+{
+    for (request_t **link = &arbiter->pending; *link != NULL; link = &(*link)->next)
+    {
+        if (*link == request)
+        {
+            *link = request->next;
+            return;
+        }
+    }
+}
+
+/**
+ * Take up to MCP342X_ARBITER_MAX_BATCH transfers off the queue in order,
+ * only those of the burst owner while the port is reserved
+ */
+static size_t _take_batch(mcp342x_arbiter_t *arbiter, request_t **batch)
+{
+    size_t n = 0;
+    portENTER_CRITICAL(&arbiter->lock);
+    request_t **link = &arbiter->pending;
+    while (*link != NULL && n < MCP342X_ARBITER_MAX_BATCH)
+    {
+        request_t *request = *link;
+        if (arbiter->burst_owner != NULL && request->task != arbiter->burst_owner)
+        {
+            link = &request->next;
+            continue;
+        }
+        *link = request->next;
+        request->state = REQUEST_ACTIVE;
+        batch[n++] = request;
+    }
+    arbiter->active = (n > 0);
+    portEXIT_CRITICAL(&arbiter->lock);
+    return n;
+}
+
+/**
+ * Send the transfers in one command link, joined by repeated starts
+ */
+static esp_err_t _send(mcp342x_arbiter_t *arbiter, request_t **batch, size_t n)
+{
+    i2c_cmd_handle_t cmd = i2c_cmd_link_create();
+    if (cmd == NULL)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    TickType_t timeout = 0;
+    for (size_t i = 0; i < n; i++)
+    {
+        const request_t *request = batch[i];
+        i2c_master_start(cmd);
+        i2c_master_write_byte(cmd, (request->smbus_info->address << 1) | (request->read ? I2C_MASTER_READ : I2C_MASTER_WRITE), true);
+        if (!request->read)
+        {
+            i2c_master_write(cmd, request->data, request->len, true);
+        }
+        else
+        {
+            if (request->len > 1)
+            {
+                i2c_master_read(cmd, request->data, request->len - 1, I2C_MASTER_ACK);
+            }
+            i2c_master_read_byte(cmd, &request->data[request->len - 1], I2C_MASTER_NACK);
+        }
+        if ((TickType_t)request->smbus_info->timeout > timeout)
+        {
+            timeout = request->smbus_info->timeout;
+        }
+    }
+    i2c_master_stop(cmd);
+    esp_err_t err = i2c_master_cmd_begin(arbiter->i2c_port, cmd, timeout);
+    i2c_cmd_link_delete(cmd);
+    arbiter->stats.links++;
+    return err;
+}
+
+static void _complete(request_t *request, esp_err_t err)
+{
+    request->err = err;
+    request->state = REQUEST_DONE;
+    xSemaphoreGive(request->done);
+}
+
+/**
+ * Address a device without transferring data, which leaves its registers alone
+ */
+static esp_err_t _probe(mcp342x_arbiter_t *arbiter, const smbus_info_t *smbus_info)
+{
+    i2c_cmd_handle_t cmd = i2c_cmd_link_create();
+    if (cmd == NULL)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    i2c_master_start(cmd);
+    i2c_master_write_byte(cmd, (smbus_info->address << 1) | I2C_MASTER_WRITE, true);
+    i2c_master_stop(cmd);
+    esp_err_t err = i2c_master_cmd_begin(arbiter->i2c_port, cmd, smbus_info->timeout);
+    i2c_cmd_link_delete(cmd);
+    arbiter->stats.links++;
+    return err;
+}
+
+/**
+ * Put transfers back at the head of the queue, in their order
+ */
+static void _requeue(mcp342x_arbiter_t *arbiter, request_t **batch, size_t n)
+{
+    portENTER_CRITICAL(&arbiter->lock);
+    for (size_t i = n; i-- > 0;)
+    {
+        batch[i]->state = REQUEST_PENDING;
+        batch[i]->next = arbiter->pending;
+        arbiter->pending = batch[i];
+    }
+    portEXIT_CRITICAL(&arbiter->lock);
+}
+
+/**
+ * Mark the bus free once a link has ended, before its callers are woken
+ */
+static void _idle(mcp342x_arbiter_t *arbiter)
+{
+    portENTER_CRITICAL(&arbiter->lock);
+    arbiter->active = false;
+    portEXIT_CRITICAL(&arbiter->lock);
+}
+
+/**
+ * A NACK ends the link where it happened. The transfers before it were carried
+ * out and must not be repeated, a read clears the ready bit of its device. So
+ * probe the addresses in order to find the transfer that was not acknowledged,
+ * complete the ones before it and queue the ones after it again.
+ * If every device answers the probe or the link failed otherwise, it is not
+ * known how far it got and all transfers fail.
+ */
+static void _complete_failed(mcp342x_arbiter_t *arbiter, request_t **batch, size_t n, esp_err_t err)
+{
+    size_t failed = n;
+    if (err == ESP_FAIL && n > 1)
+    {
+        for (failed = 0; failed < n; failed++)
+        {
+            if (_probe(arbiter, batch[failed]->smbus_info) != ESP_OK)
+            {
+                break;
+            }
+        }
+    }
+    if (failed == n)
+    {
+        _idle(arbiter);
+        arbiter->stats.transfers += n;
+        for (size_t i = 0; i < n; i++)
+        {
+            _complete(batch[i], err);
+        }
+        return;
+    }
+
+    _requeue(arbiter, &batch[failed + 1], n - failed - 1);
+    _idle(arbiter);
+    arbiter->stats.transfers += failed + 1;
+    for (size_t i = 0; i < failed; i++)
+    {
+        _complete(batch[i], ESP_OK);
+    }
+    _complete(batch[failed], err);
+}
+
+static void _worker(void *arg)
+{
+    mcp342x_arbiter_t *arbiter = (mcp342x_arbiter_t *)arg;
+    request_t *batch[MCP342X_ARBITER_MAX_BATCH];
+    for (;;)
+    {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        size_t n;
+        while ((n = _take_batch(arbiter, batch)) > 0)
+        {
+            esp_err_t err = _send(arbiter, batch, n);
+            if (err != ESP_OK)
+            {
+                _complete_failed(arbiter, batch, n, err);
+                continue;
+            }
+            _idle(arbiter);
+            arbiter->stats.transfers += n;
+            for (size_t i = 0; i < n; i++)
+            {
+                _complete(batch[i], ESP_OK);
+            }
+        }
+    }
+}
+
+static esp_err_t _arbiter_transfer(void *context, const smbus_info_t *smbus_info, uint8_t *data, size_t len, bool read)
+{
+    mcp342x_arbiter_t *arbiter = (mcp342x_arbiter_t *)context;
+    StaticSemaphore_t done_buffer;
+    request_t request;
+    memset(&request, 0, sizeof(request));
+    request.smbus_info = smbus_info;
+    request.data = data;
+    request.len = len;
+    request.read = read;
+    request.task = xTaskGetCurrentTaskHandle();
+    request.state = REQUEST_PENDING;
+    request.done = xSemaphoreCreateBinaryStatic(&done_buffer);
+
+    portENTER_CRITICAL(&arbiter->lock);
+    if (arbiter->pending != NULL || arbiter->active)
+    {
+        arbiter->stats.contentions++;
+    }
+    _enqueue(arbiter, &request);
+    portEXIT_CRITICAL(&arbiter->lock);
+    xTaskNotifyGive(arbiter->worker);
+
+    if (xSemaphoreTake(request.done, smbus_info->timeout) != pdTRUE)
+    {
+        /**
+         * Withdraw the transfer if the worker has not picked it up yet,
+         * otherwise it writes to the request, so wait for it to finish
+         */
+        portENTER_CRITICAL(&arbiter->lock);
+        bool pending = (request.state == REQUEST_PENDING);
+        if (pending)
+        {
+            _unlink(arbiter, &request);
+        }
+        portEXIT_CRITICAL(&arbiter->lock);
+        if (pending)
+        {
+            request.err = ESP_ERR_TIMEOUT;
+        }
+        else
+        {
+            xSemaphoreTake(request.done, portMAX_DELAY);
+        }
+    }
+    vSemaphoreDelete(request.done);
+    return request.err;
+}
+
+static esp_err_t _arbiter_write(void *context, const smbus_info_t *smbus_info, const uint8_t *data, size_t len)
+{
+    return _arbiter_transfer(context, smbus_info, (uint8_t *)data, len, false);
+}
+
+static esp_err_t _arbiter_read(void *context, const smbus_info_t *smbus_info, uint8_t *data, size_t len)
+{
+    return _arbiter_transfer(context, smbus_info, data, len, true);
+}
+
+/*-----------------------------------------------------------
+* PUBLIC C API
+*----------------------------------------------------------*/
+esp_err_t mcp342x_arbiter_init(i2c_port_t i2c_port, UBaseType_t priority)
+{
+    if (i2c_port < 0 || i2c_port >= I2C_NUM_MAX)
+    {
+        ESP_LOGE(TAG, "invalid i2c port %d", i2c_port);
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    mcp342x_arbiter_t *arbiter = &_arbiters[i2c_port];
+    if (arbiter->worker != NULL)
+    {
+        return ESP_OK;
+    }
+    arbiter->i2c_port = i2c_port;
+    arbiter->lock = portMUX_INITIALIZER_UNLOCKED;
+    arbiter->pending = NULL;
+    arbiter->active = false;
+    arbiter->burst_owner = NULL;
+    arbiter->burst_depth = 0;
+    memset(&arbiter->stats, 0, sizeof(arbiter->stats));
+    arbiter->burst = xSemaphoreCreateRecursiveMutex();
+    if (arbiter->burst == NULL)
+    {
+        ESP_LOGE(TAG, "create lock for port %d failed", i2c_port);
+        return ESP_ERR_NO_MEM;
+    }
+    arbiter->bus.context = arbiter;
+    arbiter->bus.write = _arbiter_write;
+    arbiter->bus.read = _arbiter_read;
+    if (xTaskCreate(_worker, TAG, MCP342X_ARBITER_STACK_SIZE, arbiter, priority, &arbiter->worker) != pdPASS)
+    {
+        ESP_LOGE(TAG, "create worker for port %d failed", i2c_port);
+        vSemaphoreDelete(arbiter->burst);
+        arbiter->burst = NULL;
+        arbiter->worker = NULL;
+        return ESP_ERR_NO_MEM;
+    }
+    ESP_LOGD(TAG, "arbiter for port %d", i2c_port);
+    return ESP_OK;
+}
+
+const mcp342x_bus_t *mcp342x_arbiter_bus(i2c_port_t i2c_port)
+{
+    mcp342x_arbiter_t *arbiter = _arbiter(i2c_port);
+    return arbiter != NULL ? &arbiter->bus : NULL;
+}
+
+esp_err_t mcp342x_arbiter_lock(i2c_port_t i2c_port, TickType_t timeout)
+{
+    mcp342x_arbiter_t *arbiter = _arbiter(i2c_port);
+    if (arbiter == NULL)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (xSemaphoreTakeRecursive(arbiter->burst, timeout) != pdTRUE)
+    {
+        return ESP_ERR_TIMEOUT;
+    }
+    portENTER_CRITICAL(&arbiter->lock);
+    arbiter->burst_owner = xTaskGetCurrentTaskHandle();
+    arbiter->burst_depth++;
+    portEXIT_CRITICAL(&arbiter->lock);
+    return ESP_OK;
+}
+
+void mcp342x_arbiter_unlock(i2c_port_t i2c_port)
+{
+    mcp342x_arbiter_t *arbiter = _arbiter(i2c_port);
+    if (arbiter == NULL || arbiter->burst_owner != xTaskGetCurrentTaskHandle())
+    {
+        return;
+    }
+
+    /**
+     * Transfers held back for the burst go out once the outermost lock is released
+     */
+    bool released = false;
+    portENTER_CRITICAL(&arbiter->lock);
+    if (--arbiter->burst_depth == 0)
+    {
+        arbiter->burst_owner = NULL;
+        released = true;
+    }
+    portEXIT_CRITICAL(&arbiter->lock);
+    xSemaphoreGiveRecursive(arbiter->burst);
+    if (released)
+    {
+        xTaskNotifyGive(arbiter->worker);
+    }
+}
+
+uint32_t mcp342x_arbiter_contentions(i2c_port_t i2c_port)
+{
+    mcp342x_arbiter_t *arbiter = _arbiter(i2c_port);
+    return arbiter != NULL ? arbiter->stats.contentions : 0;
+}
+
+void mcp342x_arbiter_get_stats(i2c_port_t i2c_port, mcp342x_arbiter_stats_t *stats)
+{
+    mcp342x_arbiter_t *arbiter = _arbiter(i2c_port);
+    if (arbiter != NULL)
+    {
+        portENTER_CRITICAL(&arbiter->lock);
+        *stats = arbiter->stats;
+        portEXIT_CRITICAL(&arbiter->lock);
+    }
+    else
+    {
+        memset(stats, 0, sizeof(*stats));
+    }
+}
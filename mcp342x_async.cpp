@@ -0,0 +1,215 @@
+/*
+    Craft Metrics
+
+    This product includes software developed by
+    Craft Metrics (https://craftmetrics.ca/).
+
+    MIT License
+    Copyright (c) 2018 Craft Metrics
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+
+#include "mcp342x_async.h"
+#include "mcp342x_priv.h"
+
+#include <string.h>
+#include <esp_log.h>
+#include <freertos/semphr.h>
+
+static const char *TAG = "mcp342x_async";
+
+static const uint32_t MCP342X_ASYNC_STACK_SIZE = 3072;
+
+/*-----------------------------------------------------------
+* PRIVATE
+*----------------------------------------------------------*/
+static int64_t _conversion_us(const mcp342x_info_t *mcp342x_info_ptr)
+{
+    return mcp342x_conversion_time_us((mcp342x_sample_rate_t)(mcp342x_info_ptr->config & MCP342X_SRATE_MASK));
+}
+
+/**
+ * Runs on the esp_timer task shared by every timer, so it only wakes the worker
+ */
+static void _on_timer(void *arg)
+{
+    mcp342x_async_t *async = (mcp342x_async_t *)arg;
+    xTaskNotifyGive(async->worker);
+}
+
+/**
+ * Read the device once per timer expiry and deliver the result
+ */
+static void _complete(mcp342x_async_t *async)
+{
+    mcp342x_info_t *info = async->mcp342x_info;
+
+    if (mcp342x_poll_sample(info, &async->sample) == MCP342X_STATUS_IN_PROGRESS)
+    {
+        /**
+         * Early, the device clock runs slower than the nominal data rate.
+         * Re-arm for a short remainder, up to the same deadline as mcp342x_read_raw.
+         */
+        int64_t conversion_us = _conversion_us(info);
+        if (!async->stopping &&
+            esp_timer_get_time() < info->conversion_start_us + 2 * conversion_us + MCP342X_TIMEOUT_SLACK_US &&
+            esp_timer_start_once(async->timer, conversion_us / 16) == ESP_OK)
+        {
+            return;
+        }
+        info->stats.timeouts++;
+        async->sample.status = MCP342X_STATUS_TIMEOUT;
+    }
+
+    async->busy = false;
+    if (async->callback != NULL)
+    {
+        async->callback(info, &async->sample, async->arg);
+    }
+    if (async->notify_task != NULL)
+    {
+        xTaskNotifyGive(async->notify_task);
+    }
+}
+
+static void _worker(void *arg)
+{
+    mcp342x_async_t *async = (mcp342x_async_t *)arg;
+    for (;;)
+    {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        if (async->stopping)
+        {
+            break;
+        }
+        if (async->busy)
+        {
+            _complete(async);
+        }
+    }
+    xSemaphoreGive(async->stopped);
+    vTaskDelete(NULL);
+}
+
+/*-----------------------------------------------------------
+* PUBLIC C API
+*----------------------------------------------------------*/
+esp_err_t mcp342x_async_init(mcp342x_async_t *async, mcp342x_info_t *mcp342x_info_ptr,
+                             mcp342x_async_callback_t callback, void *arg, TaskHandle_t notify_task,
+                             UBaseType_t priority)
+{
+    if (async == NULL || mcp342x_info_ptr == NULL)
+    {
+        ESP_LOGE(TAG, "async or mcp342x_info is NULL");
+        return ESP_ERR_INVALID_ARG;
+    }
+    memset(async, 0, sizeof(*async));
+    async->mcp342x_info = mcp342x_info_ptr;
+    async->callback = callback;
+    async->arg = arg;
+    async->notify_task = notify_task;
+
+    async->stopped = xSemaphoreCreateBinary();
+    if (async->stopped == NULL)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    if (xTaskCreate(_worker, TAG, MCP342X_ASYNC_STACK_SIZE, async, priority, &async->worker) != pdPASS)
+    {
+        ESP_LOGE(TAG, "failed to create worker task");
+        vSemaphoreDelete(async->stopped);
+        async->stopped = NULL;
+        return ESP_ERR_NO_MEM;
+    }
+
+    esp_timer_create_args_t timer_args;
+    memset(&timer_args, 0, sizeof(timer_args));
+    timer_args.callback = _on_timer;
+    timer_args.arg = async;
+    timer_args.dispatch_method = ESP_TIMER_TASK;
+    timer_args.name = TAG;
+    esp_err_t err = esp_timer_create(&timer_args, &async->timer);
+    if (err != ESP_OK)
+    {
+        async->timer = NULL;
+        mcp342x_async_deinit(async);
+    }
+    return err;
+}
+
+void mcp342x_async_deinit(mcp342x_async_t *async)
+{
+    /**
+     * Stop the timer before the worker goes, so no expiry notifies a deleted task,
+     * and again after it, in case the worker re-armed it on the way out
+     */
+    async->stopping = true;
+    if (async->timer != NULL)
+    {
+        esp_timer_stop(async->timer);
+    }
+    if (async->worker != NULL)
+    {
+        xTaskNotifyGive(async->worker);
+        xSemaphoreTake(async->stopped, portMAX_DELAY);
+        async->worker = NULL;
+    }
+    if (async->timer != NULL)
+    {
+        esp_timer_stop(async->timer);
+        esp_timer_delete(async->timer);
+        async->timer = NULL;
+    }
+    if (async->stopped != NULL)
+    {
+        vSemaphoreDelete(async->stopped);
+        async->stopped = NULL;
+    }
+    async->busy = false;
+}
+
+esp_err_t mcp342x_async_start(mcp342x_async_t *async)
+{
+    if (async->timer == NULL || async->busy)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    mcp342x_info_t *info = async->mcp342x_info;
+    esp_err_t err = mcp342x_start_new_conversion(info);
+    if (err != ESP_OK)
+    {
+        return err;
+    }
+
+    /**
+     * In continuous mode the trigger may have been skipped, the running
+     * conversion then ends one conversion time after the last result
+     */
+    int64_t wait_us = info->conversion_start_us + _conversion_us(info) - esp_timer_get_time();
+    async->busy = true;
+    err = esp_timer_start_once(async->timer, wait_us > 0 ? wait_us : 0);
+    if (err != ESP_OK)
+    {
+        async->busy = false;
+    }
+    return err;
+}
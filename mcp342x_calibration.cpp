@@ -0,0 +1,274 @@
+/*
+    Craft Metrics
+
+    This product includes software developed by
+    Craft Metrics (https://craftmetrics.ca/).
+
+    MIT License
+    Copyright (c) 2018 Craft Metrics
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+
+#include "mcp342x_calibration.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <esp_log.h>
+
+static const char *TAG = "mcp342x_calibration";
+
+static const uint8_t MCP342X_CALIBRATION_MAGIC[2] = {'M', 'C'};
+static const uint8_t MCP342X_CALIBRATION_VERSION = 1;
+
+/*-----------------------------------------------------------
+* PRIVATE
+*----------------------------------------------------------*/
+
+static uint16_t _fletcher16(const uint8_t *data, size_t len)
+{
+    uint16_t sum1 = 0;
+    uint16_t sum2 = 0;
+    for (size_t i = 0; i < len; i++)
+    {
+        sum1 = (sum1 + data[i]) % 255;
+        sum2 = (sum2 + sum1) % 255;
+    }
+    return (sum2 << 8) | sum1;
+}
+
+static void _put_le32(uint8_t *data, int32_t value)
+{
+    for (uint8_t i = 0; i < 4; i++)
+    {
+        data[i] = (uint8_t)((uint32_t)value >> (8 * i));
+    }
+}
+
+static int32_t _get_le32(const uint8_t *data)
+{
+    return (int32_t)((uint32_t)data[0] | ((uint32_t)data[1] << 8) | ((uint32_t)data[2] << 16) | ((uint32_t)data[3] << 24));
+}
+
+/*-----------------------------------------------------------
+* PUBLIC C API
+*----------------------------------------------------------*/
+esp_err_t mcp342x_calibration_measure(mcp342x_info_t *mcp342x_info_ptr, uint16_t samples, int32_t *mean_q8)
+{
+    if (samples == 0)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    const mcp342x_calibration_t *calibration = mcp342x_info_ptr->calibration;
+    bool oneshot = (mcp342x_info_ptr->config & MCP342X_MODE_MASK) == MCP342X_MODE_ONESHOT;
+    esp_err_t err = ESP_OK;
+    int64_t sum = 0;
+
+    mcp342x_info_ptr->calibration = NULL;
+    for (uint16_t i = 0; i < samples && err == ESP_OK; i++)
+    {
+        int32_t code = 0;
+        if (oneshot)
+        {
+            err = mcp342x_start_new_conversion(mcp342x_info_ptr);
+        }
+        if (err == ESP_OK)
+        {
+            mcp342x_conversion_status_t status = mcp342x_read_raw(mcp342x_info_ptr, &code);
+            if (status == MCP342X_STATUS_OVERFLOW || status == MCP342X_STATUS_UNDERFLOW)
+            {
+                ESP_LOGE(TAG, "reference input out of range");
+                err = ESP_ERR_INVALID_RESPONSE;
+            }
+            else if (status != MCP342X_STATUS_OK)
+            {
+                err = ESP_FAIL;
+            }
+        }
+        sum += code;
+    }
+    mcp342x_info_ptr->calibration = calibration;
+
+    if (err == ESP_OK)
+    {
+        *mean_q8 = (int32_t)((sum * 256) / samples);
+    }
+    return err;
+}
+
+esp_err_t mcp342x_calibration_two_point(mcp342x_calibration_t *calibration, uint8_t config,
+                                        int32_t low_q8, int32_t low_nv, int32_t high_q8, int32_t high_nv)
+{
+    if (high_q8 == low_q8 || high_nv == low_nv)
+    {
+        ESP_LOGE(TAG, "calibration points coincide");
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    /**
+     * Ideal codes of the references in 1/256 LSB, then solve
+     * (measured - offset) * gain = ideal for both points
+     */
+    int64_t lsb_nv_q3 = mcp342x_lsb_nv_q3(config);
+    int64_t ideal_low_q8 = (int64_t)low_nv * 2048 / lsb_nv_q3;
+    int64_t ideal_high_q8 = (int64_t)high_nv * 2048 / lsb_nv_q3;
+    int64_t gain_q24 = (ideal_high_q8 - ideal_low_q8) * (1 << MCP342X_CALIBRATION_TRIM_SHIFT) / ((int64_t)high_q8 - low_q8);
+    int64_t gain_trim_q24 = gain_q24 - (1 << MCP342X_CALIBRATION_TRIM_SHIFT);
+
+    if (gain_q24 <= 0 || gain_trim_q24 >= (1 << 30) || gain_trim_q24 <= -(1 << 30))
+    {
+        ESP_LOGE(TAG, "gain correction out of range");
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    mcp342x_calibration_entry_t *entry = &calibration->entry[mcp342x_calibration_index(config)];
+    entry->offset_q8 = (int32_t)(low_q8 - ideal_low_q8 * (1 << MCP342X_CALIBRATION_TRIM_SHIFT) / gain_q24);
+    entry->gain_trim_q24 = (int32_t)gain_trim_q24;
+    return ESP_OK;
+}
+
+esp_err_t mcp342x_calibration_serialize(const mcp342x_calibration_t *calibration, uint8_t *blob, size_t *len)
+{
+    size_t used = 4;
+    uint8_t count = 0;
+
+    for (uint8_t i = 0; i < MCP342X_CALIBRATION_ENTRIES; i++)
+    {
+        const mcp342x_calibration_entry_t *entry = &calibration->entry[i];
+        if (entry->offset_q8 == 0 && entry->gain_trim_q24 == 0)
+        {
+            continue;
+        }
+        if (used + 9 + 2 > *len)
+        {
+            return ESP_ERR_INVALID_SIZE;
+        }
+        blob[used] = i;
+        _put_le32(&blob[used + 1], entry->offset_q8);
+        _put_le32(&blob[used + 5], entry->gain_trim_q24);
+        used += 9;
+        count++;
+    }
+    if (used + 2 > *len)
+    {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    blob[0] = MCP342X_CALIBRATION_MAGIC[0];
+    blob[1] = MCP342X_CALIBRATION_MAGIC[1];
+    blob[2] = MCP342X_CALIBRATION_VERSION;
+    blob[3] = count;
+    uint16_t checksum = _fletcher16(blob, used);
+    blob[used++] = checksum & 0xFF;
+    blob[used++] = checksum >> 8;
+    *len = used;
+    return ESP_OK;
+}
+
+esp_err_t mcp342x_calibration_deserialize(mcp342x_calibration_t *calibration, const uint8_t *blob, size_t len)
+{
+    if (len < 6 || blob[0] != MCP342X_CALIBRATION_MAGIC[0] || blob[1] != MCP342X_CALIBRATION_MAGIC[1])
+    {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    if (blob[2] != MCP342X_CALIBRATION_VERSION)
+    {
+        return ESP_ERR_INVALID_VERSION;
+    }
+    size_t used = 4 + 9 * (size_t)blob[3];
+    if (len < used + 2)
+    {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    if (_fletcher16(blob, used) != (blob[used] | (blob[used + 1] << 8)))
+    {
+        return ESP_ERR_INVALID_CRC;
+    }
+
+    for (size_t offset = 4; offset < used; offset += 9)
+    {
+        if (blob[offset] >= MCP342X_CALIBRATION_ENTRIES)
+        {
+            return ESP_ERR_INVALID_SIZE;
+        }
+    }
+
+    memset(calibration, 0, sizeof(*calibration));
+    for (size_t offset = 4; offset < used; offset += 9)
+    {
+        uint8_t index = blob[offset];
+        calibration->entry[index].offset_q8 = _get_le32(&blob[offset + 1]);
+        calibration->entry[index].gain_trim_q24 = _get_le32(&blob[offset + 5]);
+    }
+    return ESP_OK;
+}
+
+esp_err_t mcp342x_calibration_save_file(const mcp342x_calibration_t *calibration, const char *path)
+{
+    uint8_t blob[MCP342X_CALIBRATION_BLOB_MAX];
+    size_t len = sizeof(blob);
+    esp_err_t err = mcp342x_calibration_serialize(calibration, blob, &len);
+    if (err != ESP_OK)
+    {
+        return err;
+    }
+
+    FILE *file = fopen(path, "wb");
+    if (file == NULL)
+    {
+        ESP_LOGE(TAG, "cannot create %s", path);
+        return ESP_ERR_NOT_FOUND;
+    }
+    bool written = fwrite(blob, 1, len, file) == len;
+    if (fclose(file) != 0 || !written)
+    {
+        ESP_LOGE(TAG, "cannot write %s", path);
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+esp_err_t mcp342x_calibration_load_file(mcp342x_calibration_t *calibration, const char *path)
+{
+    FILE *file = fopen(path, "rb");
+    if (file == NULL)
+    {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    /**
+     * Read one byte past the largest blob so oversized files are refused
+     */
+    uint8_t blob[MCP342X_CALIBRATION_BLOB_MAX + 1];
+    size_t len = fread(blob, 1, sizeof(blob), file);
+    bool failed = ferror(file) != 0;
+    fclose(file);
+    if (failed)
+    {
+        ESP_LOGE(TAG, "cannot read %s", path);
+        return ESP_FAIL;
+    }
+    if (len > MCP342X_CALIBRATION_BLOB_MAX)
+    {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    return mcp342x_calibration_deserialize(calibration, blob, len);
+}
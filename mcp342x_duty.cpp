@@ -0,0 +1,189 @@
+/*
+    Craft Metrics
+
+    This product includes software developed by
+    Craft Metrics (https://craftmetrics.ca/).
+
+    MIT License
+    Copyright (c) 2018 Craft Metrics
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+
+#include "mcp342x_duty.h"
+#include "mcp342x_priv.h"
+
+#include <string.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+
+static const char *TAG = "mcp342x_duty";
+
+namespace cm
+{
+
+MCP342xDutyCycle::MCP342xDutyCycle(const mcp342x_energy_model_t &in_model)
+    : model(in_model)
+{
+    this->count = 0;
+    this->ResetEnergy();
+}
+
+esp_err_t MCP342xDutyCycle::AddChannel(MCP342x *device, mcp342x_channel_t channel, uint32_t period_us)
+{
+    if (device == NULL || period_us == 0)
+    {
+        ESP_LOGE(TAG, "invalid device or period");
+        return ESP_ERR_INVALID_ARG;
+    }
+    if ((device->GetInfoPtr()->config & MCP342X_MODE_MASK) != MCP342X_MODE_ONESHOT)
+    {
+        ESP_LOGE(TAG, "device is not in one-shot mode");
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (this->count >= MAX_CHANNELS)
+    {
+        ESP_LOGE(TAG, "no free channel slot");
+        return ESP_ERR_NO_MEM;
+    }
+
+    entry_t *entry = &this->entries[this->count++];
+    entry->device = device;
+    entry->channel = (mcp342x_channel_t)(channel & MCP342X_CHANNEL_MASK);
+    entry->period_us = period_us;
+    entry->due_us = esp_timer_get_time();
+    return ESP_OK;
+}
+
+mcp342x_conversion_status_t MCP342xDutyCycle::Next(mcp342x_sample_t *sample)
+{
+    if (this->count == 0)
+    {
+        ESP_LOGE(TAG, "no channel added");
+        return MCP342X_STATUS_INVALID_STATE;
+    }
+
+    size_t index = 0;
+    for (size_t i = 1; i < this->count; i++)
+    {
+        if (this->entries[i].due_us < this->entries[index].due_us)
+        {
+            index = i;
+        }
+    }
+    entry_t *entry = &this->entries[index];
+    mcp342x_info_t *info = entry->device->GetInfoPtr();
+
+    mcp342x_delay_until_us(entry->due_us);
+
+    /**
+     * Keep the schedule, but drop periods missed while the caller was busy
+     */
+    entry->due_us += entry->period_us;
+    int64_t now_us = esp_timer_get_time();
+    if (entry->due_us < now_us)
+    {
+        entry->due_us = now_us + entry->period_us;
+    }
+
+    mcp342x_stats_t before = info->stats;
+    int64_t busy_us = 0;
+    int64_t start_us = esp_timer_get_time();
+    mcp342x_conversion_status_t status;
+
+    if (entry->device->StartNewConversion(entry->channel) != ESP_OK)
+    {
+        status = MCP342X_STATUS_I2C;
+        memset(sample, 0, sizeof(*sample));
+        sample->start_us = (uint32_t)start_us;
+        sample->ready_us = (uint32_t)start_us;
+        sample->config = info->config;
+        sample->status = status;
+        busy_us += esp_timer_get_time() - start_us;
+    }
+    else
+    {
+        busy_us += esp_timer_get_time() - start_us;
+        int64_t conversion_us = mcp342x_conversion_time_us((mcp342x_sample_rate_t)(info->config & MCP342X_SRATE_MASK));
+        int64_t deadline_us = info->conversion_start_us + 2 * conversion_us + MCP342X_TIMEOUT_SLACK_US;
+        int64_t wait_us = conversion_us;
+
+        while (true)
+        {
+            mcp342x_delay_until_us(info->conversion_start_us + wait_us);
+            start_us = esp_timer_get_time();
+            status = entry->device->TryReadSample(sample);
+            busy_us += esp_timer_get_time() - start_us;
+            if (status != MCP342X_STATUS_IN_PROGRESS)
+            {
+                break;
+            }
+            if (start_us >= deadline_us)
+            {
+                info->stats.timeouts++;
+                status = MCP342X_STATUS_TIMEOUT;
+                sample->status = status;
+                break;
+            }
+            // Early, the device clock runs slower than nominal
+            wait_us = start_us - info->conversion_start_us + conversion_us / 16;
+        }
+    }
+
+    sample->device = index;
+    this->Account(&before, &info->stats, busy_us);
+    return status;
+}
+
+uint64_t MCP342xDutyCycle::GetEnergyNj(void)
+{
+    return this->energy_nj;
+}
+
+uint32_t MCP342xDutyCycle::GetEnergyPerSampleNj(void)
+{
+    return this->samples > 0 ? this->energy_nj / this->samples : 0;
+}
+
+uint32_t MCP342xDutyCycle::GetAwakeUs(void)
+{
+    return this->awake_us;
+}
+
+void MCP342xDutyCycle::ResetEnergy(void)
+{
+    this->energy_nj = 0;
+    this->awake_us = 0;
+    this->samples = 0;
+}
+
+/**
+ * Bus energy from the bytes the device counters moved on, plus CPU time spent in transfers.
+ * uW times us is pJ.
+ */
+void MCP342xDutyCycle::Account(const mcp342x_stats_t *before, const mcp342x_stats_t *after, int64_t busy_us)
+{
+    uint32_t bytes = (after->bytes_written - before->bytes_written) + (after->bytes_read - before->bytes_read);
+    this->energy_nj += (uint64_t)bytes * this->model.nj_per_byte + ((uint64_t)busy_us * this->model.awake_uw) / 1000;
+    this->awake_us += busy_us;
+    this->samples++;
+}
+
+} // namespace cm
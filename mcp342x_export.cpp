@@ -0,0 +1,146 @@
+/*
+    Craft Metrics
+
+    This product includes software developed by
+    Craft Metrics (https://craftmetrics.ca/).
+
+    MIT License
+    Copyright (c) 2018 Craft Metrics
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+
+#include "mcp342x_export.h"
+#include "mcp342x.h"
+
+#include <string.h>
+
+/*-----------------------------------------------------------
+* PRIVATE
+*----------------------------------------------------------*/
+static size_t _put_varint(uint8_t *data, uint32_t value)
+{
+    size_t n = 0;
+    while (value >= 0x80)
+    {
+        data[n++] = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    data[n++] = (uint8_t)value;
+    return n;
+}
+
+static uint32_t _zigzag(int32_t value)
+{
+    return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+}
+
+static void _put_le16(uint8_t *data, uint16_t value)
+{
+    data[0] = (uint8_t)value;
+    data[1] = (uint8_t)(value >> 8);
+}
+
+static void _put_le32(uint8_t *data, uint32_t value)
+{
+    _put_le16(data, (uint16_t)value);
+    _put_le16(&data[2], (uint16_t)(value >> 16));
+}
+
+/*-----------------------------------------------------------
+* PUBLIC C API
+*----------------------------------------------------------*/
+void mcp342x_export_init(mcp342x_export_encoder_t *encoder, uint8_t *buffer, size_t capacity)
+{
+    memset(encoder, 0, sizeof(*encoder));
+    encoder->buffer = buffer;
+    encoder->capacity = capacity;
+}
+
+bool mcp342x_export_append(mcp342x_export_encoder_t *encoder, const struct MCP342xSample *sample)
+{
+    if (sample->status != MCP342X_STATUS_OK && sample->status != MCP342X_STATUS_OVERFLOW &&
+        sample->status != MCP342X_STATUS_UNDERFLOW)
+    {
+        encoder->skipped++;
+        return true;
+    }
+
+    /**
+     * Encode into a scratch record first, so a full buffer leaves the export intact
+     */
+    uint8_t record[MCP342X_EXPORT_HEADER_SIZE + 10];
+    size_t n = 0;
+    uint32_t period_us = 0;
+    bool new_block = !encoder->open || encoder->config != sample->config || encoder->count == UINT16_MAX;
+
+    if (new_block)
+    {
+        record[0] = 'M';
+        record[1] = 'X';
+        record[2] = MCP342X_EXPORT_VERSION;
+        record[3] = sample->config;
+        _put_le16(&record[4], 0);
+        _put_le32(&record[6], sample->ready_us);
+        _put_le32(&record[10], 0);
+        n = MCP342X_EXPORT_HEADER_SIZE;
+        n += _put_varint(&record[n], _zigzag(sample->code));
+    }
+    else
+    {
+        uint32_t interval_us = sample->ready_us - encoder->last_us;
+        period_us = (encoder->count == 1) ? interval_us : encoder->period_us;
+        n += _put_varint(&record[n], _zigzag(sample->code - encoder->last_code));
+        n += _put_varint(&record[n], _zigzag((int32_t)(interval_us - period_us)));
+    }
+
+    if (encoder->length + n > encoder->capacity)
+    {
+        return false;
+    }
+    if (new_block)
+    {
+        mcp342x_export_close(encoder);
+        encoder->block = encoder->length;
+        encoder->open = true;
+        encoder->config = sample->config;
+        encoder->count = 0;
+    }
+    else if (encoder->count == 1)
+    {
+        _put_le32(&encoder->buffer[encoder->block + 10], period_us);
+    }
+    encoder->period_us = period_us;
+    memcpy(&encoder->buffer[encoder->length], record, n);
+    encoder->length += n;
+    encoder->count++;
+    encoder->last_code = sample->code;
+    encoder->last_us = sample->ready_us;
+    return true;
+}
+
+void mcp342x_export_close(mcp342x_export_encoder_t *encoder)
+{
+    if (encoder->open)
+    {
+        _put_le16(&encoder->buffer[encoder->block + 4], encoder->count);
+        encoder->open = false;
+    }
+}
@@ -0,0 +1,134 @@
+/*
+    Craft Metrics
+
+    This product includes software developed by
+    Craft Metrics (https://craftmetrics.ca/).
+
+    MIT License
+    Copyright (c) 2018 Craft Metrics
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+
+/**
+ * Decoder of the binary export format, free of ESP-IDF dependencies so it
+ * can be built into host tools together with include/mcp342x_export.h
+ */
+#include "mcp342x_export.h"
+
+#include <string.h>
+
+/*-----------------------------------------------------------
+* PRIVATE
+*----------------------------------------------------------*/
+static bool _get_varint(mcp342x_export_decoder_t *decoder, uint32_t *value)
+{
+    *value = 0;
+    for (uint8_t shift = 0; shift < 35; shift += 7)
+    {
+        if (decoder->offset >= decoder->length)
+        {
+            return false;
+        }
+        uint8_t byte = decoder->data[decoder->offset++];
+        *value |= (uint32_t)(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+static int32_t _unzigzag(uint32_t value)
+{
+    return (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+}
+
+static uint32_t _get_le(const uint8_t *data, uint8_t bytes)
+{
+    uint32_t value = 0;
+    for (uint8_t i = 0; i < bytes; i++)
+    {
+        value |= (uint32_t)data[i] << (8 * i);
+    }
+    return value;
+}
+
+static bool _open_block(mcp342x_export_decoder_t *decoder)
+{
+    const uint8_t *header = &decoder->data[decoder->offset];
+    if (decoder->length - decoder->offset < MCP342X_EXPORT_HEADER_SIZE ||
+        header[0] != 'M' || header[1] != 'X' || header[2] != MCP342X_EXPORT_VERSION)
+    {
+        return false;
+    }
+    decoder->config = header[3];
+    decoder->remaining = (uint16_t)_get_le(&header[4], 2);
+    decoder->timestamp_us = _get_le(&header[6], 4);
+    decoder->period_us = _get_le(&header[10], 4);
+    decoder->code = 0;
+    decoder->first = true;
+    decoder->offset += MCP342X_EXPORT_HEADER_SIZE;
+    return true;
+}
+
+/*-----------------------------------------------------------
+* PUBLIC C API
+*----------------------------------------------------------*/
+void mcp342x_export_decoder_init(mcp342x_export_decoder_t *decoder, const uint8_t *data, size_t length)
+{
+    memset(decoder, 0, sizeof(*decoder));
+    decoder->data = data;
+    decoder->length = length;
+}
+
+bool mcp342x_export_next(mcp342x_export_decoder_t *decoder, mcp342x_export_record_t *record)
+{
+    while (decoder->remaining == 0)
+    {
+        if (decoder->offset >= decoder->length || !_open_block(decoder))
+        {
+            return false;
+        }
+    }
+
+    uint32_t value;
+    if (!_get_varint(decoder, &value))
+    {
+        return false;
+    }
+    decoder->code += _unzigzag(value);
+    if (!decoder->first)
+    {
+        if (!_get_varint(decoder, &value))
+        {
+            return false;
+        }
+        decoder->timestamp_us += decoder->period_us + (uint32_t)_unzigzag(value);
+    }
+    decoder->first = false;
+    decoder->remaining--;
+
+    record->code = decoder->code;
+    record->timestamp_us = decoder->timestamp_us;
+    record->config = decoder->config;
+    return true;
+}
@@ -0,0 +1,271 @@
+/*
+    Craft Metrics
+
+    This product includes software developed by
+    Craft Metrics (https://craftmetrics.ca/).
+
+    MIT License
+    Copyright (c) 2018 Craft Metrics
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+
+#include "mcp342x_filter.h"
+
+#include <string.h>
+#include <esp_log.h>
+
+static const char *TAG = "mcp342x_filter";
+
+/*-----------------------------------------------------------
+* PRIVATE
+*----------------------------------------------------------*/
+static void _boxcar_push(mcp342x_filter_t *filter, int32_t code)
+{
+    filter->integrator[0] += (uint32_t)code;
+}
+
+/**
+ * Integrators run at the input rate and wrap modulo 2^32,
+ * which the combs undo as long as the output fits in 32 bits
+ */
+static void _cic_integrate(mcp342x_filter_t *filter, int32_t code)
+{
+    uint32_t value = (uint32_t)code;
+    for (uint8_t i = 0; i < filter->order; i++)
+    {
+        filter->integrator[i] += value;
+        value = filter->integrator[i];
+    }
+}
+
+static int32_t _cic_comb(mcp342x_filter_t *filter)
+{
+    uint32_t value = filter->integrator[filter->order - 1];
+    for (uint8_t i = 0; i < filter->order; i++)
+    {
+        uint32_t delayed = filter->comb[i];
+        filter->comb[i] = value;
+        value -= delayed;
+    }
+    return (int32_t)value;
+}
+
+/**
+ * The second half of the buffer holds the window sorted,
+ * replace the oldest code with the new one by insertion
+ */
+static void _median_insert(mcp342x_filter_t *filter, int32_t code)
+{
+    int32_t *ring = filter->window;
+    int32_t *sorted = &filter->window[filter->window_size];
+    uint16_t n = filter->window_fill;
+
+    if (n == filter->window_size)
+    {
+        int32_t oldest = ring[filter->window_pos];
+        uint16_t i = 0;
+        while (sorted[i] != oldest)
+        {
+            i++;
+        }
+        memmove(&sorted[i], &sorted[i + 1], (n - i - 1) * sizeof(int32_t));
+        n--;
+    }
+    else
+    {
+        filter->window_fill++;
+    }
+
+    uint16_t i = n;
+    while (i > 0 && sorted[i - 1] > code)
+    {
+        sorted[i] = sorted[i - 1];
+        i--;
+    }
+    sorted[i] = code;
+
+    ring[filter->window_pos] = code;
+    filter->window_pos = (filter->window_pos + 1) % filter->window_size;
+}
+
+static esp_err_t _init(mcp342x_filter_t *filter, mcp342x_filter_type_t type, uint16_t decimation)
+{
+    if (filter == NULL || decimation == 0)
+    {
+        ESP_LOGE(TAG, "invalid filter or decimation");
+        return ESP_ERR_INVALID_ARG;
+    }
+    memset(filter, 0, sizeof(*filter));
+    filter->type = type;
+    filter->decimation = decimation;
+    filter->gain = 1;
+    return ESP_OK;
+}
+
+/*-----------------------------------------------------------
+* PUBLIC C API
+*----------------------------------------------------------*/
+esp_err_t mcp342x_filter_init_boxcar(mcp342x_filter_t *filter, uint16_t decimation)
+{
+    if (decimation > MCP342X_FILTER_MAX_GAIN)
+    {
+        ESP_LOGE(TAG, "decimation %d too large", decimation);
+        return ESP_ERR_INVALID_ARG;
+    }
+    esp_err_t err = _init(filter, MCP342X_FILTER_BOXCAR, decimation);
+    if (err == ESP_OK)
+    {
+        filter->gain = decimation;
+    }
+    return err;
+}
+
+esp_err_t mcp342x_filter_init_cic(mcp342x_filter_t *filter, uint16_t decimation, uint8_t order)
+{
+    if (order == 0 || order > MCP342X_FILTER_CIC_MAX_ORDER)
+    {
+        ESP_LOGE(TAG, "invalid CIC order %d", order);
+        return ESP_ERR_INVALID_ARG;
+    }
+    esp_err_t err = _init(filter, MCP342X_FILTER_CIC, decimation);
+    if (err != ESP_OK)
+    {
+        return err;
+    }
+
+    uint32_t gain = 1;
+    for (uint8_t i = 0; i < order; i++)
+    {
+        gain *= decimation;
+        if (gain > MCP342X_FILTER_MAX_GAIN)
+        {
+            ESP_LOGE(TAG, "CIC gain %d^%d too large", decimation, order);
+            return ESP_ERR_INVALID_ARG;
+        }
+    }
+    filter->order = order;
+    filter->gain = gain;
+    return ESP_OK;
+}
+
+esp_err_t mcp342x_filter_init_median(mcp342x_filter_t *filter, uint16_t decimation, uint16_t window_size, int32_t *buffer)
+{
+    if (window_size == 0 || buffer == NULL)
+    {
+        ESP_LOGE(TAG, "invalid median window");
+        return ESP_ERR_INVALID_ARG;
+    }
+    esp_err_t err = _init(filter, MCP342X_FILTER_MEDIAN, decimation);
+    if (err == ESP_OK)
+    {
+        filter->window = buffer;
+        filter->window_size = window_size;
+    }
+    return err;
+}
+
+bool mcp342x_filter_push(mcp342x_filter_t *filter, int32_t code, int32_t *output)
+{
+    if (code > MCP342X_FILTER_CODE_MAX)
+    {
+        code = MCP342X_FILTER_CODE_MAX;
+    }
+    else if (code < MCP342X_FILTER_CODE_MIN)
+    {
+        code = MCP342X_FILTER_CODE_MIN;
+    }
+
+    switch (filter->type)
+    {
+    case MCP342X_FILTER_BOXCAR:
+        _boxcar_push(filter, code);
+        break;
+    case MCP342X_FILTER_CIC:
+        _cic_integrate(filter, code);
+        break;
+    case MCP342X_FILTER_MEDIAN:
+        _median_insert(filter, code);
+        break;
+    }
+
+    if (++filter->count < filter->decimation)
+    {
+        return false;
+    }
+    filter->count = 0;
+
+    switch (filter->type)
+    {
+    case MCP342X_FILTER_BOXCAR:
+        *output = (int32_t)filter->integrator[0];
+        filter->integrator[0] = 0;
+        break;
+    case MCP342X_FILTER_CIC:
+        *output = _cic_comb(filter);
+        break;
+    case MCP342X_FILTER_MEDIAN:
+        *output = filter->window[filter->window_size + filter->window_fill / 2];
+        break;
+    }
+    return true;
+}
+
+int32_t mcp342x_filter_to_nanovolts(const mcp342x_filter_t *filter, const mcp342x_info_t *mcp342x_info_ptr, int32_t output)
+{
+    return ((int64_t)output * mcp342x_info_ptr->lsb_nv_q3) / (8 * (int64_t)filter->gain);
+}
+
+esp_err_t mcp342x_filter_plan(uint32_t max_latency_us, bool has_18bit, mcp342x_sample_rate_t *sample_rate, uint16_t *decimation)
+{
+    static const mcp342x_sample_rate_t rates[] = {
+        MCP342X_SRATE_18BIT,
+        MCP342X_SRATE_16BIT,
+        MCP342X_SRATE_14BIT,
+        MCP342X_SRATE_12BIT,
+    };
+    static const uint8_t bits[] = {18, 16, 14, 12};
+    uint64_t best_score = 0;
+
+    for (uint8_t i = has_18bit ? 0 : 1; i < 4; i++)
+    {
+        uint32_t n = max_latency_us / mcp342x_conversion_time_max_us(rates[i]);
+        if (n == 0)
+        {
+            continue;
+        }
+        if (n > MCP342X_FILTER_MAX_GAIN)
+        {
+            n = MCP342X_FILTER_MAX_GAIN;
+        }
+
+        /**
+         * Noise power relative to one LSB at 12 bits, inverted: 4^bits * n
+         */
+        uint64_t score = ((uint64_t)n) << (2 * (bits[i] - 12));
+        if (score > best_score)
+        {
+            best_score = score;
+            *sample_rate = rates[i];
+            *decimation = n;
+        }
+    }
+    return best_score > 0 ? ESP_OK : ESP_ERR_NOT_FOUND;
+}
@@ -0,0 +1,81 @@
+/*
+    Craft Metrics
+
+    This product includes software developed by
+    Craft Metrics (https://craftmetrics.ca/).
+
+    MIT License
+    Copyright (c) 2018 Craft Metrics
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+/**
+ * Helpers shared between the driver sources, not part of the public API
+ */
+
+#ifndef ESP32_MCP342X_PRIV_H
+#define ESP32_MCP342X_PRIV_H
+
+#include "mcp342x.h"
+
+#include <stdint.h>
+#include <sdkconfig.h>
+#include <esp_log.h>
+
+/**
+ * Logging on the per-sample path, compiled out unless CONFIG_MCP342X_SAMPLE_LOG is set
+ */
+#ifdef CONFIG_MCP342X_SAMPLE_LOG
+#define MCP342X_SAMPLE_LOGW(tag, format, ...) ESP_LOGW(tag, format, ##__VA_ARGS__)
+#define MCP342X_SAMPLE_LOGD(tag, format, ...) ESP_LOGD(tag, format, ##__VA_ARGS__)
+#define MCP342X_SAMPLE_LOGV(tag, format, ...) ESP_LOGV(tag, format, ##__VA_ARGS__)
+#else
+#define MCP342X_SAMPLE_LOGW(tag, format, ...) do { } while (0)
+#define MCP342X_SAMPLE_LOGD(tag, format, ...) do { } while (0)
+#define MCP342X_SAMPLE_LOGV(tag, format, ...) do { } while (0)
+#endif
+
+// Extra time allowed on top of twice the conversion time before a read times out
+#define MCP342X_TIMEOUT_SLACK_US (10000)
+
+/**
+ * Sleep for at least the given time without holding the bus or the CPU.
+ * The task blocks in whole ticks, so short delays last until the next tick.
+ */
+void mcp342x_delay_us(int64_t delay_us);
+
+/**
+ * Sleep until esp_timer_get_time() has reached until_us, as mcp342x_delay_us
+ */
+void mcp342x_delay_until_us(int64_t until_us);
+
+/**
+ * Assemble the two's complement output code of the output register bytes for
+ * the resolution in config and sign-extend it to 32 bits. Full scale codes
+ * report MCP342X_STATUS_OVERFLOW or MCP342X_STATUS_UNDERFLOW.
+ */
+mcp342x_conversion_status_t mcp342x_output_code(uint8_t config, const uint8_t *buffer, int32_t *code);
+
+/**
+ * Split a config byte into the fields mcp342x_set_config takes, the RDY bit is dropped
+ */
+mcp342x_config_t mcp342x_config_from_byte(uint8_t config);
+
+#endif // ESP32_MCP342X_PRIV_H
@@ -0,0 +1,208 @@
+/*
+    Craft Metrics
+
+    This product includes software developed by
+    Craft Metrics (https://craftmetrics.ca/).
+
+    MIT License
+    Copyright (c) 2018 Craft Metrics
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+
+
+#include "mcp342x_probe.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <smbus.h>
+
+static const char *TAG = "mcp342x_probe";
+
+/*-----------------------------------------------------------
+* PRIVATE C API
+*----------------------------------------------------------*/
+
+static bool _has_code(mcp342x_conversion_status_t status)
+{
+    return status == MCP342X_STATUS_OK || status == MCP342X_STATUS_UNDERFLOW || status == MCP342X_STATUS_OVERFLOW;
+}
+
+/**
+ * Config bits the output register reports for every variant
+ */
+static bool _is_config(uint8_t byte, uint8_t config)
+{
+    uint8_t mask = (uint8_t)~(MCP342X_CNTRL_MASK | MCP342X_CHANNEL_MASK);
+    return (byte & mask) == (config & mask);
+}
+
+/**
+ * The output register is read before and after a config write that changes the
+ * gain without starting a conversion. The data bytes stay, the config byte follows
+ * the write. At 18 bits the output is three data bytes then the config byte,
+ * parts without 18 bits send two data bytes and repeat the config byte after them.
+ *
+ * @return Index of the config byte, 0 if the layout matches neither.
+ */
+static size_t _config_index(const uint8_t *before, const uint8_t *after, uint8_t config_before, uint8_t config_after)
+{
+    if (_is_config(before[3], config_before) && _is_config(after[3], config_after) &&
+        memcmp(before, after, 3) == 0)
+    {
+        return 3;
+    }
+    if (_is_config(before[2], config_before) && _is_config(after[2], config_after) &&
+        memcmp(before, after, 2) == 0 && after[3] == after[2])
+    {
+        return 2;
+    }
+    return 0;
+}
+
+/**
+ * Single channel parts leave the channel bits unimplemented, so they read back
+ * zero after selecting channel 4. Other parts may store the bits whether or not
+ * the channel exists, so two and four channels can not be told apart.
+ */
+static uint8_t _channel_count(uint8_t config)
+{
+    return (config & MCP342X_CHANNEL_MASK) == 0 ? 1 : 0;
+}
+
+/**
+ * Load the config into every device and start all their conversions with one general call
+ */
+static esp_err_t _convert_all(mcp342x_probe_result_t *results, size_t count, mcp342x_config_t config)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        mcp342x_set_config(&results[i].mcp342x_info, config);
+        mcp342x_write_config(&results[i].mcp342x_info);
+    }
+    esp_err_t err = mcp342x_general_call(&results[0].mcp342x_info, MCP342X_GC_CONVERSION);
+    int64_t trigger_us = esp_timer_get_time();
+    for (size_t i = 0; i < count; i++)
+    {
+        results[i].mcp342x_info.conversion_start_us = trigger_us;
+        results[i].mcp342x_info.stats.conversions++;
+    }
+    return err;
+}
+
+/*-----------------------------------------------------------
+* PUBLIC C API
+*----------------------------------------------------------*/
+
+esp_err_t mcp342x_probe(i2c_port_t i2c_port, const mcp342x_bus_t *bus, mcp342x_config_t in_config,
+                        mcp342x_probe_result_t *results, size_t max_results, size_t *found)
+{
+    if (results == NULL || found == NULL)
+    {
+        ESP_LOGE(TAG, "results or found is NULL");
+        return ESP_ERR_INVALID_ARG;
+    }
+    *found = 0;
+    const mcp342x_bus_t *probe_bus = (bus != NULL) ? bus : &mcp342x_i2c_bus;
+
+    /**
+     * Latch the address pins first, parts that powered up before their
+     * pins settled answer on the right address from here on
+     */
+    smbus_info_t general_call_info;
+    smbus_init(&general_call_info, i2c_port, MCP342X_GC_START);
+    smbus_set_timeout(&general_call_info, 1000 / portTICK_RATE_MS);
+    uint8_t latch = MCP342X_GC_LATCH;
+    if (probe_bus->write(probe_bus->context, &general_call_info, &latch, 1) != ESP_OK)
+    {
+        ESP_LOGD(TAG, "general call latch not acknowledged");
+    }
+
+    /**
+     * Sweep the addresses, the config write of mcp342x_init is the presence test
+     */
+    size_t count = 0;
+    for (uint8_t address = MCP342X_A0GND_A1GND; address < MCP342X_A0GND_A1GND + MCP342X_PROBE_ADDRESSES && count < max_results; address++)
+    {
+        mcp342x_probe_result_t *result = &results[count];
+        memset(result, 0, sizeof(*result));
+        result->address = (mcp342x_address_t)address;
+        smbus_init(&result->smbus_info, i2c_port, address);
+        smbus_set_timeout(&result->smbus_info, 1000 / portTICK_RATE_MS);
+        mcp342x_set_bus(&result->mcp342x_info, bus);
+        if (mcp342x_init(&result->mcp342x_info, &result->smbus_info, in_config) == ESP_OK)
+        {
+            count++;
+        }
+    }
+    if (count == 0)
+    {
+        ESP_LOGW(TAG, "no device found on port %d", i2c_port);
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    /**
+     * One 18 bit conversion on all devices at once, then the output register
+     * is read around a config write that must not start another one
+     */
+    mcp342x_config_t probe_config = {MCP342X_CHANNEL_1, MCP342X_MODE_ONESHOT, MCP342X_SRATE_18BIT, MCP342X_GAIN_1X};
+    _convert_all(results, count, probe_config);
+    uint8_t config_before = results[0].mcp342x_info.config;
+    uint8_t config_after = (uint8_t)(MCP342X_CHANNEL_4 | MCP342X_MODE_ONESHOT | MCP342X_SRATE_18BIT | MCP342X_GAIN_8X);
+    for (size_t i = 0; i < count; i++)
+    {
+        mcp342x_probe_result_t *result = &results[i];
+        uint8_t before[4];
+        uint8_t after[4];
+        int32_t code;
+        size_t index = 0;
+        if (_has_code(mcp342x_read_raw(&result->mcp342x_info, &code)) &&
+            probe_bus->read(probe_bus->context, &result->smbus_info, before, sizeof(before)) == ESP_OK &&
+            probe_bus->write(probe_bus->context, &result->smbus_info, &config_after, 1) == ESP_OK &&
+            probe_bus->read(probe_bus->context, &result->smbus_info, after, sizeof(after)) == ESP_OK)
+        {
+            index = _config_index(before, after, config_before, config_after);
+        }
+        mcp342x_invalidate_config(&result->mcp342x_info);
+
+        if (index != 0)
+        {
+            result->identified = true;
+            result->has_18bit = (index == 3);
+            result->channels = _channel_count(after[index]);
+            ESP_LOGI(TAG, "found 0x%02x, %s channel%s, %d bits", result->address,
+                     result->channels == 1 ? "1" : "2 or 4", result->channels == 1 ? "" : "s",
+                     result->has_18bit ? 18 : 16);
+        }
+        else
+        {
+            ESP_LOGW(TAG, "found 0x%02x, variant unknown", result->address);
+        }
+
+        mcp342x_set_config(&result->mcp342x_info, in_config);
+        mcp342x_write_config(&result->mcp342x_info);
+    }
+
+    *found = count;
+    return ESP_OK;
+}
@@ -0,0 +1,189 @@
+/*
+    Craft Metrics
+
+    This product includes software developed by
+    Craft Metrics (https://craftmetrics.ca/).
+
+    MIT License
+    Copyright (c) 2018 Craft Metrics
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+
+#include "mcp342x_scheduler.h"
+#include "mcp342x_priv.h"
+
+#include <string.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+
+static const char *TAG = "mcp342x_scheduler";
+
+namespace cm
+{
+
+static mcp342x_channel_t _channel_from_index(uint8_t index)
+{
+    return (mcp342x_channel_t)(index << 5);
+}
+
+static uint8_t _next_channel_index(uint8_t channel_mask, uint8_t index)
+{
+    for (uint8_t i = 1; i <= 4; i++)
+    {
+        uint8_t next = (index + i) % 4;
+        if (channel_mask & (1 << next))
+        {
+            return next;
+        }
+    }
+    return index;
+}
+
+MCP342xScheduler::MCP342xScheduler()
+{
+    this->count = 0;
+    this->queued = 0;
+}
+
+esp_err_t MCP342xScheduler::AddDevice(MCP342x *device, uint8_t channel_mask)
+{
+    if (device == NULL || (channel_mask & 0x0F) == 0)
+    {
+        ESP_LOGE(TAG, "invalid device or channel mask");
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (this->count >= MAX_DEVICES)
+    {
+        ESP_LOGE(TAG, "no free device slot");
+        return ESP_ERR_NO_MEM;
+    }
+
+    slot_t *slot = &this->slots[this->count++];
+    slot->device = device;
+    slot->channel_mask = channel_mask & 0x0F;
+    slot->channel_index = _next_channel_index(slot->channel_mask, 3);
+    slot->triggered = false;
+    slot->deadline_us = 0;
+    return ESP_OK;
+}
+
+esp_err_t MCP342xScheduler::Start(void)
+{
+    esp_err_t err = ESP_OK;
+    this->queued = 0;
+    for (uint8_t i = 0; i < this->count; i++)
+    {
+        esp_err_t trigger_err = this->Trigger(i);
+        if (trigger_err != ESP_OK)
+        {
+            err = trigger_err;
+        }
+        this->Enqueue(i);
+    }
+    return err;
+}
+
+size_t MCP342xScheduler::Collect(mcp342x_sample_t *samples, size_t max_samples)
+{
+    size_t n = 0;
+    while (n < max_samples && this->queued > 0)
+    {
+        uint8_t index = this->queue[0];
+        slot_t *slot = &this->slots[index];
+        this->queued--;
+        memmove(&this->queue[0], &this->queue[1], this->queued);
+
+        int64_t now_us = esp_timer_get_time();
+        if (slot->deadline_us > now_us)
+        {
+            mcp342x_delay_us(slot->deadline_us - now_us);
+        }
+
+        mcp342x_info_t *info = slot->device->GetInfoPtr();
+        int64_t conversion_us = mcp342x_conversion_time_us((mcp342x_sample_rate_t)(info->config & MCP342X_SRATE_MASK));
+        mcp342x_sample_t *sample = &samples[n];
+        if (!slot->triggered)
+        {
+            /**
+             * The channel's slot still yields a sample, so a dead bus cannot keep Collect spinning
+             */
+            memset(sample, 0, sizeof(*sample));
+            sample->start_us = (uint32_t)now_us;
+            sample->ready_us = (uint32_t)now_us;
+            sample->config = info->config;
+            sample->status = MCP342X_STATUS_I2C;
+        }
+        else if (slot->device->TryReadSample(sample) == MCP342X_STATUS_IN_PROGRESS)
+        {
+            now_us = esp_timer_get_time();
+            if (now_us < info->conversion_start_us + 2 * conversion_us + MCP342X_TIMEOUT_SLACK_US)
+            {
+                // Running slower than the typical data rate, check again shortly
+                slot->deadline_us = now_us + conversion_us / 16;
+                this->Enqueue(index);
+                continue;
+            }
+            sample->status = MCP342X_STATUS_TIMEOUT;
+            info->stats.timeouts++;
+        }
+
+        sample->device = index;
+        n++;
+
+        slot->channel_index = _next_channel_index(slot->channel_mask, slot->channel_index);
+        this->Trigger(index);
+        this->Enqueue(index);
+    }
+    return n;
+}
+
+esp_err_t MCP342xScheduler::Trigger(uint8_t index)
+{
+    slot_t *slot = &this->slots[index];
+    mcp342x_info_t *info = slot->device->GetInfoPtr();
+    int64_t conversion_us = mcp342x_conversion_time_us((mcp342x_sample_rate_t)(info->config & MCP342X_SRATE_MASK));
+
+    esp_err_t err = slot->device->StartNewConversion(_channel_from_index(slot->channel_index));
+    slot->triggered = (err == ESP_OK);
+    slot->deadline_us = esp_timer_get_time() + conversion_us;
+    if (err != ESP_OK)
+    {
+        MCP342X_SAMPLE_LOGW(TAG, "trigger on device %d failed: %d", index, err);
+    }
+    return err;
+}
+
+/**
+ * Insert a slot into the queue, keeping it sorted by deadline
+ */
+void MCP342xScheduler::Enqueue(uint8_t index)
+{
+    size_t position = this->queued;
+    while (position > 0 && this->slots[this->queue[position - 1]].deadline_us > this->slots[index].deadline_us)
+    {
+        this->queue[position] = this->queue[position - 1];
+        position--;
+    }
+    this->queue[position] = index;
+    this->queued++;
+}
+
+} // namespace cm
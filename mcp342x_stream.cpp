@@ -0,0 +1,277 @@
+/*
+    Craft Metrics
+
+    This product includes software developed by
+    Craft Metrics (https://craftmetrics.ca/).
+
+    MIT License
+    Copyright (c) 2018 Craft Metrics
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+
+#include "mcp342x_stream.h"
+#include "mcp342x_priv.h"
+
+#include <string.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+
+static const char *TAG = "mcp342x_stream";
+
+static const uint32_t MCP342X_STREAM_STACK_SIZE = 3072;
+
+namespace cm
+{
+
+MCP342xStream::MCP342xStream(MCP342x *in_device, mcp342x_sample_t *in_buffer, size_t in_capacity)
+    : head(0), tail(0), running(false), overruns(0), missed(0)
+{
+    this->device = in_device;
+    this->buffer = in_buffer;
+    this->mask = in_capacity - 1;
+    this->task = NULL;
+    this->stopped = NULL;
+    this->timer = NULL;
+    this->saved_mode = MCP342X_MODE_ONESHOT;
+    if (in_capacity == 0 || (in_capacity & (in_capacity - 1)) != 0)
+    {
+        ESP_LOGE(TAG, "capacity %d is not a power of two", (int)in_capacity);
+        this->buffer = NULL;
+    }
+}
+
+MCP342xStream::~MCP342xStream()
+{
+    this->Stop();
+    if (this->stopped != NULL)
+    {
+        vSemaphoreDelete(this->stopped);
+    }
+    if (this->timer != NULL)
+    {
+        esp_timer_delete(this->timer);
+    }
+}
+
+esp_err_t MCP342xStream::Start(UBaseType_t priority)
+{
+    if (this->buffer == NULL || this->device == NULL)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (this->running)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (this->stopped == NULL)
+    {
+        this->stopped = xSemaphoreCreateBinary();
+        if (this->stopped == NULL)
+        {
+            return ESP_ERR_NO_MEM;
+        }
+    }
+    if (this->timer == NULL)
+    {
+        esp_timer_create_args_t timer_args;
+        memset(&timer_args, 0, sizeof(timer_args));
+        timer_args.callback = &MCP342xStream::OnTimer;
+        timer_args.arg = this;
+        timer_args.dispatch_method = ESP_TIMER_TASK;
+        timer_args.name = TAG;
+        esp_err_t err = esp_timer_create(&timer_args, &this->timer);
+        if (err != ESP_OK)
+        {
+            this->timer = NULL;
+            return err;
+        }
+    }
+
+    /**
+     * Switch the device to continuous mode, which starts converting right away
+     */
+    esp_err_t err = this->SetMode(MCP342X_MODE_CONTINUOUS);
+    if (err != ESP_OK)
+    {
+        return err;
+    }
+
+    this->running = true;
+    if (xTaskCreate(&MCP342xStream::Task, "mcp342x_stream", MCP342X_STREAM_STACK_SIZE, this, priority, &this->task) != pdPASS)
+    {
+        this->running = false;
+        this->SetMode(this->saved_mode);
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+esp_err_t MCP342xStream::Stop(void)
+{
+    if (!this->running)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    this->running = false;
+    xSemaphoreTake(this->stopped, portMAX_DELAY);
+    esp_timer_stop(this->timer);
+    this->task = NULL;
+    return this->SetMode(this->saved_mode);
+}
+
+size_t MCP342xStream::Drain(mcp342x_sample_t *samples, size_t max_samples)
+{
+    uint32_t read_index = this->tail.load(std::memory_order_relaxed);
+    uint32_t available = this->head.load(std::memory_order_acquire) - read_index;
+    size_t n = available < max_samples ? available : max_samples;
+    for (size_t i = 0; i < n; i++)
+    {
+        samples[i] = this->buffer[(read_index + i) & this->mask];
+    }
+    this->tail.store(read_index + n, std::memory_order_release);
+    return n;
+}
+
+uint32_t MCP342xStream::GetOverruns(void)
+{
+    return this->overruns;
+}
+
+uint32_t MCP342xStream::GetMissed(void)
+{
+    return this->missed;
+}
+
+/**
+ * Write the device config with another conversion mode. Switching to
+ * continuous mode saves the mode to go back to on Stop().
+ */
+esp_err_t MCP342xStream::SetMode(mcp342x_conversion_mode_t mode)
+{
+    mcp342x_info_t *info = this->device->GetInfoPtr();
+    if (mode == MCP342X_MODE_CONTINUOUS)
+    {
+        this->saved_mode = (mcp342x_conversion_mode_t)(info->config & MCP342X_MODE_MASK);
+    }
+    mcp342x_set_config(info, mcp342x_config_from_byte((info->config & ~MCP342X_MODE_MASK) | mode));
+    return mcp342x_write_config(info);
+}
+
+void MCP342xStream::Task(void *arg)
+{
+    MCP342xStream *stream = (MCP342xStream *)arg;
+    stream->Run();
+    xSemaphoreGive(stream->stopped);
+    vTaskDelete(NULL);
+}
+
+/**
+ * Runs on the esp_timer task, only wakes the producer
+ */
+void MCP342xStream::OnTimer(void *arg)
+{
+    MCP342xStream *stream = (MCP342xStream *)arg;
+    xTaskNotifyGive(stream->task);
+}
+
+/**
+ * Block on a one-shot timer, conversions at 240 samples/s are shorter than a tick
+ */
+void MCP342xStream::Sleep(int64_t delay_us)
+{
+    if (esp_timer_start_once(this->timer, delay_us) == ESP_OK)
+    {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    }
+    else
+    {
+        mcp342x_delay_us(delay_us);
+    }
+}
+
+void MCP342xStream::Run(void)
+{
+    this->task = xTaskGetCurrentTaskHandle();
+    mcp342x_info_t *info = this->device->GetInfoPtr();
+    int64_t conversion_us = mcp342x_conversion_time_us((mcp342x_sample_rate_t)(info->config & MCP342X_SRATE_MASK));
+    int64_t ready_us = 0;
+    int64_t running_us = 0;
+
+    while (this->running)
+    {
+        mcp342x_sample_t sample;
+        mcp342x_conversion_status_t status = mcp342x_poll_sample(info, &sample);
+        int64_t now_us = esp_timer_get_time();
+
+        if (status == MCP342X_STATUS_IN_PROGRESS)
+        {
+            running_us = now_us;
+            this->Sleep(conversion_us / 8);
+            continue;
+        }
+        if (status == MCP342X_STATUS_I2C)
+        {
+            this->Sleep(conversion_us);
+            continue;
+        }
+
+        /**
+         * The output register only holds the latest result and results complete
+         * a conversion apart, so more than one since the last result read means
+         * the ones in between were overwritten. Completion times are tracked from
+         * the polls that found the conversion still running, so a late read alone
+         * does not count as a miss.
+         */
+        int64_t estimate_us = now_us;
+        if (ready_us != 0)
+        {
+            int64_t completed = (now_us - ready_us) / conversion_us;
+            if (completed > 1)
+            {
+                this->missed += completed - 1;
+            }
+            estimate_us = ready_us + completed * conversion_us;
+        }
+        ready_us = estimate_us < running_us ? running_us : (estimate_us > now_us ? now_us : estimate_us);
+        running_us = 0;
+        this->Push(&sample);
+
+        /**
+         * Sleep through most of the next conversion. Parts may convert up to
+         * 27 % faster than the typical rate, so wake well before it ends.
+         */
+        this->Sleep(conversion_us - 3 * conversion_us / 8);
+    }
+}
+
+void MCP342xStream::Push(const mcp342x_sample_t *sample)
+{
+    uint32_t write_index = this->head.load(std::memory_order_relaxed);
+    if (write_index - this->tail.load(std::memory_order_acquire) > this->mask)
+    {
+        this->overruns++;
+        return;
+    }
+    this->buffer[write_index & this->mask] = *sample;
+    this->head.store(write_index + 1, std::memory_order_release);
+}
+
+} // namespace cm
@@ -0,0 +1,131 @@
+/*
+    Craft Metrics
+
+    This product includes software developed by
+    Craft Metrics (https://craftmetrics.ca/).
+
+    MIT License
+    Copyright (c) 2018 Craft Metrics
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+
+#include "mcp342x_sync.h"
+#include "mcp342x_priv.h"
+
+#include <esp_log.h>
+#include <esp_timer.h>
+
+static const char *TAG = "mcp342x_sync";
+
+namespace cm
+{
+
+MCP342xSyncGroup::MCP342xSyncGroup()
+{
+    this->count = 0;
+    this->triggered = false;
+    this->trigger_us = 0;
+}
+
+esp_err_t MCP342xSyncGroup::AddDevice(MCP342x *device)
+{
+    if (device == NULL)
+    {
+        ESP_LOGE(TAG, "device is NULL");
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (this->count >= MAX_DEVICES)
+    {
+        ESP_LOGE(TAG, "no free device slot");
+        return ESP_ERR_NO_MEM;
+    }
+    this->devices[this->count++] = device;
+    return ESP_OK;
+}
+
+esp_err_t MCP342xSyncGroup::Configure(void)
+{
+    esp_err_t err = ESP_OK;
+    for (size_t i = 0; i < this->count; i++)
+    {
+        /**
+         * The general call conversion latch only applies in one-shot mode
+         */
+        mcp342x_info_t *info = this->devices[i]->GetInfoPtr();
+        mcp342x_set_config(info, mcp342x_config_from_byte((info->config & ~MCP342X_MODE_MASK) | MCP342X_MODE_ONESHOT));
+        esp_err_t device_err = mcp342x_write_config(info);
+        if (device_err != ESP_OK)
+        {
+            ESP_LOGW(TAG, "configure device %d failed: %d", (int)i, device_err);
+            err = device_err;
+        }
+    }
+    return err;
+}
+
+esp_err_t MCP342xSyncGroup::Trigger(void)
+{
+    if (this->count == 0)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    esp_err_t err = mcp342x_general_call(this->devices[0]->GetInfoPtr(), MCP342X_GC_CONVERSION);
+    this->trigger_us = esp_timer_get_time();
+    this->triggered = (err == ESP_OK);
+    if (this->triggered)
+    {
+        for (size_t i = 0; i < this->count; i++)
+        {
+            this->devices[i]->GetInfoPtr()->conversion_start_us = this->trigger_us;
+            this->devices[i]->GetInfoPtr()->stats.conversions++;
+        }
+    }
+    return err;
+}
+
+esp_err_t MCP342xSyncGroup::Collect(mcp342x_sample_t *samples)
+{
+    if (!this->triggered)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    /**
+     * The first read sleeps until its conversion completes, by which time
+     * devices with the same or a faster sample rate are ready as well
+     */
+    esp_err_t err = ESP_OK;
+    for (size_t i = 0; i < this->count; i++)
+    {
+        mcp342x_conversion_status_t status = this->devices[i]->ReadSample(&samples[i]);
+        samples[i].device = i;
+        if (status != MCP342X_STATUS_OK)
+        {
+            MCP342X_SAMPLE_LOGW(TAG, "read device %d failed: %d", (int)i, status);
+            err = (status == MCP342X_STATUS_TIMEOUT) ? ESP_ERR_TIMEOUT : ESP_FAIL;
+        }
+    }
+    this->triggered = false;
+    return err;
+}
+
+} // namespace cm